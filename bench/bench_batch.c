@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * Commands per second of TEEC_InvokeCommandBatch at batch sizes 1, 8 and 64,
+ * against the same commands sent one by one with TEEC_InvokeCommand. With -m
+ * every command also carries a registered memref.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <securec.h>
+#include "tee_client_api.h"
+#include "tee_client_ext_api.h"
+#include "bench_util.h"
+#include "stub_tzdriver.h"
+
+#define BENCH_BATCH_MAX 64
+#define BENCH_SHM_SIZE  4096
+
+struct BatchBench {
+    TEEC_Context context;
+    TEEC_Session session;
+    TEEC_SharedMemory shm;
+    uint8_t buffer[BENCH_SHM_SIZE];
+    bool memref;
+    uint32_t batch;
+    TEEC_Operation operation[BENCH_BATCH_MAX];
+    TEEC_InvokeBatchEntry entry[BENCH_BATCH_MAX];
+};
+
+static struct BatchBench g_bench;
+
+static void InitOperation(struct BatchBench *bench, TEEC_Operation *operation, uint32_t value)
+{
+    (void)memset_s(operation, sizeof(*operation), 0, sizeof(*operation));
+    operation->started = 1;
+    operation->paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+    operation->params[0].value.a = value;
+    if (bench->memref) {
+        operation->paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE, TEEC_NONE, TEEC_NONE);
+        operation->params[1].memref.parent = &bench->shm;
+    }
+}
+
+static bool SingleOp(uint32_t id, void *arg)
+{
+    struct BatchBench *bench = (struct BatchBench *)arg;
+    (void)id;
+
+    return TEEC_InvokeCommand(&bench->session, 0, &bench->operation[0], NULL) == TEEC_SUCCESS;
+}
+
+static bool BatchOp(uint32_t id, void *arg)
+{
+    struct BatchBench *bench = (struct BatchBench *)arg;
+    (void)id;
+
+    return TEEC_InvokeCommandBatch(bench->entry, bench->batch) == TEEC_SUCCESS;
+}
+
+static int RunStep(const char *name, BenchOpFn op, uint32_t batch, uint32_t durationMs)
+{
+    struct BenchResult result;
+
+    g_bench.batch = batch;
+    BenchRunThreads(1, durationMs, op, &g_bench, false, &result);
+    if (result.failed) {
+        fprintf(stderr, "%s %u failed\n", name, batch);
+        return -1;
+    }
+    double rate = BenchOpsPerSec(&result) * batch;
+    printf("%-8s %6u %14.0f %14.1f\n", name, batch, rate, 1e9 / rate);
+    return 0;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-d ms per step] [-w ns per command] [-m]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t batches[] = { 1, 8, BENCH_BATCH_MAX };
+    TEEC_UUID uuid = { 0 };
+    uint32_t durationMs = 1000;
+    uint32_t workNs = 0;
+    int opt;
+    int ret = EXIT_FAILURE;
+
+    while ((opt = getopt(argc, argv, "d:w:m")) != -1) {
+        switch (opt) {
+            case 'd':
+                durationMs = BenchParseU32("d", optarg);
+                break;
+            case 'w':
+                workNs = BenchParseU32("w", optarg);
+                break;
+            case 'm':
+                g_bench.memref = true;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+
+    StubSetCmdCostNs(workNs);
+    if (TEEC_InitializeContext(NULL, &g_bench.context) != TEEC_SUCCESS) {
+        fprintf(stderr, "initialize context failed\n");
+        return EXIT_FAILURE;
+    }
+    if (TEEC_OpenSession(&g_bench.context, &g_bench.session, &uuid, TEEC_LOGIN_IDENTIFY,
+        NULL, NULL, NULL) != TEEC_SUCCESS) {
+        fprintf(stderr, "open session failed\n");
+        goto FINALIZE;
+    }
+    g_bench.shm.buffer = g_bench.buffer;
+    g_bench.shm.size = BENCH_SHM_SIZE;
+    g_bench.shm.flags = TEEC_MEM_INOUT;
+    if (g_bench.memref && TEEC_RegisterSharedMemory(&g_bench.context, &g_bench.shm) != TEEC_SUCCESS) {
+        fprintf(stderr, "register shared memory failed\n");
+        goto CLOSE;
+    }
+    for (uint32_t i = 0; i < BENCH_BATCH_MAX; i++) {
+        InitOperation(&g_bench, &g_bench.operation[i], i);
+        g_bench.entry[i].session = &g_bench.session;
+        g_bench.entry[i].commandID = 0;
+        g_bench.entry[i].operation = &g_bench.operation[i];
+    }
+
+    printf("batch: %u ns per command, %u ms per step%s\n", workNs, durationMs,
+        g_bench.memref ? ", registered memref" : "");
+    printf("%-8s %6s %14s %14s\n", "api", "batch", "commands/s", "ns/command");
+    if (RunStep("invoke", SingleOp, 1, durationMs) != 0) {
+        goto RELEASE;
+    }
+    for (uint32_t i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+        if (RunStep("batch", BatchOp, batches[i], durationMs) != 0) {
+            goto RELEASE;
+        }
+    }
+    ret = EXIT_SUCCESS;
+
+RELEASE:
+    if (g_bench.memref) {
+        TEEC_ReleaseSharedMemory(&g_bench.shm);
+    }
+CLOSE:
+    TEEC_CloseSession(&g_bench.session);
+FINALIZE:
+    TEEC_FinalizeContext(&g_bench.context);
+    return ret;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * Connect storm against the CA daemon of teecd: CaServerWorkThread runs in
+ * this process and 1 to -t client threads keep asking it for a device fd the
+ * way TEEC_InitializeContext does (connect, send a GET_FD request, receive the
+ * fd). The device is a stand-in, opening it costs nothing. With -l one more
+ * client sends its request only after the given delay on every connection,
+ * like a CA that is slow to be scheduled.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <securec.h>
+#include "tc_ns_client.h"
+#include "tee_auth_common.h"
+#include "tee_client_socket.h"
+#include "tee_ca_daemon.h"
+#include "bench_util.h"
+#include "stub_tzdriver.h"
+
+#define BENCH_SERVER_WAIT_MS 2000
+
+struct ConnectBench {
+    CaRevMsg msg;
+    uint32_t lagMs;
+    atomic_bool lagStop;
+    atomic_ulong lagged;
+};
+
+static struct ConnectBench g_bench;
+
+static int ConnectDaemon(void)
+{
+    struct sockaddr_un addr;
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (s < 0) {
+        return -1;
+    }
+    /* same address as FormatSockAddr in tee_ca_daemon.c */
+    (void)memset_s(&addr, sizeof(addr), 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    (void)strcpy_s(addr.sun_path, sizeof(addr.sun_path), TC_NS_SOCKET_NAME);
+    socklen_t len = (socklen_t)(strlen(addr.sun_path) + sizeof(addr.sun_family));
+#ifndef CONFIG_PATH_NAMED_SOCKET
+    addr.sun_path[0] = 0;
+#endif
+    if (connect(s, (struct sockaddr *)&addr, len) != 0) {
+        (void)close(s);
+        return -1;
+    }
+    return s;
+}
+
+/* returns the received device fd, -1 on failure */
+static int RequestFd(int s, const CaRevMsg *msg)
+{
+    RecvTeecdMsg data;
+    char ctrl[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { .iov_base = &data, .iov_len = sizeof(data) };
+    struct msghdr hmsg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl, .msg_controllen = sizeof(ctrl) };
+
+    if (send(s, msg, sizeof(*msg), MSG_NOSIGNAL) != (ssize_t)sizeof(*msg)) {
+        return -1;
+    }
+    if (recvmsg(s, &hmsg, MSG_CMSG_CLOEXEC) <= 0) {
+        return -1;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hmsg); cmsg != NULL; cmsg = CMSG_NXTHDR(&hmsg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int fd;
+            (void)memcpy_s(&fd, sizeof(fd), CMSG_DATA(cmsg), sizeof(fd));
+            return fd;
+        }
+    }
+    return -1;
+}
+
+static bool ConnectOp(uint32_t id, void *arg)
+{
+    struct ConnectBench *bench = (struct ConnectBench *)arg;
+    (void)id;
+
+    int s = ConnectDaemon();
+    if (s < 0) {
+        return false;
+    }
+    int fd = RequestFd(s, &bench->msg);
+    (void)close(s);
+    if (fd < 0) {
+        return false;
+    }
+    (void)close(fd);
+    return true;
+}
+
+static void *LagClientFn(void *data)
+{
+    struct ConnectBench *bench = (struct ConnectBench *)data;
+    struct timespec lag = { bench->lagMs / 1000, (long)(bench->lagMs % 1000) * 1000000L };
+
+    while (!atomic_load(&bench->lagStop)) {
+        int s = ConnectDaemon();
+        if (s < 0) {
+            continue;
+        }
+        (void)nanosleep(&lag, NULL);
+        int fd = RequestFd(s, &bench->msg);
+        (void)close(s);
+        if (fd >= 0) {
+            (void)close(fd);
+            (void)atomic_fetch_add(&bench->lagged, 1);
+        }
+    }
+    return NULL;
+}
+
+static int WaitServer(void)
+{
+    uint64_t deadline = BenchNowNs() + (uint64_t)BENCH_SERVER_WAIT_MS * 1000000;
+    struct timespec ts = { 0, 1000000 };
+
+    while (BenchNowNs() < deadline) {
+        if (ConnectOp(0, &g_bench)) {
+            return 0;
+        }
+        (void)nanosleep(&ts, NULL);
+    }
+    return -1;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t max clients] [-d ms per step] [-l ms a slow client waits before sending]\n",
+        name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t maxClients = 256;
+    uint32_t durationMs = 1000;
+    pthread_t server;
+    pthread_t lagClient;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:d:l:")) != -1) {
+        switch (opt) {
+            case 't':
+                maxClients = BenchParseU32("t", optarg);
+                break;
+            case 'd':
+                durationMs = BenchParseU32("d", optarg);
+                break;
+            case 'l':
+                g_bench.lagMs = BenchParseU32("l", optarg);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (maxClients == 0 || maxClients > BENCH_THREADS_MAX) {
+        Usage(argv[0]);
+    }
+
+    g_bench.msg.cmd = GET_FD;
+    g_bench.msg.caAuthInfo.fromHidlSide = NON_HIDL_SIDE;
+    g_bench.msg.caAuthInfo.pid = getpid();
+    g_bench.msg.caAuthInfo.uid = getuid();
+
+    /* the daemon thread serves until the process exits */
+    if (pthread_create(&server, NULL, CaServerWorkThread, NULL) != 0 || pthread_detach(server) != 0) {
+        fprintf(stderr, "start ca daemon failed\n");
+        return EXIT_FAILURE;
+    }
+    if (WaitServer() != 0) {
+        fprintf(stderr, "ca daemon does not answer on %s\n", TC_NS_SOCKET_NAME);
+        return EXIT_FAILURE;
+    }
+    if (g_bench.lagMs != 0 && pthread_create(&lagClient, NULL, LagClientFn, &g_bench) != 0) {
+        fprintf(stderr, "start slow client failed\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("connect storm: %u ms per step, slow client %u ms\n", durationMs, g_bench.lagMs);
+    printf("%8s %12s %12s %12s\n", "clients", "fds/s", "p50 us", "p99 us");
+    for (uint32_t clients = 1; clients <= maxClients; clients *= 2) {
+        struct BenchResult result;
+        BenchRunThreads(clients, durationMs, ConnectOp, &g_bench, true, &result);
+        if (result.failed) {
+            fprintf(stderr, "connect failed at %u clients: %d\n", clients, errno);
+            return EXIT_FAILURE;
+        }
+        printf("%8u %12.0f %12.1f %12.1f\n", clients, BenchOpsPerSec(&result),
+            (double)result.p50Ns / 1000, (double)result.p99Ns / 1000);
+    }
+    if (g_bench.lagMs != 0) {
+        atomic_store(&g_bench.lagStop, true);
+        (void)pthread_join(lagClient, NULL);
+        printf("slow client served %lu times\n", (unsigned long)atomic_load(&g_bench.lagged));
+    }
+    return EXIT_SUCCESS;
+}
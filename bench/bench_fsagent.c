@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * Secure storage throughput and latency with 1 to -t TAs at once. The fs
+ * agent of teecd runs in this process with the workers it was built for, the
+ * TEE is a stand-in request queue: WAIT_EVENT hands the next request to the
+ * worker by copying it into the worker's control buffer, SEND_EVENT_RESPONSE
+ * copies the answer back to the TA waiting for it. Every TA works on its own
+ * -b byte object over and over, -m picks how:
+ *   commit:  seek, write, fsync, the way secure storage commits an object
+ *   write:   seek, write, the data reaches the kernel but is not synced
+ *   read:    seek, read
+ * /var/itrustee is a temporary directory under -r, so the files are on that
+ * file system.
+ */
+
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <securec.h>
+#include "tc_ns_client.h"
+#include "tee_agent.h"
+#include "fs_work_agent.h"
+#include "bench_util.h"
+#include "stub_tzdriver.h"
+#include "stub_devnode.h"
+
+#define BENCH_AGENTS_MAX 16
+#define BENCH_STORAGE_PREFIX "/var/itrustee"
+#define BENCH_STORAGE_DIR "/var/itrustee/sec_storage_data"
+#define BENCH_WRITE_MAX (TRANS_BUFF_SIZE - offsetof(struct SecStorageType, args.write.buffer))
+
+/* a request of one TA, the control buffer is what the TA would put in the shared buffer */
+struct FsRequest {
+    struct SecStorageType *control;
+    pthread_cond_t cond;
+    bool done;
+    struct FsRequest *next;
+};
+
+/* an fs agent instance registered by AgentInit, one per worker */
+struct FsAgent {
+    int fd;
+    struct SecStorageType *control;
+    struct FsRequest *serving;
+};
+
+struct FsBench {
+    pthread_mutex_t lock;
+    pthread_cond_t requestCond;
+    struct FsRequest *head;
+    struct FsRequest *tail;
+    bool stopping;
+    struct FsAgent agents[BENCH_AGENTS_MAX];
+    uint32_t agentNum;
+    struct FsRequest tas[BENCH_THREADS_MAX];
+    int32_t fds[BENCH_THREADS_MAX];
+    uint32_t taNum;
+    uint32_t bytes;
+    char root[PATH_MAX];
+};
+
+static struct FsBench g_bench = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .requestCond = PTHREAD_COND_INITIALIZER,
+};
+
+/* stands in for tee_agent.c and the agent registration of the driver */
+int AgentInit(unsigned int id, unsigned int bufferSize, void **control)
+{
+    (void)id;
+    if (control == NULL || g_bench.agentNum >= BENCH_AGENTS_MAX || bufferSize < TRANS_BUFF_SIZE) {
+        return -1;
+    }
+    void *buffer = calloc(1, bufferSize);
+    if (buffer == NULL) {
+        return -1;
+    }
+    int fd = StubOpenDevice();
+    if (fd < 0) {
+        free(buffer);
+        return -1;
+    }
+    struct FsAgent *agent = &g_bench.agents[g_bench.agentNum++];
+    agent->fd = fd;
+    agent->control = buffer;
+    *control = buffer;
+    return fd;
+}
+
+void AgentExit(unsigned int id, int fd)
+{
+    (void)id;
+    for (uint32_t i = 0; i < g_bench.agentNum; i++) {
+        if (g_bench.agents[i].fd == fd) {
+            free(g_bench.agents[i].control);
+            g_bench.agents[i].control = NULL;
+            g_bench.agents[i].fd = -1;
+            StubCloseDevice(fd);
+        }
+    }
+}
+
+static struct FsAgent *FindAgent(int fd)
+{
+    /* all agents are registered before the workers start */
+    for (uint32_t i = 0; i < g_bench.agentNum; i++) {
+        if (g_bench.agents[i].fd == fd) {
+            return &g_bench.agents[i];
+        }
+    }
+    return NULL;
+}
+
+static int WaitEvent(struct FsAgent *agent)
+{
+    (void)pthread_mutex_lock(&g_bench.lock);
+    while (g_bench.head == NULL && !g_bench.stopping) {
+        (void)pthread_cond_wait(&g_bench.requestCond, &g_bench.lock);
+    }
+    struct FsRequest *request = g_bench.head;
+    if (request != NULL) {
+        g_bench.head = request->next;
+        if (g_bench.head == NULL) {
+            g_bench.tail = NULL;
+        }
+    }
+    (void)pthread_mutex_unlock(&g_bench.lock);
+
+    /* stopping and nothing left, the worker leaves its loop */
+    if (request == NULL) {
+        return -1;
+    }
+    (void)memcpy_s(agent->control, TRANS_BUFF_SIZE, request->control, TRANS_BUFF_SIZE);
+    agent->serving = request;
+    return 0;
+}
+
+static int SendResponse(struct FsAgent *agent)
+{
+    struct FsRequest *request = agent->serving;
+
+    if (request == NULL) {
+        return -1;
+    }
+    agent->serving = NULL;
+    (void)memcpy_s(request->control, TRANS_BUFF_SIZE, agent->control, TRANS_BUFF_SIZE);
+    (void)pthread_mutex_lock(&g_bench.lock);
+    request->done = true;
+    (void)pthread_cond_signal(&request->cond);
+    (void)pthread_mutex_unlock(&g_bench.lock);
+    return 0;
+}
+
+static bool FsTeeIoctl(int fd, unsigned int cmd, void *arg, int *ret)
+{
+    struct FsAgent *agent = NULL;
+    (void)arg;
+
+    if (cmd != (unsigned int)TC_NS_CLIENT_IOCTL_WAIT_EVENT &&
+        cmd != (unsigned int)TC_NS_CLIENT_IOCTL_SEND_EVENT_RESPONSE) {
+        return false;
+    }
+    agent = FindAgent(fd);
+    if (agent == NULL) {
+        *ret = -1;
+    } else if (cmd == (unsigned int)TC_NS_CLIENT_IOCTL_WAIT_EVENT) {
+        *ret = WaitEvent(agent);
+    } else {
+        *ret = SendResponse(agent);
+    }
+    return true;
+}
+
+/* queue the request of a TA and wait until a worker answered it */
+static int32_t FsCall(struct FsRequest *request)
+{
+    request->done = false;
+    request->next = NULL;
+    (void)pthread_mutex_lock(&g_bench.lock);
+    if (g_bench.tail == NULL) {
+        g_bench.head = request;
+    } else {
+        g_bench.tail->next = request;
+    }
+    g_bench.tail = request;
+    (void)pthread_cond_signal(&g_bench.requestCond);
+    while (!request->done) {
+        (void)pthread_cond_wait(&request->cond, &g_bench.lock);
+    }
+    (void)pthread_mutex_unlock(&g_bench.lock);
+    return request->control->ret;
+}
+
+static bool SeekStart(struct FsBench *bench, uint32_t id)
+{
+    struct SecStorageType *control = bench->tas[id].control;
+
+    control->cmd = SEC_SEEK;
+    control->args.seek.fd = bench->fds[id];
+    control->args.seek.offset = 0;
+    control->args.seek.whence = SEEK_SET;
+    return FsCall(&bench->tas[id]) == 0;
+}
+
+/* written as SSA, so the agent flushes it to the kernel */
+static bool WriteObject(struct FsBench *bench, uint32_t id)
+{
+    struct SecStorageType *control = bench->tas[id].control;
+
+    control->cmd = SEC_WRITE;
+    control->ret2 = SEC_WRITE_SSA;
+    control->args.write.fd = bench->fds[id];
+    control->args.write.count = bench->bytes;
+    return FsCall(&bench->tas[id]) == (int32_t)bench->bytes;
+}
+
+static bool ReadObject(struct FsBench *bench, uint32_t id)
+{
+    struct SecStorageType *control = bench->tas[id].control;
+
+    control->cmd = SEC_READ;
+    control->args.read.fd = bench->fds[id];
+    control->args.read.count = bench->bytes;
+    return FsCall(&bench->tas[id]) == (int32_t)bench->bytes;
+}
+
+static bool SyncObject(struct FsBench *bench, uint32_t id)
+{
+    struct SecStorageType *control = bench->tas[id].control;
+
+    control->cmd = SEC_FSYNC;
+    control->args.fsync.fd = bench->fds[id];
+    return FsCall(&bench->tas[id]) == 0;
+}
+
+static bool CommitOp(uint32_t id, void *arg)
+{
+    struct FsBench *bench = (struct FsBench *)arg;
+    return SeekStart(bench, id) && WriteObject(bench, id) && SyncObject(bench, id);
+}
+
+static bool WriteOp(uint32_t id, void *arg)
+{
+    struct FsBench *bench = (struct FsBench *)arg;
+    return SeekStart(bench, id) && WriteObject(bench, id);
+}
+
+static bool ReadOp(uint32_t id, void *arg)
+{
+    struct FsBench *bench = (struct FsBench *)arg;
+    return SeekStart(bench, id) && ReadObject(bench, id);
+}
+
+struct FsMode {
+    const char *name;
+    BenchOpFn op;
+};
+
+static const struct FsMode g_fsModes[] = {
+    { "commit", CommitOp },
+    { "write", WriteOp },
+    { "read", ReadOp },
+};
+
+static int OpenObjects(struct FsBench *bench)
+{
+    for (uint32_t i = 0; i < bench->taNum; i++) {
+        struct SecStorageType *control = bench->tas[i].control;
+        char name[FILE_NAME_MAX_BUF];
+
+        if (snprintf_s(name, sizeof(name), sizeof(name) - 1, "bench/ta%u", i) < 0) {
+            return -1;
+        }
+        (void)memset_s(control, TRANS_BUFF_SIZE, 0, TRANS_BUFF_SIZE);
+        control->cmd = SEC_CREATE;
+        control->args.open.nameLen = (uint32_t)strlen(name) + 1;
+        (void)strcpy_s((char *)control->args.open.name,
+            TRANS_BUFF_SIZE - offsetof(struct SecStorageType, args.open.name), name);
+        bench->fds[i] = FsCall(&bench->tas[i]);
+        if (bench->fds[i] < 0) {
+            fprintf(stderr, "create %s failed: %u\n", name, control->error);
+            return -1;
+        }
+        /* the object has its size from the start, so every mode reads and writes the same bytes */
+        if (!WriteObject(bench, i)) {
+            fprintf(stderr, "write %s failed: %u\n", name, control->error);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void CloseObjects(struct FsBench *bench)
+{
+    for (uint32_t i = 0; i < bench->taNum; i++) {
+        if (bench->fds[i] >= 0) {
+            bench->tas[i].control->cmd = SEC_CLOSE;
+            bench->tas[i].control->args.close.fd = bench->fds[i];
+            (void)FsCall(&bench->tas[i]);
+            bench->fds[i] = -1;
+        }
+    }
+}
+
+static int AllocRequests(struct FsBench *bench)
+{
+    for (uint32_t i = 0; i < bench->taNum; i++) {
+        bench->fds[i] = -1;
+        (void)pthread_cond_init(&bench->tas[i].cond, NULL);
+        bench->tas[i].control = calloc(1, TRANS_BUFF_SIZE);
+        if (bench->tas[i].control == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void FreeRequests(struct FsBench *bench)
+{
+    for (uint32_t i = 0; i < bench->taNum; i++) {
+        free(bench->tas[i].control);
+        bench->tas[i].control = NULL;
+        (void)pthread_cond_destroy(&bench->tas[i].cond);
+    }
+}
+
+/* the directories the agent expects exist, it only creates the ones of the objects */
+static int MakeRoot(struct FsBench *bench, const char *dir)
+{
+    char path[PATH_MAX];
+
+    if (snprintf_s(path, sizeof(path), sizeof(path) - 1, "%s/bench_fsXXXXXX", dir) < 0 ||
+        mkdtemp(path) == NULL || realpath(path, bench->root) == NULL) {
+        return -1;
+    }
+    const char *dirs[] = { "/var", "/var/itrustee", BENCH_STORAGE_DIR };
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        if (snprintf_s(path, sizeof(path), sizeof(path) - 1, "%s%s", bench->root, dirs[i]) < 0 ||
+            mkdir(path, S_IRWXU) != 0) {
+            return -1;
+        }
+    }
+    StubSetPathRoot(BENCH_STORAGE_PREFIX, bench->root);
+    return 0;
+}
+
+static int RemoveEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static void RemoveRoot(struct FsBench *bench)
+{
+    StubSetPathRoot(NULL, NULL);
+    if (bench->root[0] != '\0') {
+        (void)nftw(bench->root, RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+}
+
+static void StopAgent(void)
+{
+    (void)pthread_mutex_lock(&g_bench.lock);
+    g_bench.stopping = true;
+    (void)pthread_cond_broadcast(&g_bench.requestCond);
+    (void)pthread_mutex_unlock(&g_bench.lock);
+    FsAgentThreadJoin();
+    FsAgentExit();
+}
+
+static const struct FsMode *FindMode(const char *name)
+{
+    for (size_t i = 0; i < sizeof(g_fsModes) / sizeof(g_fsModes[0]); i++) {
+        if (strcmp(g_fsModes[i].name, name) == 0) {
+            return &g_fsModes[i];
+        }
+    }
+    return NULL;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t max TAs] [-d ms per step] [-b bytes per object, at most %zu] "
+        "[-r directory for the files] [-m commit|write|read]\n", name, BENCH_WRITE_MAX);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t maxTas = 32;
+    uint32_t durationMs = 1000;
+    const char *dir = "/tmp";
+    const struct FsMode *mode = &g_fsModes[0];
+    int opt;
+    int ret = EXIT_FAILURE;
+
+    g_bench.bytes = 1024;
+    while ((opt = getopt(argc, argv, "t:d:b:r:m:")) != -1) {
+        switch (opt) {
+            case 't':
+                maxTas = BenchParseU32("t", optarg);
+                break;
+            case 'd':
+                durationMs = BenchParseU32("d", optarg);
+                break;
+            case 'b':
+                g_bench.bytes = BenchParseU32("b", optarg);
+                break;
+            case 'r':
+                dir = optarg;
+                break;
+            case 'm':
+                mode = FindMode(optarg);
+                if (mode == NULL) {
+                    Usage(argv[0]);
+                }
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (maxTas == 0 || maxTas > BENCH_THREADS_MAX || g_bench.bytes == 0 || g_bench.bytes > BENCH_WRITE_MAX) {
+        Usage(argv[0]);
+    }
+
+    g_bench.taNum = maxTas;
+    if (AllocRequests(&g_bench) != 0 || MakeRoot(&g_bench, dir) != 0) {
+        fprintf(stderr, "set up under %s failed: %d\n", dir, errno);
+        goto REMOVE;
+    }
+    StubSetIoctlHook(FsTeeIoctl);
+    if (FsAgentInit() != 0) {
+        fprintf(stderr, "fs agent init failed\n");
+        goto REMOVE;
+    }
+    FsAgentThreadCreate();
+    if (OpenObjects(&g_bench) != 0) {
+        goto STOP;
+    }
+
+    printf("fs agent %s: %u workers, %u byte objects in %s, %u ms per step\n", mode->name, g_bench.agentNum,
+        g_bench.bytes, dir, durationMs);
+    printf("%8s %12s %12s %12s\n", "TAs", "ops/s", "p50 us", "p99 us");
+    for (uint32_t tas = 1; tas <= maxTas; tas *= 2) {
+        struct BenchResult result;
+        BenchRunThreads(tas, durationMs, mode->op, &g_bench, true, &result);
+        if (result.failed) {
+            fprintf(stderr, "%s failed at %u TAs\n", mode->name, tas);
+            goto CLOSE;
+        }
+        printf("%8u %12.0f %12.1f %12.1f\n", tas, BenchOpsPerSec(&result),
+            (double)result.p50Ns / 1000, (double)result.p99Ns / 1000);
+    }
+    ret = EXIT_SUCCESS;
+
+CLOSE:
+    CloseObjects(&g_bench);
+STOP:
+    StopAgent();
+REMOVE:
+    StubSetIoctlHook(NULL);
+    RemoveRoot(&g_bench);
+    FreeRequests(&g_bench);
+    return ret;
+}
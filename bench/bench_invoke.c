@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * TEEC_InvokeCommand throughput as the number of invoking threads grows.
+ * Thread i invokes on the session of context i % contexts, every invoke
+ * looks its context up by fd, which is what the context registry serves.
+ * With -m every invoke also passes a registered shared memory of its
+ * context, adding the shared memory get/put to the path.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <securec.h>
+#include "tee_client_api.h"
+#include "bench_util.h"
+#include "stub_tzdriver.h"
+
+#define BENCH_CONTEXTS_MAX 256
+#define BENCH_SHM_SIZE     4096
+
+struct InvokeBench {
+    uint32_t contexts;
+    bool memref;
+    TEEC_Context context[BENCH_CONTEXTS_MAX];
+    TEEC_Session session[BENCH_CONTEXTS_MAX];
+    TEEC_SharedMemory shm[BENCH_CONTEXTS_MAX];
+    uint8_t buffer[BENCH_CONTEXTS_MAX][BENCH_SHM_SIZE];
+};
+
+static struct InvokeBench g_bench;
+
+static bool InvokeOp(uint32_t id, void *arg)
+{
+    struct InvokeBench *bench = (struct InvokeBench *)arg;
+    uint32_t index = id % bench->contexts;
+    TEEC_Operation operation;
+
+    (void)memset_s(&operation, sizeof(operation), 0, sizeof(operation));
+    operation.started = 1;
+    operation.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+    operation.params[0].value.a = id;
+    if (bench->memref) {
+        operation.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE, TEEC_NONE, TEEC_NONE);
+        operation.params[1].memref.parent = &bench->shm[index];
+    }
+    return TEEC_InvokeCommand(&bench->session[index], 0, &operation, NULL) == TEEC_SUCCESS;
+}
+
+static int OpenContexts(struct InvokeBench *bench)
+{
+    TEEC_UUID uuid = { 0 };
+
+    for (uint32_t i = 0; i < bench->contexts; i++) {
+        if (TEEC_InitializeContext(NULL, &bench->context[i]) != TEEC_SUCCESS) {
+            fprintf(stderr, "initialize context %u failed\n", i);
+            return -1;
+        }
+        if (TEEC_OpenSession(&bench->context[i], &bench->session[i], &uuid, TEEC_LOGIN_IDENTIFY,
+            NULL, NULL, NULL) != TEEC_SUCCESS) {
+            fprintf(stderr, "open session %u failed\n", i);
+            return -1;
+        }
+        if (!bench->memref) {
+            continue;
+        }
+        bench->shm[i].buffer = bench->buffer[i];
+        bench->shm[i].size = BENCH_SHM_SIZE;
+        bench->shm[i].flags = TEEC_MEM_INOUT;
+        if (TEEC_RegisterSharedMemory(&bench->context[i], &bench->shm[i]) != TEEC_SUCCESS) {
+            fprintf(stderr, "register shared memory %u failed\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void CloseContexts(struct InvokeBench *bench)
+{
+    for (uint32_t i = 0; i < bench->contexts; i++) {
+        if (bench->memref) {
+            TEEC_ReleaseSharedMemory(&bench->shm[i]);
+        }
+        TEEC_CloseSession(&bench->session[i]);
+        TEEC_FinalizeContext(&bench->context[i]);
+    }
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-c contexts] [-t max threads] [-d ms per step] [-w ns per command] [-m]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t maxThreads = 64;
+    uint32_t durationMs = 1000;
+    uint32_t workNs = 0;
+    int opt;
+
+    g_bench.contexts = 1;
+    while ((opt = getopt(argc, argv, "c:t:d:w:m")) != -1) {
+        switch (opt) {
+            case 'c':
+                g_bench.contexts = BenchParseU32("c", optarg);
+                break;
+            case 't':
+                maxThreads = BenchParseU32("t", optarg);
+                break;
+            case 'd':
+                durationMs = BenchParseU32("d", optarg);
+                break;
+            case 'w':
+                workNs = BenchParseU32("w", optarg);
+                break;
+            case 'm':
+                g_bench.memref = true;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (g_bench.contexts == 0 || g_bench.contexts > BENCH_CONTEXTS_MAX ||
+        maxThreads == 0 || maxThreads > BENCH_THREADS_MAX) {
+        Usage(argv[0]);
+    }
+
+    StubSetCmdCostNs(workNs);
+    if (OpenContexts(&g_bench) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    printf("invoke: %u contexts, %u ns per command, %u ms per step%s\n", g_bench.contexts, workNs, durationMs,
+        g_bench.memref ? ", registered memref" : "");
+    printf("%8s %14s %14s\n", "threads", "invokes/s", "ns/invoke");
+    for (uint32_t threads = 1; threads <= maxThreads; threads *= 2) {
+        struct BenchResult result;
+        BenchRunThreads(threads, durationMs, InvokeOp, &g_bench, false, &result);
+        if (result.failed) {
+            fprintf(stderr, "invoke failed at %u threads\n", threads);
+            CloseContexts(&g_bench);
+            return EXIT_FAILURE;
+        }
+        double rate = BenchOpsPerSec(&result);
+        printf("%8u %14.0f %14.1f\n", threads, rate, (double)threads * 1e9 / rate);
+    }
+
+    CloseContexts(&g_bench);
+    return EXIT_SUCCESS;
+}
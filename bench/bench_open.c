@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * TEEC_OpenSession/TEEC_CloseSession latency of a TA loaded from a .sec file
+ * set as context->ta_path, so every open goes through TEEC_GetApp.
+ *   unchanged:  the file stays as it is, opens after the first may reuse the image
+ *   touched:    the mtime changes before every open, every open reads the file
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <securec.h>
+#include "tee_client_api.h"
+#include "tee_client_app_load.h"
+#include "bench_util.h"
+#include "stub_tzdriver.h"
+
+#define BENCH_MB (1024U * 1024U)
+
+struct OpenBench {
+    TEEC_Context context;
+    char path[64];
+    int fd;
+    bool touch;
+    long touchNs;
+};
+
+static struct OpenBench g_bench;
+
+static bool OpenCloseOp(uint32_t id, void *arg)
+{
+    struct OpenBench *bench = (struct OpenBench *)arg;
+    TEEC_UUID uuid = { 0 };
+    TEEC_Session session;
+    (void)id;
+
+    if (bench->touch) {
+        /* a new mtime on every open, the nanoseconds are enough to tell them apart */
+        struct timespec times[2] = { { 0, UTIME_OMIT }, { 1, 0 } };
+        bench->touchNs = (bench->touchNs + 1) % 1000000000L;
+        times[1].tv_nsec = bench->touchNs;
+        if (futimens(bench->fd, times) != 0) {
+            return false;
+        }
+    }
+    if (TEEC_OpenSession(&bench->context, &session, &uuid, TEEC_LOGIN_IDENTIFY, NULL, NULL, NULL) != TEEC_SUCCESS) {
+        return false;
+    }
+    TEEC_CloseSession(&session);
+    return true;
+}
+
+/* an image with the old version head, the rest is never looked at on this side */
+static int WriteImage(struct OpenBench *bench, uint32_t size)
+{
+    TeecImageHead head = { 0 };
+    char *image = calloc(1, size);
+
+    if (image == NULL) {
+        return -1;
+    }
+    head.context_len = size - (uint32_t)sizeof(head);
+    (void)memcpy_s(image, size, &head, sizeof(head));
+
+    (void)strcpy_s(bench->path, sizeof(bench->path), "/tmp/bench_taXXXXXX.sec");
+    bench->fd = mkstemps(bench->path, (int)strlen(".sec"));
+    if (bench->fd < 0) {
+        free(image);
+        return -1;
+    }
+    ssize_t written = write(bench->fd, image, size);
+    free(image);
+    return (written == (ssize_t)size) ? 0 : -1;
+}
+
+static int RunMode(const char *name, bool touch, uint32_t durationMs)
+{
+    struct BenchResult result;
+
+    g_bench.touch = touch;
+    BenchRunThreads(1, durationMs, OpenCloseOp, &g_bench, true, &result);
+    if (result.failed) {
+        fprintf(stderr, "%s: open session failed\n", name);
+        return -1;
+    }
+    printf("%-10s %12.0f %12.1f %12.1f\n", name, BenchOpsPerSec(&result),
+        (double)result.p50Ns / 1000, (double)result.p99Ns / 1000);
+    return 0;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-s image MB] [-d ms per mode] [-o ns per session open]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t sizeMb = 4;
+    uint32_t durationMs = 1000;
+    uint32_t openNs = 0;
+    int opt;
+    int ret = EXIT_FAILURE;
+
+    while ((opt = getopt(argc, argv, "s:d:o:")) != -1) {
+        switch (opt) {
+            case 's':
+                sizeMb = BenchParseU32("s", optarg);
+                break;
+            case 'd':
+                durationMs = BenchParseU32("d", optarg);
+                break;
+            case 'o':
+                openNs = BenchParseU32("o", optarg);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (sizeMb == 0 || sizeMb * BENCH_MB > MAX_IMAGE_LEN) {
+        fprintf(stderr, "image size must be 1..%u MB\n", MAX_IMAGE_LEN / BENCH_MB);
+        Usage(argv[0]);
+    }
+
+    StubSetOpenCostNs(openNs);
+    g_bench.fd = -1;
+    if (WriteImage(&g_bench, sizeMb * BENCH_MB) != 0) {
+        fprintf(stderr, "write image failed\n");
+        goto UNLINK;
+    }
+    if (TEEC_InitializeContext(NULL, &g_bench.context) != TEEC_SUCCESS) {
+        fprintf(stderr, "initialize context failed\n");
+        goto UNLINK;
+    }
+    g_bench.context.ta_path = (uint8_t *)g_bench.path;
+
+    printf("open/close: %u MB image, %u ns per session open, %u ms per mode\n", sizeMb, openNs, durationMs);
+    printf("%-10s %12s %12s %12s\n", "file", "opens/s", "p50 us", "p99 us");
+    if (RunMode("unchanged", false, durationMs) == 0 && RunMode("touched", true, durationMs) == 0) {
+        ret = EXIT_SUCCESS;
+    }
+
+    g_bench.context.ta_path = NULL;
+    TEEC_FinalizeContext(&g_bench.context);
+UNLINK:
+    if (g_bench.fd >= 0) {
+        (void)close(g_bench.fd);
+        (void)unlink(g_bench.path);
+    }
+    return ret;
+}
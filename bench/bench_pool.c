@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * TEEC_SessionPoolInvoke throughput and latency from 1 to -t threads. With
+ * the stand-in command taking no time the latency is the session checkout,
+ * the invoke and the return; once threads outnumber the pool it includes
+ * waiting for a session, and the operations of the least and the most
+ * served thread show how evenly the sessions are shared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <securec.h>
+#include "tee_client_api.h"
+#include "tee_session_pool.h"
+#include "bench_util.h"
+#include "stub_tzdriver.h"
+
+#define BENCH_READY_WAIT_MS 5000
+
+struct PoolBench {
+    TEEC_Context context;
+    struct SessionPool *pool;
+};
+
+static struct PoolBench g_bench;
+
+static bool PoolInvokeOp(uint32_t id, void *arg)
+{
+    struct PoolBench *bench = (struct PoolBench *)arg;
+    TEEC_Operation operation;
+
+    (void)memset_s(&operation, sizeof(operation), 0, sizeof(operation));
+    operation.started = 1;
+    operation.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+    operation.params[0].value.a = id;
+    return TEEC_SessionPoolInvoke(bench->pool, 0, &operation, NULL) == TEEC_SUCCESS;
+}
+
+/* sessions may be opened in the background, measure only once all of them are */
+static int WaitPoolOpened(struct SessionPool *pool)
+{
+    uint64_t deadline = BenchNowNs() + (uint64_t)BENCH_READY_WAIT_MS * 1000000;
+    struct timespec ts = { 0, 1000000 };
+
+    while (BenchNowNs() < deadline) {
+        uint32_t size = 0;
+        uint32_t opened = 0;
+        uint32_t inuse = 0;
+        TEEC_SessionPoolQuery(pool, &size, &opened, &inuse, false);
+        if (opened == size) {
+            return 0;
+        }
+        (void)nanosleep(&ts, NULL);
+    }
+    return -1;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-p pool size] [-t max threads] [-d ms per step] [-w ns per command]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    TEEC_UUID uuid = { 0 };
+    uint32_t poolSize = 16;
+    uint32_t maxThreads = 128;
+    uint32_t durationMs = 1000;
+    uint32_t workNs = 0;
+    int opt;
+    int ret = EXIT_FAILURE;
+
+    while ((opt = getopt(argc, argv, "p:t:d:w:")) != -1) {
+        switch (opt) {
+            case 'p':
+                poolSize = BenchParseU32("p", optarg);
+                break;
+            case 't':
+                maxThreads = BenchParseU32("t", optarg);
+                break;
+            case 'd':
+                durationMs = BenchParseU32("d", optarg);
+                break;
+            case 'w':
+                workNs = BenchParseU32("w", optarg);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (maxThreads == 0 || maxThreads > BENCH_THREADS_MAX) {
+        Usage(argv[0]);
+    }
+
+    StubSetCmdCostNs(workNs);
+    if (TEEC_InitializeContext(NULL, &g_bench.context) != TEEC_SUCCESS) {
+        fprintf(stderr, "initialize context failed\n");
+        return EXIT_FAILURE;
+    }
+    if (TEEC_SessionPoolCreate(&g_bench.context, &uuid, &g_bench.pool, poolSize) != TEEC_SUCCESS) {
+        fprintf(stderr, "create session pool of %u failed\n", poolSize);
+        goto FINALIZE;
+    }
+    if (WaitPoolOpened(g_bench.pool) != 0) {
+        fprintf(stderr, "session pool not opened in %u ms\n", BENCH_READY_WAIT_MS);
+        goto DESTROY;
+    }
+
+    printf("session pool: %u sessions, %u ns per command, %u ms per step\n", poolSize, workNs, durationMs);
+    printf("%8s %14s %12s %12s %20s\n", "threads", "invokes/s", "p50 ns", "p99 ns", "min/max per thread");
+    for (uint32_t threads = 1; threads <= maxThreads; threads *= 2) {
+        struct BenchResult result;
+        BenchRunThreads(threads, durationMs, PoolInvokeOp, &g_bench, true, &result);
+        if (result.failed) {
+            fprintf(stderr, "pool invoke failed at %u threads\n", threads);
+            goto DESTROY;
+        }
+        printf("%8u %14.0f %12lu %12lu %9lu/%-10lu\n", threads, BenchOpsPerSec(&result),
+            (unsigned long)result.p50Ns, (unsigned long)result.p99Ns,
+            (unsigned long)result.minThreadOps, (unsigned long)result.maxThreadOps);
+    }
+    ret = EXIT_SUCCESS;
+
+DESTROY:
+    TEEC_SessionPoolDestroy(g_bench.pool);
+FINALIZE:
+    TEEC_FinalizeContext(&g_bench.context);
+    return ret;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * Per-invoke cost of TEEC_InvokeCommand against TEEC_InvokePrepared for the
+ * same operation, with the stand-in command taking no time this is the
+ * client-side overhead of validating and encoding.
+ *   values:   two value parameters
+ *   memrefs:  a value, a whole and a partial memref of registered memory,
+ *             the context holds -s other registrations as well
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <securec.h>
+#include "tee_client_api.h"
+#include "tee_client_ext_api.h"
+#include "bench_util.h"
+#include "stub_tzdriver.h"
+
+#define BENCH_SHM_SIZE  4096
+#define BENCH_OTHER_MAX 1024
+
+struct PreparedBench {
+    TEEC_Context context;
+    TEEC_Session session;
+    TEEC_Operation operation;
+    TEEC_PreparedOperation *prepared;
+    TEEC_SharedMemory shm[2];
+    uint8_t buffer[2][BENCH_SHM_SIZE];
+    uint32_t others;
+    uint32_t registered;
+    TEEC_SharedMemory other[BENCH_OTHER_MAX];
+    uint8_t otherBuffer[BENCH_OTHER_MAX];
+};
+
+static struct PreparedBench g_bench;
+
+static bool InvokeOp(uint32_t id, void *arg)
+{
+    struct PreparedBench *bench = (struct PreparedBench *)arg;
+
+    bench->operation.params[0].value.a = id;
+    return TEEC_InvokeCommand(&bench->session, 0, &bench->operation, NULL) == TEEC_SUCCESS;
+}
+
+static bool PreparedOp(uint32_t id, void *arg)
+{
+    struct PreparedBench *bench = (struct PreparedBench *)arg;
+
+    bench->operation.params[0].value.a = id;
+    return TEEC_InvokePrepared(bench->prepared, NULL) == TEEC_SUCCESS;
+}
+
+static void SetValues(TEEC_Operation *operation)
+{
+    (void)memset_s(operation, sizeof(*operation), 0, sizeof(*operation));
+    operation->started = 1;
+    operation->paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INOUT, TEEC_NONE, TEEC_NONE);
+}
+
+static void SetMemrefs(struct PreparedBench *bench, TEEC_Operation *operation)
+{
+    (void)memset_s(operation, sizeof(*operation), 0, sizeof(*operation));
+    operation->started = 1;
+    operation->paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE,
+        TEEC_MEMREF_PARTIAL_INOUT, TEEC_NONE);
+    operation->params[1].memref.parent = &bench->shm[0];
+    operation->params[2].memref.parent = &bench->shm[1];
+    operation->params[2].memref.offset = BENCH_SHM_SIZE / 2;
+    operation->params[2].memref.size = BENCH_SHM_SIZE / 4;
+}
+
+static int RunStep(const char *name, BenchOpFn op, uint32_t durationMs, double *nsPerOp)
+{
+    struct BenchResult result;
+
+    BenchRunThreads(1, durationMs, op, &g_bench, false, &result);
+    if (result.failed) {
+        fprintf(stderr, "%s failed\n", name);
+        return -1;
+    }
+    *nsPerOp = 1e9 / BenchOpsPerSec(&result);
+    return 0;
+}
+
+static int RunMode(const char *mode, uint32_t durationMs)
+{
+    double invokeNs;
+    double preparedNs;
+
+    if (RunStep("invoke", InvokeOp, durationMs, &invokeNs) != 0) {
+        return -1;
+    }
+    if (TEEC_PrepareOperation(&g_bench.session, 0, &g_bench.operation, &g_bench.prepared) != TEEC_SUCCESS) {
+        fprintf(stderr, "prepare operation failed\n");
+        return -1;
+    }
+    int ret = RunStep("prepared", PreparedOp, durationMs, &preparedNs);
+    TEEC_ReleasePreparedOperation(g_bench.prepared);
+    g_bench.prepared = NULL;
+    if (ret != 0) {
+        return -1;
+    }
+    printf("%-8s %14.1f %14.1f %9.0f%%\n", mode, invokeNs, preparedNs, (1.0 - preparedNs / invokeNs) * 100);
+    return 0;
+}
+
+static TEEC_SharedMemory *NthShm(struct PreparedBench *bench, uint32_t n)
+{
+    return (n < 2) ? &bench->shm[n] : &bench->other[n - 2];
+}
+
+static int RegisterAll(struct PreparedBench *bench)
+{
+    for (uint32_t i = 0; i < 2; i++) {
+        bench->shm[i].buffer = bench->buffer[i];
+        bench->shm[i].size = BENCH_SHM_SIZE;
+        bench->shm[i].flags = TEEC_MEM_INOUT;
+    }
+    for (uint32_t i = 0; i < bench->others; i++) {
+        /* only bookkeeping on the client side, one byte each is enough to keep them distinct */
+        bench->other[i].buffer = &bench->otherBuffer[i];
+        bench->other[i].size = 1;
+        bench->other[i].flags = TEEC_MEM_INPUT;
+    }
+    for (; bench->registered < bench->others + 2; bench->registered++) {
+        if (TEEC_RegisterSharedMemory(&bench->context, NthShm(bench, bench->registered)) != TEEC_SUCCESS) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void ReleaseAll(struct PreparedBench *bench)
+{
+    for (uint32_t i = 0; i < bench->registered; i++) {
+        TEEC_ReleaseSharedMemory(NthShm(bench, i));
+    }
+    bench->registered = 0;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-d ms per step] [-s other registrations]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    TEEC_UUID uuid = { 0 };
+    uint32_t durationMs = 1000;
+    int opt;
+    int ret = EXIT_FAILURE;
+
+    g_bench.others = 16;
+    while ((opt = getopt(argc, argv, "d:s:")) != -1) {
+        switch (opt) {
+            case 'd':
+                durationMs = BenchParseU32("d", optarg);
+                break;
+            case 's':
+                g_bench.others = BenchParseU32("s", optarg);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (g_bench.others > BENCH_OTHER_MAX) {
+        Usage(argv[0]);
+    }
+
+    if (TEEC_InitializeContext(NULL, &g_bench.context) != TEEC_SUCCESS) {
+        fprintf(stderr, "initialize context failed\n");
+        return EXIT_FAILURE;
+    }
+    if (TEEC_OpenSession(&g_bench.context, &g_bench.session, &uuid, TEEC_LOGIN_IDENTIFY,
+        NULL, NULL, NULL) != TEEC_SUCCESS) {
+        fprintf(stderr, "open session failed\n");
+        goto FINALIZE;
+    }
+    if (RegisterAll(&g_bench) != 0) {
+        fprintf(stderr, "register shared memory failed\n");
+        goto RELEASE;
+    }
+
+    printf("prepared: %u other registrations, %u ms per step\n", g_bench.others, durationMs);
+    printf("%-8s %14s %14s %10s\n", "params", "invoke ns", "prepared ns", "saved");
+    SetValues(&g_bench.operation);
+    if (RunMode("values", durationMs) != 0) {
+        goto RELEASE;
+    }
+    SetMemrefs(&g_bench, &g_bench.operation);
+    if (RunMode("memrefs", durationMs) != 0) {
+        goto RELEASE;
+    }
+    ret = EXIT_SUCCESS;
+
+RELEASE:
+    ReleaseAll(&g_bench);
+    TEEC_CloseSession(&g_bench.session);
+FINALIZE:
+    TEEC_FinalizeContext(&g_bench.context);
+    return ret;
+}
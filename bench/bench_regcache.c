@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * Cost of a TEEC_RegisterSharedMemory/TEEC_InvokeCommand/TEEC_ReleaseSharedMemory
+ * loop, the pattern of CAs registering their buffers around every request.
+ *   same:    the same buffer every time, served by the registration cache
+ *   cycle:   more distinct buffers than the cache keeps, every register misses
+ *   pinned:  the same buffer pinned with TEEC_EXT_PinSharedMemory
+ * Built against a tree without the pin API the pinned mode is skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <securec.h>
+#include "tee_client_api.h"
+#include "tee_client_ext_api.h"
+#include "bench_util.h"
+#include "stub_tzdriver.h"
+
+#define BENCH_SHM_SIZE       4096
+#define BENCH_CYCLE_BUFFERS  256     /* well above REG_CACHE_MAX */
+
+/* weak so that the benchmark also links against libteec without the pin API */
+extern TEEC_Result TEEC_EXT_PinSharedMemory(TEEC_Session *session, TEEC_SharedMemory *sharedMem)
+    __attribute__((weak));
+
+struct RegBench {
+    TEEC_Context context;
+    TEEC_Session session;
+    uint32_t buffers;
+    uint32_t next;
+    uint8_t *buffer[BENCH_CYCLE_BUFFERS];
+};
+
+static struct RegBench g_bench;
+
+static bool RegInvokeRelease(uint32_t id, void *arg)
+{
+    struct RegBench *bench = (struct RegBench *)arg;
+    TEEC_SharedMemory shm;
+    TEEC_Operation operation;
+    (void)id;
+
+    (void)memset_s(&shm, sizeof(shm), 0, sizeof(shm));
+    shm.buffer = bench->buffer[bench->next];
+    shm.size = BENCH_SHM_SIZE;
+    shm.flags = TEEC_MEM_INOUT;
+    bench->next = (bench->next + 1) % bench->buffers;
+    if (TEEC_RegisterSharedMemory(&bench->context, &shm) != TEEC_SUCCESS) {
+        return false;
+    }
+
+    (void)memset_s(&operation, sizeof(operation), 0, sizeof(operation));
+    operation.started = 1;
+    operation.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_WHOLE, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+    operation.params[0].memref.parent = &shm;
+    TEEC_Result ret = TEEC_InvokeCommand(&bench->session, 0, &operation, NULL);
+    TEEC_ReleaseSharedMemory(&shm);
+    return ret == TEEC_SUCCESS;
+}
+
+static int PinFirstBuffer(struct RegBench *bench)
+{
+    TEEC_SharedMemory shm;
+
+    (void)memset_s(&shm, sizeof(shm), 0, sizeof(shm));
+    shm.buffer = bench->buffer[0];
+    shm.size = BENCH_SHM_SIZE;
+    shm.flags = TEEC_MEM_INOUT;
+    if (TEEC_RegisterSharedMemory(&bench->context, &shm) != TEEC_SUCCESS) {
+        return -1;
+    }
+    TEEC_Result ret = TEEC_EXT_PinSharedMemory(&bench->session, &shm);
+    TEEC_ReleaseSharedMemory(&shm);
+    return (ret == TEEC_SUCCESS) ? 0 : -1;
+}
+
+static int RunMode(const char *name, uint32_t buffers, uint32_t durationMs)
+{
+    struct BenchResult result;
+
+    g_bench.buffers = buffers;
+    g_bench.next = 0;
+    BenchRunThreads(1, durationMs, RegInvokeRelease, &g_bench, false, &result);
+    if (result.failed) {
+        fprintf(stderr, "%s: register/invoke/release failed\n", name);
+        return -1;
+    }
+    double rate = BenchOpsPerSec(&result);
+    printf("%-8s %10u %14.0f %14.1f\n", name, buffers, rate, 1e9 / rate);
+    return 0;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-d ms per mode] [-w ns per command]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    TEEC_UUID uuid = { 0 };
+    uint32_t durationMs = 1000;
+    uint32_t workNs = 0;
+    int opt;
+    int ret = EXIT_FAILURE;
+
+    while ((opt = getopt(argc, argv, "d:w:")) != -1) {
+        switch (opt) {
+            case 'd':
+                durationMs = BenchParseU32("d", optarg);
+                break;
+            case 'w':
+                workNs = BenchParseU32("w", optarg);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+
+    StubSetCmdCostNs(workNs);
+    for (uint32_t i = 0; i < BENCH_CYCLE_BUFFERS; i++) {
+        g_bench.buffer[i] = malloc(BENCH_SHM_SIZE);
+        if (g_bench.buffer[i] == NULL) {
+            goto FREE_BUFFERS;
+        }
+    }
+    if (TEEC_InitializeContext(NULL, &g_bench.context) != TEEC_SUCCESS) {
+        fprintf(stderr, "initialize context failed\n");
+        goto FREE_BUFFERS;
+    }
+    if (TEEC_OpenSession(&g_bench.context, &g_bench.session, &uuid, TEEC_LOGIN_IDENTIFY,
+        NULL, NULL, NULL) != TEEC_SUCCESS) {
+        fprintf(stderr, "open session failed\n");
+        goto FINALIZE;
+    }
+
+    printf("register/invoke/release: %u ns per command, %u ms per mode\n", workNs, durationMs);
+    printf("%-8s %10s %14s %14s\n", "mode", "buffers", "loops/s", "ns/loop");
+    if (RunMode("same", 1, durationMs) != 0 || RunMode("cycle", BENCH_CYCLE_BUFFERS, durationMs) != 0) {
+        goto CLOSE;
+    }
+    if (TEEC_EXT_PinSharedMemory == NULL) {
+        printf("%-8s no TEEC_EXT_PinSharedMemory in this libteec\n", "pinned");
+    } else if (PinFirstBuffer(&g_bench) != 0 || RunMode("pinned", 1, durationMs) != 0) {
+        fprintf(stderr, "pinned: failed\n");
+        goto CLOSE;
+    }
+    ret = EXIT_SUCCESS;
+
+CLOSE:
+    TEEC_CloseSession(&g_bench.session);
+FINALIZE:
+    TEEC_FinalizeContext(&g_bench.context);
+FREE_BUFFERS:
+    for (uint32_t i = 0; i < BENCH_CYCLE_BUFFERS; i++) {
+        free(g_bench.buffer[i]);
+    }
+    return ret;
+}
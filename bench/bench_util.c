@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "bench_util.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <securec.h>
+
+#define NS_PER_SEC 1000000000ULL
+#define NS_PER_MS  1000000ULL
+#define BENCH_LAT_SAMPLES 8192        /* latencies kept per thread, the last ones win */
+#define PERCENT 100
+
+struct BenchThread {
+    pthread_t tid;
+    uint32_t id;
+    uint64_t ops;
+    bool failed;
+    uint64_t *lat;
+    struct BenchRun *run;
+};
+
+struct BenchRun {
+    BenchOpFn op;
+    void *arg;
+    atomic_uint ready;
+    atomic_bool go;
+    atomic_bool stop;
+};
+
+uint64_t BenchNowNs(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+void BenchSpinNs(uint64_t ns)
+{
+    if (ns == 0) {
+        return;
+    }
+    uint64_t end = BenchNowNs() + ns;
+    while (BenchNowNs() < end) {
+    }
+}
+
+static void *BenchThreadFn(void *data)
+{
+    struct BenchThread *thread = (struct BenchThread *)data;
+    struct BenchRun *run = thread->run;
+
+    (void)atomic_fetch_add(&run->ready, 1);
+    while (!atomic_load_explicit(&run->go, memory_order_acquire)) {
+    }
+    while (!atomic_load_explicit(&run->stop, memory_order_relaxed)) {
+        uint64_t start = (thread->lat != NULL) ? BenchNowNs() : 0;
+        if (!run->op(thread->id, run->arg)) {
+            thread->failed = true;
+            break;
+        }
+        if (thread->lat != NULL) {
+            thread->lat[thread->ops % BENCH_LAT_SAMPLES] = BenchNowNs() - start;
+        }
+        thread->ops++;
+    }
+    return NULL;
+}
+
+static int CompareU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t KeptSamples(const struct BenchThread *thread)
+{
+    if (thread->lat == NULL) {
+        return 0;
+    }
+    return (thread->ops < BENCH_LAT_SAMPLES) ? thread->ops : BENCH_LAT_SAMPLES;
+}
+
+static void CollectLatency(const struct BenchThread *threads, uint32_t num, struct BenchResult *result)
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < num; i++) {
+        total += KeptSamples(&threads[i]);
+    }
+    if (total == 0) {
+        return;
+    }
+    uint64_t *all = malloc(total * sizeof(*all));
+    if (all == NULL) {
+        return;
+    }
+    uint64_t n = 0;
+    for (uint32_t i = 0; i < num; i++) {
+        uint64_t kept = KeptSamples(&threads[i]);
+        (void)memcpy_s(all + n, (total - n) * sizeof(*all), threads[i].lat, kept * sizeof(*all));
+        n += kept;
+    }
+    qsort(all, total, sizeof(*all), CompareU64);
+    result->p50Ns = all[total / 2];
+    result->p99Ns = all[total * 99 / PERCENT];
+    free(all);
+}
+
+void BenchRunThreads(uint32_t threads, uint32_t durationMs, BenchOpFn op, void *arg, bool latency,
+    struct BenchResult *result)
+{
+    struct BenchRun run = { .op = op, .arg = arg };
+    struct BenchThread *pool = calloc(threads, sizeof(*pool));
+
+    (void)memset_s(result, sizeof(*result), 0, sizeof(*result));
+    if (pool == NULL) {
+        result->failed = true;
+        return;
+    }
+    uint32_t started = 0;
+    for (; started < threads; started++) {
+        pool[started].id = started;
+        pool[started].run = &run;
+        if (latency) {
+            pool[started].lat = malloc(BENCH_LAT_SAMPLES * sizeof(uint64_t));
+        }
+        if (pthread_create(&pool[started].tid, NULL, BenchThreadFn, &pool[started]) != 0) {
+            fprintf(stderr, "create thread %u failed: %d\n", started, errno);
+            result->failed = true;
+            break;
+        }
+    }
+    while (atomic_load(&run.ready) < started) {
+    }
+
+    uint64_t start = BenchNowNs();
+    atomic_store_explicit(&run.go, true, memory_order_release);
+    struct timespec ts = { durationMs / 1000, (long)(durationMs % 1000) * (long)NS_PER_MS };
+    (void)nanosleep(&ts, NULL);
+    atomic_store(&run.stop, true);
+    result->elapsedNs = BenchNowNs() - start;
+    result->minThreadOps = UINT64_MAX;
+    for (uint32_t i = 0; i < started; i++) {
+        (void)pthread_join(pool[i].tid, NULL);
+        result->ops += pool[i].ops;
+        result->minThreadOps = (pool[i].ops < result->minThreadOps) ? pool[i].ops : result->minThreadOps;
+        result->maxThreadOps = (pool[i].ops > result->maxThreadOps) ? pool[i].ops : result->maxThreadOps;
+        result->failed = result->failed || pool[i].failed;
+    }
+    if (started == 0) {
+        result->minThreadOps = 0;
+    }
+    if (latency) {
+        CollectLatency(pool, started, result);
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        free(pool[i].lat);
+    }
+    free(pool);
+}
+
+double BenchOpsPerSec(const struct BenchResult *result)
+{
+    if (result->elapsedNs == 0) {
+        return 0;
+    }
+    return (double)result->ops * (double)NS_PER_SEC / (double)result->elapsedNs;
+}
+
+uint32_t BenchParseU32(const char *opt, const char *value)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long v = strtoul(value, &end, 10);
+    if (errno != 0 || end == value || *end != '\0' || v > UINT32_MAX) {
+        fprintf(stderr, "bad value for -%s: %s\n", opt, value);
+        exit(EXIT_FAILURE);
+    }
+    return (uint32_t)v;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BENCH_THREADS_MAX 256
+
+/* one operation of a benchmark loop, returns false to stop the thread on an error */
+typedef bool (*BenchOpFn)(uint32_t id, void *arg);
+
+struct BenchResult {
+    uint64_t ops;
+    uint64_t elapsedNs;
+    uint64_t p50Ns;               /* per operation latency, only with BenchRunThreads(..., true) */
+    uint64_t p99Ns;
+    uint64_t minThreadOps;        /* operations of the least and the most served thread */
+    uint64_t maxThreadOps;
+    bool failed;
+};
+
+uint64_t BenchNowNs(void);
+void BenchSpinNs(uint64_t ns);
+
+/*
+ * run op in a loop on threads threads for durationMs, all threads start
+ * together; with latency each operation is timed on its own
+ */
+void BenchRunThreads(uint32_t threads, uint32_t durationMs, BenchOpFn op, void *arg, bool latency,
+    struct BenchResult *result);
+
+double BenchOpsPerSec(const struct BenchResult *result);
+
+/* parse a decimal option value, exits on a malformed one */
+uint32_t BenchParseU32(const char *opt, const char *value);
+
+#endif
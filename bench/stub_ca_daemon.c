@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * Stand-in for tee_client_socket.c: instead of asking teecd for a logged in
+ * fd of /dev/tc_ns_client, hand out an fd of the stand-in driver.
+ */
+
+#include "tee_client_socket.h"
+#include "stub_tzdriver.h"
+
+int CaDaemonConnectWithCaInfo(const CaAuthInfo *caInfo, int cmd, const TEEC_XmlParameter *halXmlPtr)
+{
+    (void)caInfo;
+    (void)cmd;
+    (void)halXmlPtr;
+    return StubOpenDevice();
+}
+
+int CaDaemonConnectPreAuth(const CaAuthInfo *caInfo)
+{
+    (void)caInfo;
+    return StubOpenDevice();
+}
+
+uint32_t CaDaemonGetTeeVersion(void)
+{
+    return 0;
+}
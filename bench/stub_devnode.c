@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * Stand-in device nodes for benchmarks of teecd code, linked with
+ * -Wl,--wrap=open -Wl,--wrap=close: opening the tzdriver nodes hands out a
+ * stand-in device of stub_tzdriver.c, every other path is opened as usual,
+ * under the stand-in root when StubSetPathRoot moved its directory.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/types.h>
+#include <securec.h>
+#include "tc_ns_client.h"
+#include "stub_tzdriver.h"
+#include "stub_devnode.h"
+
+static char g_pathPrefix[PATH_MAX];
+static char g_pathRoot[PATH_MAX];
+
+int __real_open(const char *path, int flags, ...);
+int __wrap_open(const char *path, int flags, ...);
+int __real_close(int fd);
+int __wrap_close(int fd);
+
+void StubSetPathRoot(const char *prefix, const char *root)
+{
+    if (prefix == NULL || root == NULL) {
+        g_pathPrefix[0] = '\0';
+        g_pathRoot[0] = '\0';
+        return;
+    }
+    (void)strcpy_s(g_pathPrefix, sizeof(g_pathPrefix), prefix);
+    (void)strcpy_s(g_pathRoot, sizeof(g_pathRoot), root);
+}
+
+const char *StubMapPath(const char *path, char *buf, size_t len)
+{
+    size_t prefixLen = strlen(g_pathPrefix);
+
+    /* the directory itself or anything below it */
+    if (path == NULL || prefixLen == 0 || strncmp(path, g_pathPrefix, prefixLen) != 0 ||
+        (path[prefixLen] != '\0' && path[prefixLen] != '/')) {
+        return path;
+    }
+    if (snprintf_s(buf, len, len - 1, "%s%s", g_pathRoot, path) < 0) {
+        return path;
+    }
+    return buf;
+}
+
+void StubUnmapPath(char *path)
+{
+    size_t rootLen = strlen(g_pathRoot);
+
+    if (rootLen == 0 || strncmp(path, g_pathRoot, rootLen) != 0 || path[rootLen] != '/') {
+        return;
+    }
+    (void)memmove_s(path, strlen(path) + 1, path + rootLen, strlen(path + rootLen) + 1);
+}
+
+int __wrap_open(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    char buf[PATH_MAX];
+
+    if (strcmp(path, TC_NS_CLIENT_DEV_NAME) == 0 || strcmp(path, TC_TEECD_PRIVATE_DEV_NAME) == 0) {
+        return StubOpenDevice();
+    }
+    if ((flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = (mode_t)va_arg(ap, int);
+        va_end(ap);
+    }
+    return __real_open(StubMapPath(path, buf, sizeof(buf)), flags, mode);
+}
+
+int __wrap_close(int fd)
+{
+    if (StubIsDevice(fd)) {
+        /* StubCloseDevice forgets the fd before it closes it, so this comes back to __real_close */
+        StubCloseDevice(fd);
+        return 0;
+    }
+    return __real_close(fd);
+}
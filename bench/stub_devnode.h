@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#ifndef BENCH_STUB_DEVNODE_H
+#define BENCH_STUB_DEVNODE_H
+
+#include <stddef.h>
+
+/*
+ * The directory prefix (no trailing '/') and the paths below it are looked up
+ * under root instead, e.g. the secure storage directories of teecd under a
+ * temporary directory. root has to be a real path without symlinks, NULL for
+ * both turns the mapping off.
+ */
+void StubSetPathRoot(const char *prefix, const char *root);
+
+/* returns path under the stand-in root in buf, or path itself when it is not moved */
+const char *StubMapPath(const char *path, char *buf, size_t len);
+
+/* strips the stand-in root from a resolved path in place */
+void StubUnmapPath(char *path);
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * The path calls of the fs agent besides open, for benchmarks linked with
+ * -Wl,--wrap= for each of them: paths under the prefix given to
+ * StubSetPathRoot go to the stand-in root, and realpath hides the root again
+ * so the agent still finds its files under the directories it checks for.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "stub_devnode.h"
+
+char *__real_realpath(const char *path, char *resolved);
+char *__wrap_realpath(const char *path, char *resolved);
+int __real_access(const char *path, int mode);
+int __wrap_access(const char *path, int mode);
+int __real_mkdir(const char *path, mode_t mode);
+int __wrap_mkdir(const char *path, mode_t mode);
+int __real_chmod(const char *path, mode_t mode);
+int __wrap_chmod(const char *path, mode_t mode);
+int __real_stat(const char *path, struct stat *st);
+int __wrap_stat(const char *path, struct stat *st);
+FILE *__real_fopen(const char *path, const char *mode);
+FILE *__wrap_fopen(const char *path, const char *mode);
+
+char *__wrap_realpath(const char *path, char *resolved)
+{
+    char buf[PATH_MAX];
+
+    char *ret = __real_realpath(StubMapPath(path, buf, sizeof(buf)), resolved);
+    if (ret != NULL) {
+        StubUnmapPath(ret);
+    }
+    return ret;
+}
+
+int __wrap_access(const char *path, int mode)
+{
+    char buf[PATH_MAX];
+    return __real_access(StubMapPath(path, buf, sizeof(buf)), mode);
+}
+
+int __wrap_mkdir(const char *path, mode_t mode)
+{
+    char buf[PATH_MAX];
+    return __real_mkdir(StubMapPath(path, buf, sizeof(buf)), mode);
+}
+
+int __wrap_chmod(const char *path, mode_t mode)
+{
+    char buf[PATH_MAX];
+    return __real_chmod(StubMapPath(path, buf, sizeof(buf)), mode);
+}
+
+int __wrap_stat(const char *path, struct stat *st)
+{
+    char buf[PATH_MAX];
+    return __real_stat(StubMapPath(path, buf, sizeof(buf)), st);
+}
+
+FILE *__wrap_fopen(const char *path, const char *mode)
+{
+    char buf[PATH_MAX];
+    return __real_fopen(StubMapPath(path, buf, sizeof(buf)), mode);
+}
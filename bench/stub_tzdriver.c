@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "stub_tzdriver.h"
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "tc_ns_client.h"
+#include "bench_util.h"
+
+#define STUB_FD_MAX 4096
+
+static atomic_bool g_stubFds[STUB_FD_MAX];
+static atomic_uint g_nextSessionId;
+static uint64_t g_cmdCostNs;
+static uint64_t g_openCostNs;
+static StubIoctlHook g_ioctlHook;
+
+int __real_ioctl(int fd, unsigned long request, ...);
+int __wrap_ioctl(int fd, unsigned long request, ...);
+
+int StubOpenDevice(void)
+{
+    int fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (fd < 0 || fd >= STUB_FD_MAX) {
+        if (fd >= 0) {
+            (void)close(fd);
+        }
+        return -1;
+    }
+    atomic_store(&g_stubFds[fd], true);
+    return fd;
+}
+
+void StubCloseDevice(int fd)
+{
+    if (StubIsDevice(fd)) {
+        atomic_store(&g_stubFds[fd], false);
+        (void)close(fd);
+    }
+}
+
+bool StubIsDevice(int fd)
+{
+    return fd >= 0 && fd < STUB_FD_MAX && atomic_load_explicit(&g_stubFds[fd], memory_order_relaxed);
+}
+
+void StubSetCmdCostNs(uint64_t ns)
+{
+    g_cmdCostNs = ns;
+}
+
+void StubSetOpenCostNs(uint64_t ns)
+{
+    g_openCostNs = ns;
+}
+
+void StubSetIoctlHook(StubIoctlHook hook)
+{
+    g_ioctlHook = hook;
+}
+
+static int StubIoctl(unsigned int cmd, void *arg)
+{
+    TC_NS_ClientContext *cliContext = (TC_NS_ClientContext *)arg;
+
+    switch (cmd) {
+        case (unsigned int)TC_NS_CLIENT_IOCTL_SES_OPEN_REQ:
+            BenchSpinNs(g_openCostNs);
+            cliContext->session_id = atomic_fetch_add(&g_nextSessionId, 1) + 1;
+            cliContext->returns.code = 0;
+            return 0;
+        case (unsigned int)TC_NS_CLIENT_IOCTL_SEND_CMD_REQ:
+            BenchSpinNs(g_cmdCostNs);
+            cliContext->returns.code = 0;
+            return 0;
+        case (unsigned int)TC_NS_CLIENT_IOCTL_GET_TEE_VERSION:
+            *(unsigned int *)arg = 0;
+            return 0;
+        default:
+            /* close, cancel, login and the rest succeed without doing anything */
+            return 0;
+    }
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    va_start(ap, request);
+    void *arg = va_arg(ap, void *);
+    va_end(ap);
+
+    if (!StubIsDevice(fd)) {
+        return __real_ioctl(fd, request, arg);
+    }
+    /* callers pass the request through an int, only the low 32 bits are the command */
+    unsigned int cmd = (unsigned int)request;
+    int ret = 0;
+    if (g_ioctlHook != NULL && g_ioctlHook(fd, cmd, arg, &ret)) {
+        return ret;
+    }
+    return StubIoctl(cmd, arg);
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#ifndef BENCH_STUB_TZDRIVER_H
+#define BENCH_STUB_TZDRIVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Stand-in for the tzdriver. Benchmarks are linked with -Wl,--wrap=ioctl, so
+ * ioctls on fds returned by StubOpenDevice are answered here and never reach
+ * the kernel, every other fd goes to the real ioctl.
+ */
+
+/* returns true when the ioctl was handled, *ret is then its return value */
+typedef bool (*StubIoctlHook)(int fd, unsigned int cmd, void *arg, int *ret);
+
+int StubOpenDevice(void);
+void StubCloseDevice(int fd);
+bool StubIsDevice(int fd);
+
+/* busy time of every SEND_CMD_REQ, standing in for the TA */
+void StubSetCmdCostNs(uint64_t ns);
+/* busy time of every SES_OPEN_REQ */
+void StubSetOpenCostNs(uint64_t ns);
+void StubSetIoctlHook(StubIoctlHook hook);
+
+#endif
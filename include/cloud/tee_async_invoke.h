@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#ifndef _TEE_ASYNC_INVOKE_H_
+#define _TEE_ASYNC_INVOKE_H_
+
+#include "tee_client_api.h"
+
+struct AsyncInvoke;
+
+/*
+ * queue a command to the libteec worker pool and return at once, session and
+ * operation must stay valid until the handle is released
+ */
+TEEC_Result TEEC_InvokeCommandAsync(TEEC_Session *session, uint32_t commandID,
+    TEEC_Operation *operation, struct AsyncInvoke **handle);
+
+/* eventfd that becomes readable when the command completes, closed by TEEC_AsyncInvokeRelease */
+int TEEC_AsyncInvokeGetFd(const struct AsyncInvoke *handle);
+
+/* result of the command, TEEC_ERROR_BUSY while it is still queued or running */
+TEEC_Result TEEC_AsyncInvokePoll(struct AsyncInvoke *handle, uint32_t *returnOrigin);
+
+/* drop a queued command, or forward a running one to TEEC_RequestCancellation */
+void TEEC_AsyncInvokeCancel(struct AsyncInvoke *handle);
+
+/* free the handle, waits for a running command to complete */
+void TEEC_AsyncInvokeRelease(struct AsyncInvoke *handle);
+
+#endif
@@ -14,32 +14,114 @@
 #define _TEE_SESSION_POOL_H_
 
 #include <stdbool.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include "tee_client_api.h"
 
+/* callers waiting for a session are served by class, FIFO within a class */
+enum SessionPoolPriority {
+    SESSION_POOL_PRIO_HIGH = 0,
+    SESSION_POOL_PRIO_NORMAL,
+    SESSION_POOL_PRIO_LOW,
+    SESSION_POOL_PRIO_NUM,
+};
+
+/* bucket 0 counts acquires without waiting, bucket i waits in [2^(i-1), 2^i) us, the last one all longer waits */
+#define SESSION_POOL_WAIT_BUCKETS 24
+
+/* remembered affinity keys, a key evicts another one hashed to the same entry */
+#define SESSION_POOL_AFFINITY_SLOTS 256
+
+struct SessionPoolClassStats {
+    uint64_t acquired;            /* sessions handed out to this class */
+    uint64_t expired;             /* checkouts that failed with TEEC_ERROR_TIMEOUT */
+    uint64_t waitHist[SESSION_POOL_WAIT_BUCKETS];
+};
+
 struct SessionInfo {
     TEEC_Session session;
     bool isDead;
 };
 
+struct SessionPoolConfig {
+    uint32_t minSize;             /* sessions kept open, opened when the pool is created */
+    uint32_t maxSize;             /* sessions the pool may grow to under load */
+    uint32_t targetWaitUs;        /* open one more session when a caller waits longer than this */
+    uint32_t idleTimeoutMs;       /* close sessions above minSize unused for this long, 0 never shrinks */
+    uint32_t warmupThreads;       /* threads opening the first minSize sessions in parallel, 0 means 1 */
+};
+
+struct SessionPoolStats {
+    uint32_t minSize;
+    uint32_t maxSize;
+    uint32_t limit;               /* sessions the pool may hold now, see TEEC_SessionPoolSetLimit */
+    uint32_t opened;
+    uint32_t inuse;
+    uint64_t acquired;            /* sessions handed out */
+    uint64_t waited;              /* acquires that found no idle session */
+    uint64_t waitTotalUs;
+    uint64_t waitMaxUs;
+    uint64_t overTarget;          /* waits longer than targetWaitUs */
+    uint64_t grown;               /* sessions opened on demand beyond minSize */
+    uint64_t shrunk;              /* idle sessions closed */
+    uint32_t dead;                /* sessions lost to TEEC_ERROR_TARGET_DEAD and not reopened yet */
+    uint64_t deaths;              /* sessions that returned TEEC_ERROR_TARGET_DEAD */
+    uint64_t reopened;            /* dead sessions reopened */
+    uint64_t reopenFailed;        /* failed attempts to reopen a dead session */
+    uint64_t degradedMs;          /* time spent with at least one dead session */
+    uint64_t affinityHits;        /* affinity checkouts given the session last used for the key */
+    uint64_t affinityMisses;      /* that session was busy or gone, another one was given */
+    uint64_t affinityCold;        /* the key was not remembered */
+    struct SessionPoolClassStats classes[SESSION_POOL_PRIO_NUM];
+};
+
+/*
+ * The layout below is part of the ABI, the state added for sizing, healing,
+ * priorities and affinity is private to tee_session_pool.c.
+ */
 struct SessionPool {
     TEEC_Context *context;        /* context owner */
     TEEC_UUID uuid;
-    uint32_t poolSize;            /* expected count of sessions to open */
+    uint32_t poolSize;            /* max count of sessions to open */
     struct SessionInfo *sessionsInfo;
     uint32_t opened;              /* counf of sessions opend successfully */
     uint32_t inuse;               /* count of sessions in using */
     sem_t keys;                   /* keys value equal opend - inuse */
-    uint8_t *usage;               /* a bitmap mark session in-use */
+    uint8_t *usage;               /* a bitmap mark session idle, changed with atomics */
     uint32_t usageSize;           /* bitmap size in bytes */
     pthread_mutex_t usageLock;
 };
 
 TEEC_Result TEEC_SessionPoolCreate(TEEC_Context *context, const TEEC_UUID *destination,
     struct SessionPool **sessionPool, uint32_t poolSize);
+TEEC_Result TEEC_SessionPoolCreateWithConfig(TEEC_Context *context, const TEEC_UUID *destination,
+    const struct SessionPoolConfig *config, struct SessionPool **sessionPool);
 TEEC_Result TEEC_SessionPoolInvoke(struct SessionPool *sessionPool, uint32_t commandID,
     TEEC_Operation *operation, uint32_t *returnOrigin);
+/*
+ * like TEEC_SessionPoolInvoke, but waits for a session in the queue of the given
+ * priority class. If no session is free within timeoutMs (0 waits forever) the
+ * command is not sent and TEEC_ERROR_TIMEOUT is returned with TEEC_ORIGIN_API.
+ */
+TEEC_Result TEEC_SessionPoolInvokeWithPriority(struct SessionPool *sessionPool, uint32_t priority,
+    uint32_t timeoutMs, uint32_t commandID, TEEC_Operation *operation, uint32_t *returnOrigin);
+/*
+ * like TEEC_SessionPoolInvoke, but prefers the session that last served
+ * affinityKey so that state the TA keeps per session can be reused, and falls
+ * back to any idle session when that one is busy or closed
+ */
+TEEC_Result TEEC_SessionPoolInvokeWithAffinity(struct SessionPool *sessionPool, uint64_t affinityKey,
+    uint32_t commandID, TEEC_Operation *operation, uint32_t *returnOrigin);
 void TEEC_SessionPoolDestroy(struct SessionPool *sessionPool);
 void TEEC_SessionPoolQuery(struct SessionPool *sessionPool, uint32_t *size,
     uint32_t *opened, uint32_t *inuse, bool showBitmap);
+/*
+ * change how many sessions the pool may hold, between minSize and maxSize.
+ * Idle sessions above a lowered limit are closed by the maintainer.
+ */
+TEEC_Result TEEC_SessionPoolSetLimit(struct SessionPool *sessionPool, uint32_t limit);
+void TEEC_SessionPoolGetStats(struct SessionPool *sessionPool, struct SessionPoolStats *stats);
+/* wait until count sessions are usable, returns TEEC_ERROR_TIMEOUT if timeoutMs passes first */
+TEEC_Result TEEC_SessionPoolWaitReady(struct SessionPool *sessionPool, uint32_t count, uint32_t timeoutMs);
 
 #endif
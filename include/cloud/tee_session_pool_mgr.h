@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#ifndef _TEE_SESSION_POOL_MGR_H_
+#define _TEE_SESSION_POOL_MGR_H_
+
+#include <stdint.h>
+#include "tee_client_api.h"
+#include "tee_session_pool.h"
+
+#define SESSION_POOL_MGR_TA_MAX 32
+
+struct SessionPoolManager;
+
+struct SessionPoolManagerConfig {
+    uint32_t budget;              /* sessions all pools may hold together */
+    uint32_t rebalanceIntervalMs; /* how often limits follow demand, 0 means 1000 */
+};
+
+struct SessionPoolManagerStats {
+    uint32_t budget;
+    uint32_t poolNum;
+    uint32_t reserved;            /* sum of the limits of all pools */
+    uint32_t opened;              /* sessions opened by all pools */
+    uint64_t rebalances;          /* rebalance rounds that changed a limit */
+};
+
+/*
+ * Pools of different TAs share one session budget. Every pool keeps its
+ * minSize, the rest of the budget is moved to the pools whose callers are
+ * waiting, and pools without demand fall back to minSize.
+ */
+TEEC_Result TEEC_SessionPoolManagerCreate(TEEC_Context *context, const struct SessionPoolManagerConfig *config,
+    struct SessionPoolManager **manager);
+/* returns TEEC_ERROR_OUT_OF_MEMORY when minSize of all pools would exceed the budget */
+TEEC_Result TEEC_SessionPoolManagerAddTa(struct SessionPoolManager *manager, const TEEC_UUID *destination,
+    const struct SessionPoolConfig *config);
+TEEC_Result TEEC_SessionPoolManagerInvoke(struct SessionPoolManager *manager, const TEEC_UUID *destination,
+    uint32_t commandID, TEEC_Operation *operation, uint32_t *returnOrigin);
+TEEC_Result TEEC_SessionPoolManagerInvokeWithPriority(struct SessionPoolManager *manager,
+    const TEEC_UUID *destination, uint32_t priority, uint32_t timeoutMs, uint32_t commandID,
+    TEEC_Operation *operation, uint32_t *returnOrigin);
+/* pool serving destination, for TEEC_SessionPoolGetStats and friends, NULL if the TA was not added */
+struct SessionPool *TEEC_SessionPoolManagerGetPool(struct SessionPoolManager *manager, const TEEC_UUID *destination);
+void TEEC_SessionPoolManagerGetStats(struct SessionPoolManager *manager, struct SessionPoolManagerStats *stats);
+void TEEC_SessionPoolManagerDestroy(struct SessionPoolManager *manager);
+
+#endif
@@ -59,7 +59,8 @@ enum TEEC_ReturnCode {
     TEEC_ERROR_SIGNATURE_INVALID = 0xFFFF3072,  /* used by adapt only */
     TEEC_ERROR_TIME_NOT_SET      = 0xFFFF5000,  /* used by adapt only */
     TEEC_ERROR_TIME_NEEDS_RESET  = 0xFFFF5001,  /* used by adapt only */
-    TEEC_ERROR_IPC_OVERFLOW      = 0xFFFF9114   /* ipc overflow */
+    TEEC_ERROR_IPC_OVERFLOW      = 0xFFFF9114,  /* ipc overflow */
+    TEEC_ERROR_TIMEOUT           = 0xFFFF3001   /* command canceled because its deadline expired */
 };
 
 enum TEEC_ReturnCodeOrigin {
@@ -77,6 +78,11 @@ enum TEEC_SharedMemCtl {
     TEEC_MEM_REGISTER_INOUT = 0x5, /* register shared memory */
 };
 
+enum TEEC_SharedMemPoolFlag {
+    TEEC_SHM_POOL_HUGEPAGE = 0x1,  /* back size classes that are multiples of 2MB with hugepages */
+    TEEC_SHM_POOL_SKIP_ZERO = 0x2, /* do not clear recycled buffers, the CA always overwrites them */
+};
+
 enum TEEC_ParamType {
     TEEC_NONE = 0x0,  /* unused parameter */
     TEEC_VALUE_INPUT = 0x01,  /* input type of value, refer TEEC_Value */
@@ -125,4 +131,5 @@ enum TST_CMD_ID {
 };
 
 #define TEEC_PARAM_NUM 4 /* teec param max number */
+#define TEEC_INVOKE_BATCH_MAX 256 /* max entries of TEEC_InvokeCommandBatch */
 #endif
@@ -77,6 +77,165 @@ TEEC_Result TEEC_EXT_UnregisterAgent(uint32_t agentId, int devFd, void **buffer)
  */
 TEEC_Result TEEC_SendSecfile(const char *path, TEEC_Session *session);
 
+/*
+ * get shared memory statistics of a context
+ *
+ * @param context [IN] initialized TEE context
+ * @param stats [OUT] shared memory counters of the context
+ *
+ * @return TEEC_SUCCESS operation success
+ * @return TEEC_ERROR_BAD_PARAMETERS context is invalid or stats is NULL
+ */
+TEEC_Result TEEC_EXT_GetSharedMemStats(TEEC_Context *context, TEEC_SharedMemStats *stats);
+
+/*
+ * enable a pool of recycled buffers for TEEC_MEM_SHARED_INOUT and TEEC_MEM_REGISTER_INOUT
+ * allocations of a context, the pool lives until the context is finalized
+ *
+ * @param context [IN] initialized TEE context
+ * @param config [IN] size classes and caching policy of the pool
+ *
+ * @return TEEC_SUCCESS operation success
+ * @return TEEC_ERROR_BAD_PARAMETERS context or config is invalid
+ * @return TEEC_ERROR_BAD_STATE pool is already enabled for this context
+ * @return TEEC_ERROR_OUT_OF_MEMORY pool cannot be created
+ */
+TEEC_Result TEEC_EXT_EnableSharedMemPool(TEEC_Context *context, const TEEC_SharedMemPoolConfig *config);
+
+/*
+ * get counters of the shared memory pool of a context
+ *
+ * @param context [IN] initialized TEE context
+ * @param stats [OUT] pool counters, stats->enabled is false if no pool is enabled
+ *
+ * @return TEEC_SUCCESS operation success
+ * @return TEEC_ERROR_BAD_PARAMETERS context is invalid or stats is NULL
+ */
+TEEC_Result TEEC_EXT_GetSharedMemPoolStats(TEEC_Context *context, TEEC_SharedMemPoolStats *stats);
+
+/*
+ * keep the registration of a shared memory cached for the whole session, so that
+ * registering the same buffer, size and flags again while the session is open is
+ * always served from the registration cache
+ *
+ * @param session [IN] opened session the buffer is used with
+ * @param sharedMem [IN] shared memory registered by TEEC_RegisterSharedMemory in the session context
+ *
+ * @return TEEC_SUCCESS operation success
+ * @return TEEC_ERROR_BAD_PARAMETERS session or sharedMem is invalid
+ * @return TEEC_ERROR_ITEM_NOT_FOUND sharedMem is not registered in the session context
+ */
+TEEC_Result TEEC_EXT_PinSharedMemory(TEEC_Session *session, TEEC_SharedMemory *sharedMem);
+
+/*
+ * release the pin taken by TEEC_EXT_PinSharedMemory before the session closes,
+ * a pinned registration that was already released stays in the registration
+ * cache and is unpinned by passing a TEEC_SharedMemory with the same context,
+ * buffer, size and flags
+ *
+ * @param sharedMem [IN] pinned shared memory
+ *
+ * @return TEEC_SUCCESS operation success
+ * @return TEEC_ERROR_BAD_PARAMETERS sharedMem is invalid
+ * @return TEEC_ERROR_ITEM_NOT_FOUND sharedMem is not pinned
+ */
+TEEC_Result TEEC_EXT_UnpinSharedMemory(TEEC_SharedMemory *sharedMem);
+
+/*
+ * drop cached registrations overlapping a buffer that is about to be unmapped or
+ * reallocated, pinned ones included
+ *
+ * The registration cache is keyed by address, size and flags only, libteec does
+ * not see munmap, free or realloc of application buffers. A CA that releases a
+ * registered buffer and then unmaps or reallocates it must call this first,
+ * otherwise a later registration of a new buffer at the same address reuses the
+ * cached entry of the old one.
+ *
+ * @param context [IN] initialized TEE context
+ * @param buffer [IN] start of the range, NULL to drop every cached registration
+ * @param size [IN] length of the range
+ *
+ * @return TEEC_SUCCESS operation success
+ * @return TEEC_ERROR_BAD_PARAMETERS context is invalid
+ */
+TEEC_Result TEEC_EXT_InvalidateRegisteredMemory(TEEC_Context *context, const void *buffer, uint32_t size);
+
+/*
+ * invoke a vector of commands back to back, the context is looked up and every
+ * entry is validated once before the first command is sent
+ *
+ * @param entries [IN/OUT] commands to invoke, result and returnOrigin of each entry are filled in
+ * @param count [IN] number of entries, at most TEEC_INVOKE_BATCH_MAX
+ *
+ * @return TEEC_SUCCESS every entry succeeded
+ * @return TEEC_ERROR_BAD_PARAMETERS entries, count or the session context is invalid, or some entry
+ *         failed validation (its result is set, the others keep TEEC_SUCCESS); nothing was invoked
+ * @return others result of the first failed entry, the remaining entries are still invoked
+ */
+TEEC_Result TEEC_InvokeCommandBatch(TEEC_InvokeBatchEntry *entries, uint32_t count);
+
+/*
+ * validate and encode an operation once for repeated invokes of one command, the
+ * session, operation and the shared memory it references must stay valid until
+ * the prepared operation is released; later calls may change values, temp buffers,
+ * memref offsets and sizes, but not paramTypes or memref parents
+ *
+ * @param session [IN] opened session the command is invoked in
+ * @param commandID [IN] command to invoke
+ * @param operation [IN] operation bound to the prepared operation
+ * @param prepared [OUT] prepared operation
+ *
+ * @return TEEC_SUCCESS operation success
+ * @return TEEC_ERROR_BAD_PARAMETERS session or operation is invalid
+ * @return TEEC_ERROR_OUT_OF_MEMORY no memory for the prepared operation
+ */
+TEEC_Result TEEC_PrepareOperation(TEEC_Session *session, uint32_t commandID, TEEC_Operation *operation,
+    TEEC_PreparedOperation **prepared);
+
+/*
+ * invoke a prepared operation, only the parts that may change between calls are checked again
+ *
+ * @param prepared [IN] prepared operation
+ * @param returnOrigin [OUT] return origin, may be NULL
+ *
+ * @return same as TEEC_InvokeCommand
+ * @return TEEC_ERROR_BAD_PARAMETERS paramTypes or a memref parent changed, or a parent was released
+ */
+TEEC_Result TEEC_InvokePrepared(TEEC_PreparedOperation *prepared, uint32_t *returnOrigin);
+
+/*
+ * release a prepared operation and the references it holds
+ *
+ * @param prepared [IN] prepared operation
+ */
+void TEEC_ReleasePreparedOperation(TEEC_PreparedOperation *prepared);
+
+/*
+ * invoke a command and request its cancellation through TEEC_RequestCancellation
+ * when it has not completed within timeoutMs, all deadlines share one timer thread
+ *
+ * @param session [IN] opened session
+ * @param commandID [IN] command to invoke
+ * @param operation [IN/OUT] same as TEEC_InvokeCommand, may be NULL
+ * @param timeoutMs [IN] deadline in milliseconds from now, 0 for no deadline
+ * @param returnOrigin [OUT] return origin, may be NULL
+ *
+ * @return TEEC_ERROR_TIMEOUT the deadline expired and the command did not complete successfully
+ * @return others same as TEEC_InvokeCommand
+ */
+TEEC_Result TEEC_InvokeCommandWithDeadline(TEEC_Session *session, uint32_t commandID, TEEC_Operation *operation,
+    uint32_t timeoutMs, uint32_t *returnOrigin);
+
+/*
+ * get counters of TEEC_InvokeCommandWithDeadline
+ *
+ * @param stats [OUT] counters since the process started
+ *
+ * @return TEEC_SUCCESS operation success
+ * @return TEEC_ERROR_BAD_PARAMETERS stats is NULL
+ */
+TEEC_Result TEEC_EXT_GetInvokeDeadlineStats(TEEC_InvokeDeadlineStats *stats);
+
 /*
  * get version of TEE
  *
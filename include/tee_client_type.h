@@ -68,6 +68,39 @@ typedef struct {
     TEEC_Context *context;
 } TEEC_SharedMemory;
 
+typedef struct {
+    uint32_t allocatedBlocks;  /* live blocks allocated by TEEC_AllocateSharedMemory */
+    uint32_t registeredBlocks; /* live blocks registered by TEEC_RegisterSharedMemory */
+    uint32_t offsetInUse;      /* mmap offsets currently reserved */
+    uint32_t offsetPeak;       /* highest number of mmap offsets reserved at once */
+    uint32_t offsetMax;        /* upper bound of mmap offsets per context */
+    uint64_t allocTotal;       /* successful allocations since the context was initialized */
+    uint64_t registerTotal;    /* successful registrations since the context was initialized */
+    uint64_t allocFailed;      /* failed allocations */
+    uint64_t regCacheHits;     /* registrations served from the registration cache */
+    uint64_t regCacheMisses;   /* registrations that had to create a new entry */
+    uint64_t regCacheEvicted;  /* cached registrations dropped by the size bound or invalidation */
+} TEEC_SharedMemStats;
+
+typedef struct {
+    uint32_t minSize;           /* smallest size class, 0 for 4KB */
+    uint32_t maxSize;           /* largest size class, bigger requests bypass the pool, 0 for 1MB */
+    uint32_t maxCachedPerClass; /* idle buffers kept per size class, 0 for 16 */
+    uint32_t warmCountPerClass; /* buffers mapped and faulted in per size class when the pool is enabled */
+    uint32_t flags;             /* reference to TEEC_SharedMemPoolFlag */
+} TEEC_SharedMemPoolConfig;
+
+typedef struct {
+    bool enabled;
+    uint64_t hits;          /* allocations served by a recycled buffer */
+    uint64_t misses;        /* allocations that mapped a new buffer */
+    uint64_t bypassed;      /* allocations bigger than the largest size class */
+    uint64_t recycled;      /* releases that returned the buffer to the pool */
+    uint64_t trimmed;       /* releases unmapped because the size class was full */
+    uint32_t cachedBuffers; /* idle buffers currently held by the pool */
+    uint64_t cachedBytes;
+} TEEC_SharedMemPoolStats;
+
 /*
  * the corresponding param types are
  * TEEC_MEMREF_TEMP_INPUT/TEEC_MEMREF_TEMP_OUTPUT/TEEC_MEMREF_TEMP_INOUT
@@ -129,4 +162,21 @@ typedef struct {
     bool cancel_flag;
 } TEEC_Operation;
 
+typedef struct {
+    TEEC_Session *session;     /* all entries of a batch must share one context */
+    uint32_t commandID;
+    TEEC_Operation *operation; /* may be NULL as in TEEC_InvokeCommand */
+    TEEC_Result result;        /* filled in by TEEC_InvokeCommandBatch */
+    uint32_t returnOrigin;     /* filled in by TEEC_InvokeCommandBatch */
+} TEEC_InvokeBatchEntry;
+
+typedef struct {
+    uint64_t armed;    /* invokes started with a deadline */
+    uint64_t fired;    /* deadlines that expired and requested cancellation */
+    uint64_t timedOut; /* invokes that returned TEEC_ERROR_TIMEOUT */
+    uint32_t pending;  /* deadlines currently armed */
+} TEEC_InvokeDeadlineStats;
+
+typedef struct PreparedOperation TEEC_PreparedOperation; /* created by TEEC_PrepareOperation */
+
 #endif
@@ -36,8 +36,12 @@ enum ConnectCmd {
     GET_TEEVERSION,
     SET_SYS_XML,
     GET_TEECD_VERSION,
+    GET_FDS,                /* several logged in fds, the count is passed in CaRevMsg.xmlBufSize */
 };
 
+/* most fds handed out by one GET_FDS request, a teecd without GET_FDS sends one */
+#define CA_DAEMON_FD_BATCH_MAX 8
+
 typedef struct {
     unsigned int method;
     unsigned int mdata;
@@ -15,6 +15,7 @@
 
 #include <unistd.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 #include "tee_client_constants.h"
 #include "tee_client_type.h"
 
@@ -33,7 +34,12 @@
     (((paramType) == TEEC_MEMREF_SHARED_INOUT) || ((paramType) == TEEC_MEMREF_REGISTER_INOUT))
 
 #define MAX_SHAREDMEM_LEN 0x10000000
-#define NUM_OF_SHAREMEM_BITMAP 8
+#define NUM_OF_SHAREMEM_BITMAP 8 /* initial size of the mmap offset bitmap, grows on demand */
+#define MAX_NUM_OF_SHAREMEM_BITMAP 512 /* at most 4096 mmap offsets per context */
+#define SHAREMEM_BUCKET_NUM 256 /* must be power of 2 */
+#define REG_CACHE_BUCKET_NUM 64 /* must be power of 2 */
+#define REG_CACHE_MAX 64 /* idle registrations kept per context, pinned ones are not counted */
+#define SESSION_BUCKET_NUM 64 /* must be power of 2 */
 
 #ifndef PAGE_SIZE
 #define PAGE_SIZE getpagesize()
@@ -59,32 +65,67 @@ enum SVC_GLOBAL_CMD_ID {
     GLOBAL_CMD_ID_MAX,
 };
 
-typedef struct {
+struct SessionBucket {
+    struct ListNode list; /* sessions whose session_id hashes to this bucket */
+    pthread_mutex_t lock;
+};
+
+struct TeecSharedMemoryHidl;
+struct ShmPool;
+
+struct ShareMemStats {
+    atomic_uint allocated;     /* live allocated blocks */
+    atomic_uint registered;    /* live registered blocks */
+    atomic_uint offsetInUse;   /* mmap offsets currently reserved */
+    atomic_uint offsetPeak;    /* highest number of mmap offsets reserved at once */
+    atomic_ullong allocTotal;
+    atomic_ullong registerTotal;
+    atomic_ullong allocFailed;
+    atomic_ullong regCacheHits;
+    atomic_ullong regCacheMisses;
+    atomic_ullong regCacheEvicted;
+};
+
+typedef struct TeecContextHidl {
     int32_t fd;                    /* file descriptor */
-    struct ListNode session_list;  /* session list  */
+    struct SessionBucket session_buckets[SESSION_BUCKET_NUM]; /* sessions indexed by session_id */
     struct ListNode shrd_mem_list; /* share memory list */
     struct {
         void *buffer;
         sem_t buffer_barrier;
     } share_buffer;
-    uint8_t shm_bitmap[NUM_OF_SHAREMEM_BITMAP];
-    struct ListNode c_node; /* context list node  */
+    uint8_t *shm_bitmap;           /* mmap offset bitmap, protected by shrMemBitMapLock */
+    uint32_t shm_bitmap_len;       /* bytes of shm_bitmap */
+    struct TeecSharedMemoryHidl **shm_slots; /* mmap offset to block, protected by shrMemLock */
+    uint32_t shm_slot_num;
+    struct ListNode shm_buckets[SHAREMEM_BUCKET_NUM]; /* blocks indexed by buffer, protected by shrMemLock */
+    struct ShareMemStats shm_stats;
+    _Atomic(struct ShmPool *) shm_pool; /* recycled zero-copy buffers, NULL unless enabled */
+    struct ListNode reg_cache_lru; /* released registrations kept for reuse, protected by shrMemLock */
+    struct ListNode reg_cache_buckets[REG_CACHE_BUCKET_NUM]; /* the same registrations indexed by buffer */
+    uint32_t reg_cache_num;        /* unpinned registrations in reg_cache_lru */
+    uint32_t reg_pinned_num;       /* pinned registrations, cached or in use */
+    _Atomic(struct TeecContextHidl *) c_next; /* next context in the same registry shard */
     uint32_t ops_cnt;
-    pthread_mutex_t sessionLock;
     pthread_mutex_t shrMemLock;
     pthread_mutex_t shrMemBitMapLock;
     bool callFromHidl; /* true:from hidl,false:from vendor */
 } TEEC_ContextHidl;
 
-typedef struct {
+typedef struct TeecSharedMemoryHidl {
     void *buffer;              /* memory pointer */
     uint32_t size;             /* memory size */
     uint32_t flags;            /* memory flag, distinguish between input and output, range in #TEEC_SharedMemCtl */
     uint32_t ops_cnt;          /* memoty operation cnt */
     bool is_allocated;         /* memory allocated flag, distinguish between registered or distributed */
     struct ListNode head;      /* head of shared memory list */
+    struct ListNode b_node;    /* node in the buffer hash bucket */
     TEEC_ContextHidl *context; /* point to its own TEE environment */
     uint32_t offset;
+    struct ShmPool *pool;      /* pool the buffer was taken from, it holds a reference on it */
+    uint32_t pool_class;       /* size class in pool, SHM_POOL_NO_CLASS if not pooled */
+    bool pinned;               /* registration is kept cached until its session closes */
+    uint32_t pin_session_id;
 } TEEC_SharedMemoryHidl;
 
 typedef struct {
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "tee_async_invoke.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <securec.h>
+
+#include "tee_client_list.h"
+#include "tee_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "libteec_vendor"
+
+#define ASYNC_WORKER_MAX      16 /* commands in flight in the TEE, the rest wait in the queue */
+#define ASYNC_WORKER_IDLE_SEC 30 /* an idle worker exits after this */
+
+enum AsyncState {
+    ASYNC_QUEUED = 0,
+    ASYNC_RUNNING,
+    ASYNC_DONE,
+};
+
+struct AsyncInvoke {
+    struct ListNode node;      /* in g_asyncQueue while queued */
+    TEEC_Session *session;
+    uint32_t commandID;
+    TEEC_Operation *operation;
+    int eventFd;
+    uint32_t state;            /* enum AsyncState, protected by g_asyncLock */
+    TEEC_Result result;
+    uint32_t returnOrigin;
+};
+
+static pthread_mutex_t g_asyncLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_asyncWork  = PTHREAD_COND_INITIALIZER; /* queue became non empty */
+static pthread_cond_t g_asyncDone  = PTHREAD_COND_INITIALIZER; /* some command completed */
+static LIST_DECLARE(g_asyncQueue);
+static uint32_t g_asyncQueued;  /* requests in g_asyncQueue */
+static uint32_t g_asyncWorkers;
+static uint32_t g_asyncIdle;
+
+/* caller must hold g_asyncLock and req must be in g_asyncQueue */
+static void UnqueueAsyncLocked(struct AsyncInvoke *req)
+{
+    ListRemoveEntry(&req->node);
+    g_asyncQueued--;
+}
+
+/* caller must hold g_asyncLock */
+static void CompleteAsyncLocked(struct AsyncInvoke *req, TEEC_Result result, uint32_t returnOrigin)
+{
+    uint64_t one = 1;
+
+    req->result       = result;
+    req->returnOrigin = returnOrigin;
+    req->state        = ASYNC_DONE;
+    if (write(req->eventFd, &one, sizeof(one)) != (ssize_t)sizeof(one)) {
+        tloge("signal async invoke completion failed, errno=%d\n", errno);
+    }
+    (void)pthread_cond_broadcast(&g_asyncDone);
+}
+
+static void *AsyncWorkerThread(void *arg)
+{
+    (void)arg;
+    struct timespec deadline;
+
+    (void)pthread_mutex_lock(&g_asyncLock);
+    for (;;) {
+        if (LIST_EMPTY(&g_asyncQueue)) {
+            (void)clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += ASYNC_WORKER_IDLE_SEC;
+            g_asyncIdle++;
+            int ret = 0;
+            while (LIST_EMPTY(&g_asyncQueue) && ret != ETIMEDOUT) {
+                ret = pthread_cond_timedwait(&g_asyncWork, &g_asyncLock, &deadline);
+            }
+            g_asyncIdle--;
+            if (LIST_EMPTY(&g_asyncQueue)) {
+                break;
+            }
+        }
+
+        struct AsyncInvoke *req = CONTAINER_OF(ListRemoveHead(&g_asyncQueue), struct AsyncInvoke, node);
+        g_asyncQueued--;
+        req->state = ASYNC_RUNNING;
+        (void)pthread_mutex_unlock(&g_asyncLock);
+
+        uint32_t origin = TEEC_ORIGIN_API;
+        TEEC_Result ret = TEEC_InvokeCommand(req->session, req->commandID, req->operation, &origin);
+
+        (void)pthread_mutex_lock(&g_asyncLock);
+        CompleteAsyncLocked(req, ret, origin);
+    }
+    g_asyncWorkers--;
+    (void)pthread_mutex_unlock(&g_asyncLock);
+    return NULL;
+}
+
+/*
+ * caller must hold g_asyncLock and has just queued a request. An idle worker
+ * only leaves g_asyncIdle once it has the lock back, so a burst of requests
+ * sees the same idle workers each time: a worker is added whenever the queued
+ * requests outnumber the idle ones, not only when none is idle.
+ */
+static TEEC_Result WakeAsyncWorkerLocked(void)
+{
+    pthread_t tid;
+    pthread_attr_t attr;
+
+    if (g_asyncIdle > 0) {
+        (void)pthread_cond_signal(&g_asyncWork);
+    }
+    if (g_asyncQueued <= g_asyncIdle || g_asyncWorkers >= ASYNC_WORKER_MAX) {
+        return TEEC_SUCCESS;
+    }
+
+    (void)pthread_attr_init(&attr);
+    (void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(&tid, &attr, AsyncWorkerThread, NULL);
+    (void)pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        tloge("create async invoke worker failed, ret=%d\n", ret);
+        /* the other workers will still drain the queue */
+        return (g_asyncWorkers > 0) ? TEEC_SUCCESS : (TEEC_Result)TEEC_ERROR_OUT_OF_MEMORY;
+    }
+    g_asyncWorkers++;
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_InvokeCommandAsync(TEEC_Session *session, uint32_t commandID,
+    TEEC_Operation *operation, struct AsyncInvoke **handle)
+{
+    if (session == NULL || session->context == NULL || handle == NULL) {
+        tloge("invoke async: session or handle is invalid\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    struct AsyncInvoke *req = (struct AsyncInvoke *)malloc(sizeof(*req));
+    if (req == NULL) {
+        tloge("alloc async invoke failed\n");
+        return (TEEC_Result)TEEC_ERROR_OUT_OF_MEMORY;
+    }
+    (void)memset_s(req, sizeof(*req), 0, sizeof(*req));
+    req->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (req->eventFd < 0) {
+        tloge("create async invoke eventfd failed, errno=%d\n", errno);
+        free(req);
+        return (TEEC_Result)TEEC_ERROR_OUT_OF_MEMORY;
+    }
+    req->session   = session;
+    req->commandID = commandID;
+    req->operation = operation;
+    req->state     = ASYNC_QUEUED;
+    if (operation != NULL) {
+        /* TEEC_RequestCancellation finds the session through the operation */
+        operation->session = session;
+    }
+
+    (void)pthread_mutex_lock(&g_asyncLock);
+    ListInsertTail(&g_asyncQueue, &req->node);
+    g_asyncQueued++;
+    TEEC_Result ret = WakeAsyncWorkerLocked();
+    if (ret != TEEC_SUCCESS) {
+        UnqueueAsyncLocked(req);
+    }
+    (void)pthread_mutex_unlock(&g_asyncLock);
+
+    if (ret != TEEC_SUCCESS) {
+        (void)close(req->eventFd);
+        free(req);
+        return ret;
+    }
+    *handle = req;
+    return TEEC_SUCCESS;
+}
+
+int TEEC_AsyncInvokeGetFd(const struct AsyncInvoke *handle)
+{
+    return (handle == NULL) ? -1 : handle->eventFd;
+}
+
+TEEC_Result TEEC_AsyncInvokePoll(struct AsyncInvoke *handle, uint32_t *returnOrigin)
+{
+    TEEC_Result ret = (TEEC_Result)TEEC_ERROR_BUSY;
+
+    if (handle == NULL) {
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    (void)pthread_mutex_lock(&g_asyncLock);
+    if (handle->state == ASYNC_DONE) {
+        ret = handle->result;
+        if (returnOrigin != NULL) {
+            *returnOrigin = handle->returnOrigin;
+        }
+    }
+    (void)pthread_mutex_unlock(&g_asyncLock);
+    return ret;
+}
+
+void TEEC_AsyncInvokeCancel(struct AsyncInvoke *handle)
+{
+    if (handle == NULL) {
+        return;
+    }
+
+    (void)pthread_mutex_lock(&g_asyncLock);
+    uint32_t state = handle->state;
+    if (state == ASYNC_QUEUED) {
+        UnqueueAsyncLocked(handle);
+        CompleteAsyncLocked(handle, (TEEC_Result)TEEC_ERROR_CANCEL, TEEC_ORIGIN_API);
+    }
+    (void)pthread_mutex_unlock(&g_asyncLock);
+
+    if (state == ASYNC_RUNNING && handle->operation != NULL) {
+        TEEC_RequestCancellation(handle->operation);
+    }
+}
+
+void TEEC_AsyncInvokeRelease(struct AsyncInvoke *handle)
+{
+    if (handle == NULL) {
+        return;
+    }
+
+    (void)pthread_mutex_lock(&g_asyncLock);
+    if (handle->state == ASYNC_QUEUED) {
+        UnqueueAsyncLocked(handle);
+    }
+    while (handle->state == ASYNC_RUNNING) {
+        (void)pthread_cond_wait(&g_asyncDone, &g_asyncLock);
+    }
+    (void)pthread_mutex_unlock(&g_asyncLock);
+
+    (void)close(handle->eventFd);
+    free(handle);
+}
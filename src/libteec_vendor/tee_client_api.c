@@ -20,6 +20,8 @@
 #include <sys/ioctl.h> /* for ioctl */
 #include <sys/mman.h>  /* for mmap */
 #include <pthread.h>
+#include <sched.h>     /* for sched_yield */
+#include <stdatomic.h>
 #include <securec.h>
 #include "tee_client_list.h"
 #include "tee_log.h"
@@ -27,6 +29,8 @@
 #include "tee_client_app_load.h"
 #include "tee_client_inner.h"
 #include "tee_client_socket.h"
+#include "tee_client_ext_api.h"
+#include "tee_shm_pool.h"
 
 #define TEE_ERROR_CA_AUTH_FAIL 0xFFFFCFE5
 
@@ -95,16 +99,6 @@ void ClearBit(uint32_t i, uint32_t byteMax, uint8_t *bitMap)
     bitMap[i >> SHIFT] &= (uint8_t)(~(1U << (i & MASK)));
 }
 
-static void ClearBitWithLock(pthread_mutex_t *mutex, uint32_t i, uint32_t byteMax, uint8_t *bitMap)
-{
-    if (pthread_mutex_lock(mutex) != 0) {
-        tloge("get share mem bit lock failed\n");
-        return;
-    }
-    ClearBit(i, byteMax, bitMap);
-    (void)pthread_mutex_unlock(mutex);
-}
-
 enum BitmapOps {
     SET,
     CLEAR
@@ -154,17 +148,6 @@ int32_t GetAndSetBit(uint8_t *bitMap, uint32_t byteMax)
     return IterateBitmap(bitMap, byteMax, SET);
 }
 
-static int32_t GetAndSetBitWithLock(pthread_mutex_t *mutex, uint8_t *bitMap, uint32_t byteMax)
-{
-    if (pthread_mutex_lock(mutex) != 0) {
-        tloge("get share mem bit lock failed\n");
-        return -1;
-    }
-    int32_t validBit = GetAndSetBit(bitMap, byteMax);
-    (void)pthread_mutex_unlock(mutex);
-    return validBit;
-}
-
 int32_t GetAndCleartBit(uint8_t *bitMap, uint32_t byteMax)
 {
     if (bitMap == NULL) {
@@ -173,85 +156,190 @@ int32_t GetAndCleartBit(uint8_t *bitMap, uint32_t byteMax)
     return IterateBitmap(bitMap, byteMax, CLEAR);
 }
 
-static pthread_mutex_t g_mutexAtom = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Reference counts are plain uint32_t fields because TEEC_Session and
+ * TEEC_SharedMemory are part of the public ABI; they have the size and
+ * alignment of atomic_uint and are only ever touched through these helpers
+ * once the object is shared.
+ *
+ * The last put frees the object, so a reference may only be taken on an
+ * object whose count can't be zero. Contexts are found without a lock, see
+ * the epoch guard of the context shards below. Sessions and shared memory are
+ * only found under the lock of the index holding a reference on them
+ * (bucket->lock, shrMemLock), and are unlinked under that lock before the
+ * index reference is put: whoever finds one there takes its reference while
+ * the count is still at least one.
+ */
 static void AtomInc(volatile uint32_t *cnt)
 {
-    /*
-     * The use of g_mutexAtom has been rigorously checked
-     * and there is no risk of failure, we do not care the return value
-     * of pthread_mutex_lock here
-     */
-    (void)pthread_mutex_lock(&g_mutexAtom);
-    (*cnt)++;
-    (void)pthread_mutex_unlock(&g_mutexAtom);
+    (void)atomic_fetch_add_explicit((volatile atomic_uint *)cnt, 1, memory_order_relaxed);
 }
 
 static bool AtomDecAndCompareWithZero(volatile uint32_t *cnt)
 {
-    bool result = false;
-
-    /*
-     * The use of g_mutexAtom has been rigorously checked
-     * and there is no risk of failure, we do not care the return value
-     * of pthread_mutex_lock here
-     */
-    (void)pthread_mutex_lock(&g_mutexAtom);
-    (*cnt)--;
-    if ((*cnt) == 0) {
-        result = true;
+    if (atomic_fetch_sub_explicit((volatile atomic_uint *)cnt, 1, memory_order_release) != 1) {
+        return false;
     }
-    (void)pthread_mutex_unlock(&g_mutexAtom);
-    return result;
+    /* the last put must observe every write made by the previous holders before freeing */
+    atomic_thread_fence(memory_order_acquire);
+    return true;
 }
 
-static LIST_DECLARE(g_teecContextList);
-static pthread_mutex_t g_mutexTeecContext = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Contexts are registered in shards indexed by fd. Lookups walk the shard chain
+ * without taking any lock, inside an epoch guard: a reader bumps the counter of
+ * the current epoch of its shard for the duration of the walk. Writers serialize
+ * on the shard lock, unlink the context, then flip the epoch twice and wait for
+ * the readers of each epoch to drain before the registry reference is dropped,
+ * so a context found by a reader is never freed under it.
+ */
+#define CONTEXT_SHARD_NUM   64
+#define CONTEXT_SHARD_MASK  (CONTEXT_SHARD_NUM - 1)
+#define CACHE_LINE_SIZE     64
+
+struct ContextShard {
+    _Atomic(TEEC_ContextHidl *) head;
+    atomic_uint epoch;
+    atomic_uint readers[2];
+    pthread_mutex_t writeLock;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct ContextShard g_contextShards[CONTEXT_SHARD_NUM];
+static pthread_once_t g_contextShardsOnce = PTHREAD_ONCE_INIT;
+
 void TEEC_CloseSessionHidl(TEEC_Session *session, const TEEC_ContextHidl *context);
 void TEEC_FinalizeContextHidl(TEEC_ContextHidl *context);
 
-static int32_t MutexLockContext(void)
+static void InitContextShards(void)
+{
+    for (uint32_t i = 0; i < CONTEXT_SHARD_NUM; i++) {
+        atomic_init(&g_contextShards[i].head, NULL);
+        atomic_init(&g_contextShards[i].epoch, 0);
+        atomic_init(&g_contextShards[i].readers[0], 0);
+        atomic_init(&g_contextShards[i].readers[1], 0);
+        (void)pthread_mutex_init(&g_contextShards[i].writeLock, NULL);
+    }
+}
+
+static struct ContextShard *GetContextShard(int32_t fd)
+{
+    (void)pthread_once(&g_contextShardsOnce, InitContextShards);
+    return &g_contextShards[(uint32_t)fd & CONTEXT_SHARD_MASK];
+}
+
+static uint32_t ShardReadLock(struct ContextShard *shard)
+{
+    uint32_t idx = atomic_load(&shard->epoch) & 1;
+    (void)atomic_fetch_add(&shard->readers[idx], 1);
+    return idx;
+}
+
+static void ShardReadUnlock(struct ContextShard *shard, uint32_t idx)
+{
+    (void)atomic_fetch_sub(&shard->readers[idx], 1);
+}
+
+/* called with shard->writeLock held, after the context has been unlinked */
+static void ShardSynchronize(struct ContextShard *shard)
 {
-    int lockRet = pthread_mutex_lock(&g_mutexTeecContext);
-    return lockRet;
+    for (int i = 0; i < 2; i++) {
+        uint32_t old = atomic_fetch_xor(&shard->epoch, 1) & 1;
+        while (atomic_load(&shard->readers[old]) != 0) {
+            (void)sched_yield();
+        }
+    }
 }
 
-static void MutexUnlockContext(int lockRet)
+static int32_t InsertBnContext(TEEC_ContextHidl *context)
 {
+    struct ContextShard *shard = GetContextShard(context->fd);
+
+    int lockRet = pthread_mutex_lock(&shard->writeLock);
     if (lockRet != 0) {
-        tloge("unlock mutex: not exe, mutex not in lock state. lockRet = %d\n", lockRet);
-        return;
+        tloge("get context shard lock failed.\n");
+        return lockRet;
+    }
+    atomic_store_explicit(&context->c_next, atomic_load_explicit(&shard->head, memory_order_relaxed),
+        memory_order_relaxed);
+    atomic_store_explicit(&shard->head, context, memory_order_release);
+    (void)pthread_mutex_unlock(&shard->writeLock);
+    return 0;
+}
+
+static struct SessionBucket *GetSessionBucket(TEEC_ContextHidl *context, uint32_t sessionId)
+{
+    /* session ids are not uniformly distributed, scramble them before masking */
+    uint32_t hash = (sessionId * 0x9E3779B1U) >> 16;
+    return &context->session_buckets[hash & (SESSION_BUCKET_NUM - 1)];
+}
+
+static void InitSessionBuckets(TEEC_ContextHidl *context)
+{
+    for (uint32_t i = 0; i < SESSION_BUCKET_NUM; i++) {
+        ListInit(&context->session_buckets[i].list);
+        (void)pthread_mutex_init(&context->session_buckets[i].lock, NULL);
+    }
+}
+
+static void DestroySessionBuckets(TEEC_ContextHidl *context)
+{
+    for (uint32_t i = 0; i < SESSION_BUCKET_NUM; i++) {
+        (void)pthread_mutex_destroy(&context->session_buckets[i].lock);
+    }
+}
+
+/*
+ * If session is still linked from an earlier open, remove it. A session being
+ * opened may be uninitialized memory of the caller, so its id can't tell the
+ * bucket: look for the struct itself in every bucket.
+ */
+static TEEC_Result RemoveStaleSession(TEEC_ContextHidl *context, const TEEC_Session *session)
+{
+    struct ListNode *node = NULL;
+    struct ListNode *n    = NULL;
+    bool found            = false;
+
+    for (uint32_t i = 0; i < SESSION_BUCKET_NUM && !found; i++) {
+        struct SessionBucket *bucket = &context->session_buckets[i];
+        int lockRet = pthread_mutex_lock(&bucket->lock);
+        if (lockRet != 0) {
+            tloge("get session lock failed.\n");
+            return TEEC_ERROR_GENERIC;
+        }
+        LIST_FOR_EACH_SAFE(node, n, &bucket->list)
+        {
+            if (CONTAINER_OF(node, TEEC_Session, head) == session) {
+                ListRemoveEntry(node);
+                found = true;
+                break;
+            }
+        }
+        (void)pthread_mutex_unlock(&bucket->lock);
     }
-    (void)pthread_mutex_unlock(&g_mutexTeecContext);
+    return TEEC_SUCCESS;
 }
 
 static TEEC_Result AddSessionList(uint32_t sessionId, const TEEC_UUID *destination, TEEC_ContextHidl *context,
                                   TEEC_Session *session)
 {
-    struct ListNode *node      = NULL;
-    struct ListNode *n         = NULL;
-    TEEC_Session *sessionEntry = NULL;
+    if (RemoveStaleSession(context, session) != TEEC_SUCCESS) {
+        return TEEC_ERROR_GENERIC;
+    }
 
     session->session_id = sessionId;
     session->service_id = *destination;
     session->ops_cnt    = 1; /* only for libteec hidl, not for vendor ca */
 
-    int lockRet = pthread_mutex_lock(&context->sessionLock);
+    struct SessionBucket *bucket = GetSessionBucket(context, sessionId);
+    int lockRet = pthread_mutex_lock(&bucket->lock);
     if (lockRet != 0) {
         tloge("get session lock failed.\n");
         return TEEC_ERROR_GENERIC;
     }
-    /* if session is still in list,  remove it */
-    LIST_FOR_EACH_SAFE(node, n, &context->session_list)
-    {
-        sessionEntry = CONTAINER_OF(node, TEEC_Session, head);
-        if (sessionEntry == session) {
-            ListRemoveEntry(node);
-        }
-    }
     ListInit(&session->head);
-    ListInsertTail(&context->session_list, &session->head);
+    ListInsertTail(&bucket->list, &session->head);
     AtomInc(&session->ops_cnt); /* only for libteec hidl, not for vendor ca */
-    (void)pthread_mutex_unlock(&context->sessionLock);
+    (void)pthread_mutex_unlock(&bucket->lock);
     return TEEC_SUCCESS;
 }
 
@@ -267,29 +355,20 @@ static int CaDaemonConnectWithoutCaInfo(void)
     }
 
     caInfo.fromHidlSide = NON_HIDL_SIDE;
-    ret = CaDaemonConnectWithCaInfo(&caInfo, GET_FD, NULL);
+    ret = CaDaemonConnectPreAuth(&caInfo);
     return ret;
 }
 
-static TEEC_ContextHidl *FindBnContext(const TEEC_Context *context)
+/* caller must be inside the shard epoch guard or hold the shard write lock */
+static TEEC_ContextHidl *FindBnContext(const struct ContextShard *shard, int32_t fd)
 {
-    TEEC_ContextHidl *sContext = NULL;
-
-    if (context == NULL) {
-        tloge("find context: context is NULL!\n");
-        return NULL;
-    }
+    TEEC_ContextHidl *sContext = atomic_load_explicit(&shard->head, memory_order_acquire);
 
-    struct ListNode *ptr = NULL;
-    if (!LIST_EMPTY(&g_teecContextList)) {
-        LIST_FOR_EACH(ptr, &g_teecContextList)
-        {
-            TEEC_ContextHidl *tmp = CONTAINER_OF(ptr, TEEC_ContextHidl, c_node);
-            if (tmp->fd == context->fd) {
-                sContext = tmp;
-                break;
-            }
+    while (sContext != NULL) {
+        if (sContext->fd == fd) {
+            break;
         }
+        sContext = atomic_load_explicit(&sContext->c_next, memory_order_acquire);
     }
     return sContext;
 }
@@ -298,16 +377,18 @@ TEEC_ContextHidl *GetBnContext(const TEEC_Context *context)
 {
     TEEC_ContextHidl *sContext = NULL;
 
-    int retMutexLock = MutexLockContext();
-    if (retMutexLock != 0) {
-        tloge("get context lock failed.\n");
+    if (context == NULL) {
+        tloge("get context: context is NULL!\n");
         return NULL;
     }
-    sContext = FindBnContext(context);
+
+    struct ContextShard *shard = GetContextShard(context->fd);
+    uint32_t idx = ShardReadLock(shard);
+    sContext = FindBnContext(shard, context->fd);
     if (sContext != NULL) {
         AtomInc(&sContext->ops_cnt);
     }
-    MutexUnlockContext(retMutexLock);
+    ShardReadUnlock(shard, idx);
     return sContext;
 }
 
@@ -330,32 +411,46 @@ TEEC_ContextHidl *FindAndRemoveBnContext(const TEEC_Context *context)
 {
     TEEC_ContextHidl *sContext = NULL;
 
-    int retMutexLock = MutexLockContext();
-    if (retMutexLock != 0) {
-        tloge("get context lock failed.\n");
+    if (context == NULL) {
+        tloge("find and remove context: context is NULL!\n");
+        return NULL;
+    }
+
+    struct ContextShard *shard = GetContextShard(context->fd);
+    int lockRet = pthread_mutex_lock(&shard->writeLock);
+    if (lockRet != 0) {
+        tloge("get context shard lock failed.\n");
         return NULL;
     }
-    sContext = FindBnContext(context);
+
+    _Atomic(TEEC_ContextHidl *) *link = &shard->head;
+    sContext = atomic_load_explicit(link, memory_order_relaxed);
+    while (sContext != NULL && sContext->fd != context->fd) {
+        link = &sContext->c_next;
+        sContext = atomic_load_explicit(link, memory_order_relaxed);
+    }
     if (sContext != NULL) {
-        ListRemoveEntry(&sContext->c_node);
+        atomic_store_explicit(link, atomic_load_explicit(&sContext->c_next, memory_order_relaxed),
+            memory_order_release);
+        /* wait for lock-free readers that may still hold a pointer to it */
+        ShardSynchronize(shard);
     }
-    MutexUnlockContext(retMutexLock);
+    (void)pthread_mutex_unlock(&shard->writeLock);
     return sContext;
 }
 
-static TEEC_Session *FindBnSession(const TEEC_Session *session, const TEEC_ContextHidl *context)
+/* caller must hold bucket->lock */
+static TEEC_Session *FindBnSession(const TEEC_Session *session, const struct SessionBucket *bucket)
 {
     TEEC_Session *sSession = NULL;
 
     struct ListNode *ptr = NULL;
-    if (!LIST_EMPTY(&context->session_list)) {
-        LIST_FOR_EACH(ptr, &context->session_list)
-        {
-            TEEC_Session *tmp = CONTAINER_OF(ptr, TEEC_Session, head);
-            if (tmp->session_id == session->session_id) {
-                sSession = tmp;
-                break;
-            }
+    LIST_FOR_EACH(ptr, &bucket->list)
+    {
+        TEEC_Session *tmp = CONTAINER_OF(ptr, TEEC_Session, head);
+        if (tmp->session_id == session->session_id) {
+            sSession = tmp;
+            break;
         }
     }
     return sSession;
@@ -371,16 +466,17 @@ TEEC_Session *GetBnSession(const TEEC_Session *session, TEEC_ContextHidl *contex
         return NULL;
     }
 
-    int lockRet = pthread_mutex_lock(&context->sessionLock);
+    struct SessionBucket *bucket = GetSessionBucket(context, session->session_id);
+    int lockRet = pthread_mutex_lock(&bucket->lock);
     if (lockRet != 0) {
         tloge("get session lock failed.\n");
         return NULL;
     }
-    sSession = FindBnSession(session, context);
+    sSession = FindBnSession(session, bucket);
     if (sSession != NULL) {
         AtomInc(&sSession->ops_cnt);
     }
-    (void)pthread_mutex_unlock(&context->sessionLock);
+    (void)pthread_mutex_unlock(&bucket->lock);
     return sSession;
 }
 
@@ -407,19 +503,357 @@ TEEC_Session *FindAndRemoveSession(const TEEC_Session *session, TEEC_ContextHidl
         return NULL;
     }
 
-    int lockRet = pthread_mutex_lock(&context->sessionLock);
+    struct SessionBucket *bucket = GetSessionBucket(context, session->session_id);
+    int lockRet = pthread_mutex_lock(&bucket->lock);
     if (lockRet != 0) {
         tloge("get session lock failed.\n");
         return NULL;
     }
-    sSession = FindBnSession(session, context);
+    sSession = FindBnSession(session, bucket);
     if (sSession != NULL) {
         ListRemoveEntry(&sSession->head);
     }
-    (void)pthread_mutex_unlock(&context->sessionLock);
+    (void)pthread_mutex_unlock(&bucket->lock);
     return sSession;
 }
 
+static void InitShareMemIndex(TEEC_ContextHidl *context)
+{
+    ListInit(&context->shrd_mem_list);
+    for (uint32_t i = 0; i < SHAREMEM_BUCKET_NUM; i++) {
+        ListInit(&context->shm_buckets[i]);
+    }
+    context->shm_bitmap     = NULL;
+    context->shm_bitmap_len = 0;
+    context->shm_slots      = NULL;
+    context->shm_slot_num   = 0;
+
+    atomic_init(&context->shm_stats.allocated, 0);
+    atomic_init(&context->shm_stats.registered, 0);
+    atomic_init(&context->shm_stats.offsetInUse, 0);
+    atomic_init(&context->shm_stats.offsetPeak, 0);
+    atomic_init(&context->shm_stats.allocTotal, 0);
+    atomic_init(&context->shm_stats.registerTotal, 0);
+    atomic_init(&context->shm_stats.allocFailed, 0);
+    atomic_init(&context->shm_stats.regCacheHits, 0);
+    atomic_init(&context->shm_stats.regCacheMisses, 0);
+    atomic_init(&context->shm_stats.regCacheEvicted, 0);
+    atomic_init(&context->shm_pool, NULL);
+
+    ListInit(&context->reg_cache_lru);
+    for (uint32_t i = 0; i < REG_CACHE_BUCKET_NUM; i++) {
+        ListInit(&context->reg_cache_buckets[i]);
+    }
+    context->reg_cache_num  = 0;
+    context->reg_pinned_num = 0;
+}
+
+static void DestroyShareMemIndex(TEEC_ContextHidl *context)
+{
+    ShmPoolDestroy(atomic_exchange(&context->shm_pool, NULL));
+    free(context->shm_bitmap);
+    context->shm_bitmap     = NULL;
+    context->shm_bitmap_len = 0;
+    free(context->shm_slots);
+    context->shm_slots    = NULL;
+    context->shm_slot_num = 0;
+}
+
+static void FreeZeroCopyBuffer(TEEC_SharedMemoryHidl *sharedMem)
+{
+    if (sharedMem->pool_class != SHM_POOL_NO_CLASS) {
+        /* the context may have dropped its pool already, the buffer's own reference keeps it valid */
+        ShmPoolFree(sharedMem->pool, sharedMem->buffer, sharedMem->pool_class);
+        sharedMem->pool       = NULL;
+        sharedMem->pool_class = SHM_POOL_NO_CLASS;
+    } else {
+        free(sharedMem->buffer);
+    }
+}
+
+/* only blocks mapped from the driver own an mmap offset */
+static bool ShmHasOffset(const TEEC_SharedMemoryHidl *sharedMem)
+{
+    return sharedMem->is_allocated && (sharedMem->flags != TEEC_MEM_SHARED_INOUT) &&
+        (sharedMem->flags != TEEC_MEM_REGISTER_INOUT);
+}
+
+static uint32_t ShmBucketIndex(const void *buffer)
+{
+    uint64_t hash = ((uint64_t)(uintptr_t)buffer >> SHIFT) * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(hash >> 32) & (SHAREMEM_BUCKET_NUM - 1);
+}
+
+static int32_t AllocShmOffset(TEEC_ContextHidl *context)
+{
+    if (pthread_mutex_lock(&context->shrMemBitMapLock) != 0) {
+        tloge("get share mem bit lock failed\n");
+        return -1;
+    }
+
+    int32_t validBit = GetAndSetBit(context->shm_bitmap, context->shm_bitmap_len);
+    if (validBit < 0 && context->shm_bitmap_len < MAX_NUM_OF_SHAREMEM_BITMAP) {
+        uint32_t oldLen = context->shm_bitmap_len;
+        uint32_t newLen = (oldLen == 0) ? NUM_OF_SHAREMEM_BITMAP : oldLen * 2;
+        uint8_t *newMap = (uint8_t *)realloc(context->shm_bitmap, newLen);
+        if (newMap != NULL) {
+            context->shm_bitmap = newMap;
+            if (memset_s(newMap + oldLen, newLen - oldLen, 0, newLen - oldLen) == EOK) {
+                context->shm_bitmap_len = newLen;
+                validBit = GetAndSetBit(context->shm_bitmap, context->shm_bitmap_len);
+            }
+        }
+    }
+
+    if (validBit >= 0) {
+        uint32_t inUse = atomic_fetch_add_explicit(&context->shm_stats.offsetInUse, 1, memory_order_relaxed) + 1;
+        if (inUse > atomic_load_explicit(&context->shm_stats.offsetPeak, memory_order_relaxed)) {
+            atomic_store_explicit(&context->shm_stats.offsetPeak, inUse, memory_order_relaxed);
+        }
+    }
+    (void)pthread_mutex_unlock(&context->shrMemBitMapLock);
+    return validBit;
+}
+
+static void FreeShmOffset(TEEC_ContextHidl *context, uint32_t offset)
+{
+    if (pthread_mutex_lock(&context->shrMemBitMapLock) != 0) {
+        tloge("get share mem bit lock failed\n");
+        return;
+    }
+    if (CheckBit(offset, context->shm_bitmap_len, context->shm_bitmap)) {
+        ClearBit(offset, context->shm_bitmap_len, context->shm_bitmap);
+        (void)atomic_fetch_sub_explicit(&context->shm_stats.offsetInUse, 1, memory_order_relaxed);
+    }
+    (void)pthread_mutex_unlock(&context->shrMemBitMapLock);
+}
+
+/* caller must hold context->shrMemLock */
+static bool SetShmSlot(TEEC_ContextHidl *context, uint32_t offset, TEEC_SharedMemoryHidl *sharedMem)
+{
+    if (offset >= context->shm_slot_num) {
+        uint32_t newNum = (context->shm_slot_num == 0) ? (NUM_OF_SHAREMEM_BITMAP * BYTE_BIT) :
+            context->shm_slot_num;
+        while (newNum <= offset) {
+            newNum *= 2;
+        }
+        TEEC_SharedMemoryHidl **newSlots =
+            (TEEC_SharedMemoryHidl **)realloc(context->shm_slots, newNum * sizeof(*newSlots));
+        if (newSlots == NULL) {
+            tloge("grow share mem slots failed\n");
+            return false;
+        }
+        context->shm_slots = newSlots;
+        size_t oldSize = context->shm_slot_num * sizeof(*newSlots);
+        size_t newSize = newNum * sizeof(*newSlots);
+        if (memset_s((uint8_t *)newSlots + oldSize, newSize - oldSize, 0, newSize - oldSize) != EOK) {
+            return false;
+        }
+        context->shm_slot_num = newNum;
+    }
+    context->shm_slots[offset] = sharedMem;
+    return true;
+}
+
+/* caller must hold context->shrMemLock */
+static bool InsertShmLocked(TEEC_ContextHidl *context, TEEC_SharedMemoryHidl *sharedMem)
+{
+    if (ShmHasOffset(sharedMem) && !SetShmSlot(context, sharedMem->offset, sharedMem)) {
+        return false;
+    }
+    ListInsertTail(&context->shrd_mem_list, &sharedMem->head);
+    ListInsertTail(&context->shm_buckets[ShmBucketIndex(sharedMem->buffer)], &sharedMem->b_node);
+    if (sharedMem->is_allocated) {
+        (void)atomic_fetch_add_explicit(&context->shm_stats.allocated, 1, memory_order_relaxed);
+        (void)atomic_fetch_add_explicit(&context->shm_stats.allocTotal, 1, memory_order_relaxed);
+    } else {
+        (void)atomic_fetch_add_explicit(&context->shm_stats.registered, 1, memory_order_relaxed);
+        (void)atomic_fetch_add_explicit(&context->shm_stats.registerTotal, 1, memory_order_relaxed);
+    }
+    return true;
+}
+
+/* caller must hold context->shrMemLock */
+static void RemoveShmLocked(TEEC_ContextHidl *context, TEEC_SharedMemoryHidl *sharedMem)
+{
+    ListRemoveEntry(&sharedMem->head);
+    ListRemoveEntry(&sharedMem->b_node);
+    if (ShmHasOffset(sharedMem) && sharedMem->offset < context->shm_slot_num &&
+        context->shm_slots[sharedMem->offset] == sharedMem) {
+        context->shm_slots[sharedMem->offset] = NULL;
+    }
+    if (sharedMem->is_allocated) {
+        (void)atomic_fetch_sub_explicit(&context->shm_stats.allocated, 1, memory_order_relaxed);
+    } else {
+        (void)atomic_fetch_sub_explicit(&context->shm_stats.registered, 1, memory_order_relaxed);
+    }
+}
+
+/* caller must hold context->shrMemLock */
+static TEEC_SharedMemoryHidl *FindShmByBuffer(TEEC_ContextHidl *context, const void *buffer)
+{
+    struct ListNode *ptr = NULL;
+    struct ListNode *bucket = &context->shm_buckets[ShmBucketIndex(buffer)];
+
+    LIST_FOR_EACH(ptr, bucket)
+    {
+        TEEC_SharedMemoryHidl *tmp = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, b_node);
+        if (tmp->buffer == buffer) {
+            return tmp;
+        }
+    }
+    return NULL;
+}
+
+static void ReleaseSharedMemory(TEEC_SharedMemoryHidl *sharedMem);
+
+/*
+ * Registered memory of vendor CAs is only bookkeeping on this side, it is passed to
+ * the driver as a temp memref on every invoke. Released registrations are parked in
+ * a per-context cache so that a CA registering the same buffer around every request
+ * reuses the entry instead of allocating and indexing a new one. Hidl contexts hand
+ * in their own objects and are not cached.
+ */
+static struct ListNode *RegCacheBucket(TEEC_ContextHidl *context, const void *buffer)
+{
+    return &context->reg_cache_buckets[ShmBucketIndex(buffer) & (REG_CACHE_BUCKET_NUM - 1)];
+}
+
+/* caller must hold context->shrMemLock */
+static void DropCachedRegLocked(TEEC_ContextHidl *context, TEEC_SharedMemoryHidl *sharedMem)
+{
+    ListRemoveEntry(&sharedMem->head);
+    ListRemoveEntry(&sharedMem->b_node);
+    if (sharedMem->pinned) {
+        context->reg_pinned_num--;
+    } else {
+        context->reg_cache_num--;
+    }
+    (void)atomic_fetch_add_explicit(&context->shm_stats.regCacheEvicted, 1, memory_order_relaxed);
+    ReleaseSharedMemory(sharedMem);
+}
+
+/* caller must hold context->shrMemLock, evicts the least recently released unpinned entries */
+static void TrimRegCacheLocked(TEEC_ContextHidl *context)
+{
+    struct ListNode *ptr = NULL;
+    struct ListNode *n   = NULL;
+
+    LIST_FOR_EACH_SAFE(ptr, n, &context->reg_cache_lru)
+    {
+        if (context->reg_cache_num <= REG_CACHE_MAX) {
+            break;
+        }
+        TEEC_SharedMemoryHidl *tmp = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, head);
+        if (!tmp->pinned) {
+            DropCachedRegLocked(context, tmp);
+        }
+    }
+}
+
+static bool TakeCachedRegistration(TEEC_ContextHidl *context, const TEEC_SharedMemory *sharedMem,
+                                   TEEC_SharedMemoryHidl **shmHidl)
+{
+    struct ListNode *ptr = NULL;
+    TEEC_SharedMemoryHidl *found = NULL;
+
+    if (context->callFromHidl || pthread_mutex_lock(&context->shrMemLock) != 0) {
+        return false;
+    }
+    LIST_FOR_EACH(ptr, RegCacheBucket(context, sharedMem->buffer))
+    {
+        TEEC_SharedMemoryHidl *tmp = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, b_node);
+        if (tmp->buffer == sharedMem->buffer && tmp->size == sharedMem->size && tmp->flags == sharedMem->flags) {
+            found = tmp;
+            break;
+        }
+    }
+    if (found != NULL) {
+        ListRemoveEntry(&found->head);
+        ListRemoveEntry(&found->b_node);
+        if (!found->pinned) {
+            context->reg_cache_num--;
+        }
+        found->ops_cnt = 1;
+        (void)InsertShmLocked(context, found);
+        (void)atomic_fetch_add_explicit(&context->shm_stats.regCacheHits, 1, memory_order_relaxed);
+        *shmHidl = found;
+    } else {
+        (void)atomic_fetch_add_explicit(&context->shm_stats.regCacheMisses, 1, memory_order_relaxed);
+    }
+    (void)pthread_mutex_unlock(&context->shrMemLock);
+    return found != NULL;
+}
+
+/* sharedMem has already been removed from the context index */
+static bool CacheRegistration(TEEC_ContextHidl *context, TEEC_SharedMemoryHidl *sharedMem)
+{
+    if (context->callFromHidl || sharedMem->is_allocated) {
+        return false;
+    }
+    if (pthread_mutex_lock(&context->shrMemLock) != 0) {
+        return false;
+    }
+    /* someone still holds a reference, let the last put free it */
+    if (atomic_load((volatile atomic_uint *)&sharedMem->ops_cnt) != 1) {
+        (void)pthread_mutex_unlock(&context->shrMemLock);
+        return false;
+    }
+    ListInsertTail(&context->reg_cache_lru, &sharedMem->head);
+    ListInsertTail(RegCacheBucket(context, sharedMem->buffer), &sharedMem->b_node);
+    if (!sharedMem->pinned) {
+        context->reg_cache_num++;
+        TrimRegCacheLocked(context);
+    }
+    (void)pthread_mutex_unlock(&context->shrMemLock);
+    return true;
+}
+
+static void FlushRegCache(TEEC_ContextHidl *context)
+{
+    struct ListNode *ptr = NULL;
+    struct ListNode *n   = NULL;
+
+    if (pthread_mutex_lock(&context->shrMemLock) != 0) {
+        tloge("get share mem lock failed.\n");
+        return;
+    }
+    LIST_FOR_EACH_SAFE(ptr, n, &context->reg_cache_lru)
+    {
+        DropCachedRegLocked(context, CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, head));
+    }
+    (void)pthread_mutex_unlock(&context->shrMemLock);
+}
+
+static void UnpinSessionRegistrations(TEEC_ContextHidl *context, uint32_t sessionId)
+{
+    struct ListNode *ptr = NULL;
+    struct ListNode *n   = NULL;
+
+    if (context->reg_pinned_num == 0 || pthread_mutex_lock(&context->shrMemLock) != 0) {
+        return;
+    }
+    LIST_FOR_EACH(ptr, &context->shrd_mem_list)
+    {
+        TEEC_SharedMemoryHidl *tmp = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, head);
+        if (tmp->pinned && tmp->pin_session_id == sessionId) {
+            tmp->pinned = false;
+            context->reg_pinned_num--;
+        }
+    }
+    LIST_FOR_EACH_SAFE(ptr, n, &context->reg_cache_lru)
+    {
+        TEEC_SharedMemoryHidl *tmp = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, head);
+        if (tmp->pinned && tmp->pin_session_id == sessionId) {
+            tmp->pinned = false;
+            context->reg_pinned_num--;
+            context->reg_cache_num++;
+        }
+    }
+    TrimRegCacheLocked(context);
+    (void)pthread_mutex_unlock(&context->shrMemLock);
+}
+
 static void ReleaseSharedMemory(TEEC_SharedMemoryHidl *sharedMem)
 {
     if ((!sharedMem->is_allocated) || (sharedMem->buffer == NULL)) {
@@ -427,7 +861,7 @@ static void ReleaseSharedMemory(TEEC_SharedMemoryHidl *sharedMem)
     }
 
     if (sharedMem->flags == TEEC_MEM_SHARED_INOUT || sharedMem->flags == TEEC_MEM_REGISTER_INOUT) {
-        free(sharedMem->buffer);
+        FreeZeroCopyBuffer(sharedMem);
     } else {
         if ((sharedMem->buffer != ZERO_SIZE_PTR) && (sharedMem->size != 0)) {
             if (munmap(sharedMem->buffer, sharedMem->size) != 0) {
@@ -435,8 +869,9 @@ static void ReleaseSharedMemory(TEEC_SharedMemoryHidl *sharedMem)
             }
         }
     }
-    ClearBitWithLock(&sharedMem->context->shrMemBitMapLock, sharedMem->offset,
-                         sizeof(sharedMem->context->shm_bitmap), sharedMem->context->shm_bitmap);
+    if (ShmHasOffset(sharedMem)) {
+        FreeShmOffset(sharedMem->context, sharedMem->offset);
+    }
 CLEAR_SHM:
     sharedMem->buffer  = NULL;
     sharedMem->size    = 0;
@@ -474,20 +909,14 @@ TEEC_SharedMemoryHidl *GetBnShmByOffset(uint32_t shmOffset, TEEC_ContextHidl *co
     }
 
     /* found server shardmem */
-    struct ListNode *ptr = NULL;
-    if (!LIST_EMPTY(&context->shrd_mem_list)) {
-        LIST_FOR_EACH(ptr, &context->shrd_mem_list)
-        {
-            tempShardMem = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, head);
-            if (tempShardMem->offset == shmOffset) {
-                AtomInc(&tempShardMem->ops_cnt);
-                (void)pthread_mutex_unlock(&context->shrMemLock);
-                return tempShardMem;
-            }
-        }
+    if (shmOffset < context->shm_slot_num) {
+        tempShardMem = context->shm_slots[shmOffset];
+    }
+    if (tempShardMem != NULL) {
+        AtomInc(&tempShardMem->ops_cnt);
     }
     (void)pthread_mutex_unlock(&context->shrMemLock);
-    return NULL;
+    return tempShardMem;
 }
 
 static TEEC_Result MallocShrMemHidl(TEEC_SharedMemoryHidl **shareMemHidl)
@@ -698,7 +1127,6 @@ TEEC_Result TEEC_InitializeContextWithType(const char *name, TEEC_ContextHidl *c
                                            bool fromHidl, const CaAuthInfo *caInfo)
 {
     int32_t fd = -1;
-    errno_t nRet;
 
     (void)name; /* supress warning */
     (void)type; /* discarded */
@@ -718,29 +1146,21 @@ TEEC_Result TEEC_InitializeContextWithType(const char *name, TEEC_ContextHidl *c
     context->ops_cnt      = 1;
     context->callFromHidl = fromHidl;
 
-    ListInit(&context->session_list);
-    ListInit(&context->shrd_mem_list);
+    InitShareMemIndex(context);
 
-    nRet = memset_s(context->shm_bitmap, sizeof(context->shm_bitmap), 0x00, sizeof(context->shm_bitmap));
-    if (nRet != EOK) {
-        tloge("Initial context: context->shm_bitmap memset failed : %d\n", (int)nRet);
+    InitSessionBuckets(context);
+    (void)pthread_mutex_init(&context->shrMemLock, NULL);
+    (void)pthread_mutex_init(&context->shrMemBitMapLock, NULL);
+    AtomInc(&context->ops_cnt);
+    if (InsertBnContext(context) != 0) {
+        DestroySessionBuckets(context);
+        (void)pthread_mutex_destroy(&context->shrMemLock);
+        (void)pthread_mutex_destroy(&context->shrMemBitMapLock);
+        DestroyShareMemIndex(context);
         close((int)context->fd);
         return TEEC_FAIL;
     }
 
-    int retMutexLock = MutexLockContext();
-    if (retMutexLock != 0) {
-        tloge("get context lock failed.\n");
-        close((int)context->fd);
-        return TEEC_FAIL;
-    }
-    (void)pthread_mutex_init(&context->sessionLock, NULL);
-    (void)pthread_mutex_init(&context->shrMemLock, NULL);
-    (void)pthread_mutex_init(&context->shrMemBitMapLock, NULL);
-    ListInsertTail(&g_teecContextList, &context->c_node);
-    AtomInc(&context->ops_cnt);
-    MutexUnlockContext(retMutexLock);
-
     return TEEC_SUCCESS;
 }
 
@@ -813,15 +1233,16 @@ void TEEC_FinalizeContextHidl(TEEC_ContextHidl *context)
         return;
     }
 
-    int lockRet = pthread_mutex_lock(&context->sessionLock);
-    if (lockRet != 0) {
-        tloge("get session lock failed.\n");
-        return;
-    }
-    if (!LIST_EMPTY(&context->session_list)) {
-        tlogd("context still has sessions opened, close it\n");
-
-        LIST_FOR_EACH_SAFE(ptr, n, &context->session_list)
+    for (uint32_t i = 0; i < SESSION_BUCKET_NUM; i++) {
+        struct SessionBucket *bucket = &context->session_buckets[i];
+        if (pthread_mutex_lock(&bucket->lock) != 0) {
+            tloge("get session lock failed.\n");
+            return;
+        }
+        if (!LIST_EMPTY(&bucket->list)) {
+            tlogd("context still has sessions opened, close it\n");
+        }
+        LIST_FOR_EACH_SAFE(ptr, n, &bucket->list)
         {
             session = CONTAINER_OF(ptr, TEEC_Session, head);
             ListRemoveEntry(&session->head);
@@ -832,10 +1253,10 @@ void TEEC_FinalizeContextHidl(TEEC_ContextHidl *context)
                 session = NULL;
             }
         }
+        (void)pthread_mutex_unlock(&bucket->lock);
     }
-    (void)pthread_mutex_unlock(&context->sessionLock);
 
-    lockRet = pthread_mutex_lock(&context->shrMemLock);
+    int lockRet = pthread_mutex_lock(&context->shrMemLock);
     if (lockRet != 0) {
         tloge("get shrmem lock failed.\n");
         return;
@@ -847,16 +1268,20 @@ void TEEC_FinalizeContextHidl(TEEC_ContextHidl *context)
         LIST_FOR_EACH_SAFE(ptr, n, &context->shrd_mem_list)
         {
             shrdMem = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, head);
-            ListRemoveEntry(&shrdMem->head);
+            RemoveShmLocked(context, shrdMem);
             PutBnShrMem(shrdMem); /* pair with Initial value 1 */
         }
     }
     (void)pthread_mutex_unlock(&context->shrMemLock);
 
+    FlushRegCache(context);
+
     close((int)context->fd);
     context->fd = -1;
-    (void)pthread_mutex_destroy(&context->sessionLock);
+    DestroySessionBuckets(context);
     (void)pthread_mutex_destroy(&context->shrMemLock);
+    (void)pthread_mutex_destroy(&context->shrMemBitMapLock);
+    DestroyShareMemIndex(context);
     free(context);
 }
 
@@ -973,10 +1398,7 @@ ERROR:
         *returnOrigin = cliContext.returns.origin;
     }
 
-    if (cliContext.memref.file_addr != 0 || cliContext.memref.file_h_addr != 0) {
-        free((void *)(uintptr_t)(cliContext.memref.file_addr |
-                (((uint64_t)cliContext.memref.file_h_addr) << H_OFFSET)));
-    }
+    TEEC_ReleaseApp(&cliContext);
     return teecRet;
 }
 
@@ -1091,6 +1513,7 @@ void TEEC_CloseSession(TEEC_Session *session)
         (void)PutBnContext(contextHidl);
         return;
     }
+    UnpinSessionRegistrations(contextHidl, session->session_id);
 
     TEEC_CloseSessionHidl(session, contextHidl);
     (void)PutBnContext(contextHidl);
@@ -1192,6 +1615,270 @@ ERROR:
     return teecRet;
 }
 
+static TEEC_Result CheckBatchEntries(TEEC_ContextHidl *context, const TEEC_Context *batchContext,
+                                     TEEC_InvokeBatchEntry *entries, uint32_t count)
+{
+    TEEC_Result ret = TEEC_SUCCESS;
+
+    for (uint32_t i = 0; i < count; i++) {
+        TEEC_InvokeBatchEntry *entry = &entries[i];
+        entry->returnOrigin = TEEC_ORIGIN_API;
+        entry->result       = (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+        if ((entry->session == NULL) || (entry->session->context != batchContext)) {
+            tloge("invoke batch: session of entry %u is invalid\n", i);
+            ret = (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+            continue;
+        }
+        if ((TEEC_CheckOperation(context, entry->operation) != TEEC_SUCCESS) ||
+            (CheckRegisterShm(entry->operation) != TEEC_SUCCESS)) {
+            tloge("invoke batch: operation of entry %u is invalid\n", i);
+            ret = (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+            continue;
+        }
+        entry->result = TEEC_SUCCESS;
+    }
+    return ret;
+}
+
+/*
+ * The driver has no vector command ioctl, so the entries still go down one
+ * SEND_CMD_REQ each. What is saved is the per call context lookup, the
+ * validation pass and the logging of the single invoke path.
+ */
+TEEC_Result TEEC_InvokeCommandBatch(TEEC_InvokeBatchEntry *entries, uint32_t count)
+{
+    TEEC_Result ret = TEEC_SUCCESS;
+    TC_NS_ClientContext cliContext;
+    TC_NS_ClientLogin cliLogin = { 0, 0 };
+
+    bool condition = (entries == NULL) || (count == 0) || (count > TEEC_INVOKE_BATCH_MAX) ||
+        (entries[0].session == NULL) || (entries[0].session->context == NULL);
+    if (condition) {
+        tloge("invoke batch: entries or count is invalid\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    TEEC_Context *batchContext    = entries[0].session->context;
+    TEEC_ContextHidl *contextHidl = GetBnContext(batchContext);
+    if (contextHidl == NULL) {
+        tloge("invoke batch: context is invalid\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    if (CheckBatchEntries(contextHidl, batchContext, entries, count) != TEEC_SUCCESS) {
+        ret = (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+        goto END;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        TEEC_InvokeBatchEntry *entry = &entries[i];
+        cliContext.returns.origin    = TEEC_ORIGIN_API;
+        entry->result = TEEC_Encode(&cliContext, &entry->session->service_id, entry->session->session_id,
+                                    entry->commandID, &cliLogin, entry->operation);
+        if (entry->result == TEEC_SUCCESS) {
+            entry->result = ProcessInvokeCommand(contextHidl, &cliContext);
+        }
+        entry->returnOrigin = cliContext.returns.origin;
+        if ((entry->result != TEEC_SUCCESS) && (ret == TEEC_SUCCESS)) {
+            ret = entry->result;
+        }
+    }
+
+END:
+    (void)PutBnContext(contextHidl);
+    return ret;
+}
+
+static TEEC_Result TEEC_CheckTmpRef(TEEC_TempMemoryReference tmpref);
+
+struct PreparedOperation {
+    TEEC_ContextHidl *context;                      /* reference held until release */
+    TEEC_Session *session;
+    TEEC_Operation *operation;
+    uint32_t paramTypes;                            /* operation->paramTypes when prepared */
+    TEEC_SharedMemory *parent[TEEC_PARAM_NUM];      /* memref parents checked when prepared */
+    TEEC_SharedMemoryHidl *shm[TEEC_PARAM_NUM];     /* their registrations, reference held until release */
+    TC_NS_ClientContext cliContext;                 /* encoded when prepared */
+};
+
+/*
+ * hold the registration of every memref parent, allocated buffers stay mapped
+ * and a released registration is not reused while the operation is prepared
+ */
+static TEEC_Result HoldPreparedShm(struct PreparedOperation *prepared)
+{
+    TEEC_Result ret = TEEC_SUCCESS;
+
+    if (pthread_mutex_lock(&prepared->context->shrMemLock) != 0) {
+        tloge("get share mem lock failed.\n");
+        return (TEEC_Result)TEEC_ERROR_GENERIC;
+    }
+    for (uint32_t i = 0; i < TEEC_PARAM_NUM; i++) {
+        uint32_t paramType = TEEC_PARAM_TYPE_GET(prepared->paramTypes, i);
+        if (!IS_PARTIAL_MEM(paramType) && !IS_SHARED_MEM(paramType)) {
+            continue;
+        }
+        TEEC_SharedMemory *parent = prepared->operation->params[i].memref.parent;
+        if (parent == NULL) {
+            ret = (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+            break;
+        }
+        prepared->parent[i] = parent;
+        prepared->shm[i] = FindShmByBuffer(prepared->context, parent->buffer);
+        if (prepared->shm[i] == NULL) {
+            ret = (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+            break;
+        }
+        AtomInc(&prepared->shm[i]->ops_cnt);
+    }
+    (void)pthread_mutex_unlock(&prepared->context->shrMemLock);
+    return ret;
+}
+
+void TEEC_ReleasePreparedOperation(TEEC_PreparedOperation *prepared)
+{
+    if (prepared == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < TEEC_PARAM_NUM; i++) {
+        PutBnShrMem(prepared->shm[i]);
+    }
+    (void)PutBnContext(prepared->context);
+    free(prepared);
+}
+
+TEEC_Result TEEC_PrepareOperation(TEEC_Session *session, uint32_t commandID, TEEC_Operation *operation,
+    TEEC_PreparedOperation **prepared)
+{
+    TEEC_Result ret;
+    TC_NS_ClientLogin cliLogin = { 0, 0 };
+
+    bool condition = (session == NULL) || (session->context == NULL) || (operation == NULL) || (prepared == NULL);
+    if (condition) {
+        tloge("prepare operation: session or operation is invalid\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    struct PreparedOperation *prep = (struct PreparedOperation *)malloc(sizeof(*prep));
+    if (prep == NULL) {
+        tloge("prepare operation: alloc failed\n");
+        return (TEEC_Result)TEEC_ERROR_OUT_OF_MEMORY;
+    }
+    (void)memset_s(prep, sizeof(*prep), 0, sizeof(*prep));
+    prep->session    = session;
+    prep->operation  = operation;
+    prep->paramTypes = operation->paramTypes;
+    prep->context    = GetBnContext(session->context);
+    if (prep->context == NULL) {
+        ret = (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+        goto ERROR;
+    }
+
+    ret = TEEC_CheckOperation(prep->context, operation);
+    if (ret == TEEC_SUCCESS) {
+        ret = CheckRegisterShm(operation);
+    }
+    if (ret != TEEC_SUCCESS) {
+        tloge("prepare operation: operation is invalid\n");
+        goto ERROR;
+    }
+
+    ret = HoldPreparedShm(prep);
+    if (ret != TEEC_SUCCESS) {
+        tloge("prepare operation: shared memory is not in the context\n");
+        goto ERROR;
+    }
+
+    ret = TEEC_Encode(&prep->cliContext, &session->service_id, session->session_id, commandID, &cliLogin, operation);
+    if (ret != TEEC_SUCCESS) {
+        tloge("prepare operation: encode failed(0x%x)\n", ret);
+        goto ERROR;
+    }
+
+    *prepared = prep;
+    return TEEC_SUCCESS;
+
+ERROR:
+    TEEC_ReleasePreparedOperation(prep);
+    return ret;
+}
+
+/*
+ * Values and ion references are encoded by address, so the driver picks up new
+ * values by itself. Only temp buffers and memref offsets and sizes may have moved
+ * since the operation was prepared and are checked and encoded again.
+ */
+static TEEC_Result PatchPreparedParams(const struct PreparedOperation *prepared, TC_NS_ClientContext *cliContext)
+{
+    TEEC_Operation *operation = prepared->operation;
+
+    for (uint32_t i = 0; i < TEEC_PARAM_NUM; i++) {
+        uint32_t paramType = TEEC_PARAM_TYPE_GET(operation->paramTypes, i);
+        if (IS_TEMP_MEM(paramType)) {
+            if (TEEC_CheckTmpRef(operation->params[i].tmpref) != TEEC_SUCCESS) {
+                return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+            }
+            TEEC_EncodeTempParam(&operation->params[i].tmpref, &cliContext->params[i]);
+        } else if (IS_PARTIAL_MEM(paramType) || IS_SHARED_MEM(paramType)) {
+            TEEC_RegisteredMemoryReference *memref = &operation->params[i].memref;
+            /* only the parent checked when prepared may be used, and only while it is registered */
+            if ((memref->parent != prepared->parent[i]) || (memref->parent->buffer != prepared->shm[i]->buffer) ||
+                (memref->parent->context == NULL)) {
+                tloge("memref parent changed or released since the operation was prepared\n");
+                return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+            }
+            bool partial = (paramType == TEEC_MEMREF_PARTIAL_INPUT) || (paramType == TEEC_MEMREF_PARTIAL_OUTPUT) ||
+                (paramType == TEEC_MEMREF_PARTIAL_INOUT);
+            if (partial && ((memref->offset > memref->parent->size) ||
+                (memref->size > memref->parent->size - memref->offset))) {
+                tloge("offset + size exceed the parent size\n");
+                return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+            }
+            TEEC_EncodePartialParam(paramType, memref, &cliContext->params[i]);
+        }
+    }
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_InvokePrepared(TEEC_PreparedOperation *prepared, uint32_t *returnOrigin)
+{
+    TEEC_Result ret = (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    TC_NS_ClientContext cliContext;
+
+    cliContext.returns.origin = TEEC_ORIGIN_API;
+    if (prepared == NULL) {
+        goto END;
+    }
+    TEEC_Operation *operation = prepared->operation;
+    if ((operation->paramTypes != prepared->paramTypes) || (!operation->started)) {
+        tloge("invoke prepared: operation changed since it was prepared\n");
+        goto END;
+    }
+
+    if (memcpy_s(&cliContext, sizeof(cliContext), &prepared->cliContext, sizeof(prepared->cliContext)) != EOK) {
+        goto END;
+    }
+    ret = PatchPreparedParams(prepared, &cliContext);
+    if (ret != TEEC_SUCCESS) {
+        goto END;
+    }
+    /* as TEEC_Encode, an operation without params keeps started cleared */
+    if (operation->paramTypes != 0) {
+        cliContext.started = operation->cancel_flag;
+    }
+
+    ret = ProcessInvokeCommand(prepared->context, &cliContext);
+    if (ret != TEEC_SUCCESS) {
+        tloge("invoke prepared failed\n");
+    }
+
+END:
+    if (returnOrigin != NULL) {
+        *returnOrigin = cliContext.returns.origin;
+    }
+    return ret;
+}
+
 TEEC_Result TEEC_InvokeCommand(TEEC_Session *session, uint32_t commandID, TEEC_Operation *operation,
                                uint32_t *returnOrigin)
 {
@@ -1260,6 +1947,7 @@ TEEC_Result TEEC_RegisterSharedMemoryHidl(TEEC_ContextHidl *context, TEEC_Shared
     sharedMem->ops_cnt      = 1;
     sharedMem->is_allocated = false;
     sharedMem->offset       = (uint32_t)(-1);
+    sharedMem->pinned       = false;
     sharedMem->context      = context;
     ListInit(&sharedMem->head);
     int lockRet = pthread_mutex_lock(&context->shrMemLock);
@@ -1267,7 +1955,7 @@ TEEC_Result TEEC_RegisterSharedMemoryHidl(TEEC_ContextHidl *context, TEEC_Shared
         tloge("get share mem lock failed.\n");
         return TEEC_ERROR_GENERIC;
     }
-    ListInsertTail(&context->shrd_mem_list, &sharedMem->head);
+    (void)InsertShmLocked(context, sharedMem);
     AtomInc(&sharedMem->ops_cnt);
     (void)pthread_mutex_unlock(&context->shrMemLock);
 
@@ -1300,15 +1988,25 @@ TEEC_Result TEEC_RegisterSharedMemory(TEEC_Context *context, TEEC_SharedMemory *
      */
     sharedMem->context = context;
 
+    contextHidl = GetBnContext(context);
+    if (contextHidl != NULL && sharedMem->buffer != NULL &&
+        TakeCachedRegistration(contextHidl, sharedMem, &shmHidl)) {
+        sharedMem->ops_cnt      = 2; /* same as a fresh registration before its list reference is put */
+        sharedMem->is_allocated = false;
+        ListInit(&sharedMem->head);
+        (void)PutBnContext(contextHidl);
+        return TEEC_SUCCESS;
+    }
+
     ret = MallocShrMemHidl(&shmHidl);
     if (ret != TEEC_SUCCESS) {
+        (void)PutBnContext(contextHidl);
         return ret;
     }
     shmHidl->buffer = sharedMem->buffer;
     shmHidl->size   = sharedMem->size;
     shmHidl->flags  = sharedMem->flags;
 
-    contextHidl = GetBnContext(context);
     ret         = TEEC_RegisterSharedMemoryHidl(contextHidl, shmHidl);
     if (ret == TEEC_SUCCESS) {
         sharedMem->ops_cnt      = shmHidl->ops_cnt;
@@ -1326,22 +2024,34 @@ TEEC_Result TEEC_RegisterSharedMemory(TEEC_Context *context, TEEC_SharedMemory *
 
 static void RelaseBufferAndClearBit(TEEC_ContextHidl *context, TEEC_SharedMemoryHidl *sharedMem)
 {
-    if (sharedMem->buffer != MAP_FAILED && sharedMem->size != 0) {
-        (void)munmap(sharedMem->buffer, sharedMem->size);
+    if (ShmHasOffset(sharedMem)) {
+        if (sharedMem->buffer != MAP_FAILED && sharedMem->buffer != ZERO_SIZE_PTR && sharedMem->size != 0) {
+            (void)munmap(sharedMem->buffer, sharedMem->size);
+        }
+        FreeShmOffset(context, sharedMem->offset);
+    } else {
+        FreeZeroCopyBuffer(sharedMem);
     }
-    ClearBitWithLock(&context->shrMemBitMapLock, sharedMem->offset,
-                     sizeof(context->shm_bitmap), context->shm_bitmap);
+    (void)atomic_fetch_add_explicit(&context->shm_stats.allocFailed, 1, memory_order_relaxed);
     sharedMem->buffer = NULL;
     sharedMem->offset = 0;
 }
 
-static TEEC_Result AllocateSharedMem(TEEC_SharedMemoryHidl *sharedMem)
+static TEEC_Result AllocateSharedMem(TEEC_ContextHidl *context, TEEC_SharedMemoryHidl *sharedMem)
 {
     errno_t rc;
     if (sharedMem == NULL || sharedMem->size == 0 || sharedMem->size > MAX_SHAREDMEM_LEN) {
         return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
     }
 
+    /* pooled buffers come back already cleared as the pool policy requires */
+    struct ShmPool *pool = atomic_load_explicit(&context->shm_pool, memory_order_acquire);
+    sharedMem->buffer = ShmPoolAlloc(pool, sharedMem->size, &sharedMem->pool_class);
+    if (sharedMem->buffer != NULL) {
+        sharedMem->pool = pool;
+        return TEEC_SUCCESS;
+    }
+
     sharedMem->buffer = malloc(sharedMem->size);
     if (sharedMem->buffer == NULL) {
         return (TEEC_Result)TEEC_ERROR_OUT_OF_MEMORY;
@@ -1349,6 +2059,8 @@ static TEEC_Result AllocateSharedMem(TEEC_SharedMemoryHidl *sharedMem)
 
     rc = memset_s(sharedMem->buffer, sharedMem->size, 0, sharedMem->size);
     if (rc != EOK) {
+        free(sharedMem->buffer);
+        sharedMem->buffer = NULL;
         return (TEEC_Result)TEEC_ERROR_SECURITY;
     }
     return TEEC_SUCCESS;
@@ -1374,20 +2086,23 @@ TEEC_Result TEEC_AllocateSharedMemoryHidl(TEEC_ContextHidl *context, TEEC_Shared
 
     /* Paramters all right, start execution */
     sharedMem->buffer = NULL;
+    sharedMem->pool       = NULL;
+    sharedMem->pool_class = SHM_POOL_NO_CLASS;
     bool isZeroCopyMem = (sharedMem->flags == TEEC_MEM_SHARED_INOUT || sharedMem->flags == TEEC_MEM_REGISTER_INOUT);
     if (!isZeroCopyMem) {
-        int32_t validBit = GetAndSetBitWithLock(&context->shrMemBitMapLock, context->shm_bitmap,
-                                                sizeof(context->shm_bitmap));
+        int32_t validBit = AllocShmOffset(context);
         if (validBit < 0) {
             tloge("get valid bit for shm failed\n");
-            return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+            (void)atomic_fetch_add_explicit(&context->shm_stats.allocFailed, 1, memory_order_relaxed);
+            return (TEEC_Result)TEEC_ERROR_OUT_OF_MEMORY;
         }
 
         sharedMem->offset = (uint32_t)validBit;
     }
     if (isZeroCopyMem) {
-        ret = AllocateSharedMem(sharedMem);
+        ret = AllocateSharedMem(context, sharedMem);
         if (ret != TEEC_SUCCESS) {
+            (void)atomic_fetch_add_explicit(&context->shm_stats.allocFailed, 1, memory_order_relaxed);
             return ret;
         }
     } else if (sharedMem->size != 0) {
@@ -1411,7 +2126,11 @@ TEEC_Result TEEC_AllocateSharedMemoryHidl(TEEC_ContextHidl *context, TEEC_Shared
         ret = TEEC_ERROR_GENERIC;
         goto ERROR;
     }
-    ListInsertTail(&context->shrd_mem_list, &sharedMem->head);
+    if (!InsertShmLocked(context, sharedMem)) {
+        (void)pthread_mutex_unlock(&context->shrMemLock);
+        ret = TEEC_ERROR_OUT_OF_MEMORY;
+        goto ERROR;
+    }
     AtomInc(&sharedMem->ops_cnt);
     (void)pthread_mutex_unlock(&context->shrMemLock);
     return TEEC_SUCCESS;
@@ -1466,8 +2185,6 @@ TEEC_Result TEEC_AllocateSharedMemory(TEEC_Context *context, TEEC_SharedMemory *
 
 static bool TEEC_FindAndRemoveShrMemHidl(TEEC_SharedMemoryHidl **sharedMem, TEEC_ContextHidl *contextHidl)
 {
-    bool found                           = false;
-    struct ListNode *ptr                 = NULL;
     TEEC_SharedMemoryHidl *tempSharedMem = NULL;
     TEEC_SharedMemoryHidl *shm           = *sharedMem;
 
@@ -1477,28 +2194,21 @@ static bool TEEC_FindAndRemoveShrMemHidl(TEEC_SharedMemoryHidl **sharedMem, TEEC
         return false;
     }
 
-    LIST_FOR_EACH(ptr, &contextHidl->shrd_mem_list)
-    {
-        tempSharedMem = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, head);
-        if (contextHidl->callFromHidl && shm->is_allocated) {
-            if (tempSharedMem->offset == shm->offset && tempSharedMem->context == shm->context) {
-                found = true;
-                ListRemoveEntry(&tempSharedMem->head);
-                *sharedMem = tempSharedMem;
-                break;
-            }
-        } else {
-            if (tempSharedMem->buffer == shm->buffer && tempSharedMem->context == shm->context) {
-                found = true;
-                ListRemoveEntry(&tempSharedMem->head);
-                *sharedMem = tempSharedMem;
-                break;
-            }
-        }
+    if (contextHidl->callFromHidl && shm->is_allocated && shm->offset < contextHidl->shm_slot_num) {
+        tempSharedMem = contextHidl->shm_slots[shm->offset];
+    }
+    if (tempSharedMem == NULL) {
+        tempSharedMem = FindShmByBuffer(contextHidl, shm->buffer);
+    }
+    if (tempSharedMem == NULL || tempSharedMem->context != shm->context) {
+        (void)pthread_mutex_unlock(&contextHidl->shrMemLock);
+        return false;
     }
 
+    RemoveShmLocked(contextHidl, tempSharedMem);
+    *sharedMem = tempSharedMem;
     (void)pthread_mutex_unlock(&contextHidl->shrMemLock);
-    return found;
+    return true;
 }
 
 /*
@@ -1524,6 +2234,9 @@ void TEEC_ReleaseSharedMemoryHidl(TEEC_SharedMemoryHidl *sharedMem)
         return;
     }
 
+    if (CacheRegistration(shm->context, shm)) {
+        return;
+    }
     PutBnShrMem(shm); /* pair with Initial value 1 */
 }
 
@@ -1553,6 +2266,199 @@ void TEEC_ReleaseSharedMemory(TEEC_SharedMemory *sharedMem)
     sharedMem->context = NULL;
 }
 
+TEEC_Result TEEC_EXT_GetSharedMemStats(TEEC_Context *context, TEEC_SharedMemStats *stats)
+{
+    if ((context == NULL) || (stats == NULL)) {
+        tloge("get shardmem stats: context or stats is NULL\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    TEEC_ContextHidl *contextHidl = GetBnContext(context);
+    if (contextHidl == NULL) {
+        tloge("get shardmem stats: context hidl is NULL\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    const struct ShareMemStats *shmStats = &contextHidl->shm_stats;
+    stats->allocatedBlocks  = atomic_load_explicit(&shmStats->allocated, memory_order_relaxed);
+    stats->registeredBlocks = atomic_load_explicit(&shmStats->registered, memory_order_relaxed);
+    stats->offsetInUse      = atomic_load_explicit(&shmStats->offsetInUse, memory_order_relaxed);
+    stats->offsetPeak       = atomic_load_explicit(&shmStats->offsetPeak, memory_order_relaxed);
+    stats->offsetMax        = MAX_NUM_OF_SHAREMEM_BITMAP * BYTE_BIT;
+    stats->allocTotal       = atomic_load_explicit(&shmStats->allocTotal, memory_order_relaxed);
+    stats->registerTotal    = atomic_load_explicit(&shmStats->registerTotal, memory_order_relaxed);
+    stats->allocFailed      = atomic_load_explicit(&shmStats->allocFailed, memory_order_relaxed);
+    stats->regCacheHits     = atomic_load_explicit(&shmStats->regCacheHits, memory_order_relaxed);
+    stats->regCacheMisses   = atomic_load_explicit(&shmStats->regCacheMisses, memory_order_relaxed);
+    stats->regCacheEvicted  = atomic_load_explicit(&shmStats->regCacheEvicted, memory_order_relaxed);
+    (void)PutBnContext(contextHidl);
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_EXT_EnableSharedMemPool(TEEC_Context *context, const TEEC_SharedMemPoolConfig *config)
+{
+    if ((context == NULL) || (config == NULL)) {
+        tloge("enable shardmem pool: context or config is NULL\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    TEEC_ContextHidl *contextHidl = GetBnContext(context);
+    if (contextHidl == NULL) {
+        tloge("enable shardmem pool: context hidl is NULL\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    TEEC_Result ret = TEEC_SUCCESS;
+    struct ShmPool *pool = ShmPoolCreate(config);
+    struct ShmPool *expected = NULL;
+    if (pool == NULL) {
+        ret = (TEEC_Result)TEEC_ERROR_OUT_OF_MEMORY;
+    } else if (!atomic_compare_exchange_strong(&contextHidl->shm_pool, &expected, pool)) {
+        tloge("enable shardmem pool: pool already enabled\n");
+        ShmPoolDestroy(pool);
+        ret = (TEEC_Result)TEEC_ERROR_BAD_STATE;
+    }
+    (void)PutBnContext(contextHidl);
+    return ret;
+}
+
+TEEC_Result TEEC_EXT_GetSharedMemPoolStats(TEEC_Context *context, TEEC_SharedMemPoolStats *stats)
+{
+    if ((context == NULL) || (stats == NULL)) {
+        tloge("get shardmem pool stats: context or stats is NULL\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    TEEC_ContextHidl *contextHidl = GetBnContext(context);
+    if (contextHidl == NULL) {
+        tloge("get shardmem pool stats: context hidl is NULL\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+    ShmPoolGetStats(atomic_load_explicit(&contextHidl->shm_pool, memory_order_acquire), stats);
+    (void)PutBnContext(contextHidl);
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_EXT_PinSharedMemory(TEEC_Session *session, TEEC_SharedMemory *sharedMem)
+{
+    TEEC_Result ret = (TEEC_Result)TEEC_ERROR_ITEM_NOT_FOUND;
+
+    bool condition = (session == NULL) || (session->context == NULL) || (sharedMem == NULL) ||
+        (sharedMem->context != session->context) || sharedMem->is_allocated;
+    if (condition) {
+        tloge("pin shardmem: session or sharedMem is invalid\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    TEEC_ContextHidl *contextHidl = GetBnContext(session->context);
+    if (contextHidl == NULL || contextHidl->callFromHidl) {
+        (void)PutBnContext(contextHidl);
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+    if (pthread_mutex_lock(&contextHidl->shrMemLock) != 0) {
+        (void)PutBnContext(contextHidl);
+        return (TEEC_Result)TEEC_ERROR_GENERIC;
+    }
+    TEEC_SharedMemoryHidl *shm = FindShmByBuffer(contextHidl, sharedMem->buffer);
+    if (shm != NULL && !shm->is_allocated && shm->size == sharedMem->size) {
+        if (!shm->pinned) {
+            shm->pinned = true;
+            contextHidl->reg_pinned_num++;
+        }
+        shm->pin_session_id = session->session_id;
+        ret = TEEC_SUCCESS;
+    }
+    (void)pthread_mutex_unlock(&contextHidl->shrMemLock);
+    (void)PutBnContext(contextHidl);
+    return ret;
+}
+
+/* caller must hold context->shrMemLock, a released pinned registration waits in the cache */
+static TEEC_Result UnpinCachedRegLocked(TEEC_ContextHidl *context, const TEEC_SharedMemory *sharedMem)
+{
+    struct ListNode *ptr = NULL;
+
+    LIST_FOR_EACH(ptr, RegCacheBucket(context, sharedMem->buffer))
+    {
+        TEEC_SharedMemoryHidl *tmp = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, b_node);
+        bool match = (tmp->buffer == sharedMem->buffer) && (tmp->size == sharedMem->size) &&
+            (tmp->flags == sharedMem->flags) && tmp->pinned;
+        if (match) {
+            /* it turns into an ordinary cached registration and may be evicted now */
+            tmp->pinned = false;
+            context->reg_pinned_num--;
+            context->reg_cache_num++;
+            TrimRegCacheLocked(context);
+            return TEEC_SUCCESS;
+        }
+    }
+    return (TEEC_Result)TEEC_ERROR_ITEM_NOT_FOUND;
+}
+
+TEEC_Result TEEC_EXT_UnpinSharedMemory(TEEC_SharedMemory *sharedMem)
+{
+    TEEC_Result ret = (TEEC_Result)TEEC_ERROR_ITEM_NOT_FOUND;
+
+    if ((sharedMem == NULL) || (sharedMem->context == NULL)) {
+        tloge("unpin shardmem: sharedMem is invalid\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    TEEC_ContextHidl *contextHidl = GetBnContext(sharedMem->context);
+    if (contextHidl == NULL) {
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+    if (pthread_mutex_lock(&contextHidl->shrMemLock) != 0) {
+        (void)PutBnContext(contextHidl);
+        return (TEEC_Result)TEEC_ERROR_GENERIC;
+    }
+    TEEC_SharedMemoryHidl *shm = FindShmByBuffer(contextHidl, sharedMem->buffer);
+    if (shm != NULL && shm->pinned) {
+        shm->pinned = false;
+        contextHidl->reg_pinned_num--;
+        ret = TEEC_SUCCESS;
+    } else if (shm == NULL) {
+        ret = UnpinCachedRegLocked(contextHidl, sharedMem);
+    }
+    (void)pthread_mutex_unlock(&contextHidl->shrMemLock);
+    (void)PutBnContext(contextHidl);
+    return ret;
+}
+
+TEEC_Result TEEC_EXT_InvalidateRegisteredMemory(TEEC_Context *context, const void *buffer, uint32_t size)
+{
+    struct ListNode *ptr = NULL;
+    struct ListNode *n   = NULL;
+
+    if (context == NULL) {
+        tloge("invalidate registered mem: context is NULL\n");
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    TEEC_ContextHidl *contextHidl = GetBnContext(context);
+    if (contextHidl == NULL) {
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+    if (pthread_mutex_lock(&contextHidl->shrMemLock) != 0) {
+        (void)PutBnContext(contextHidl);
+        return (TEEC_Result)TEEC_ERROR_GENERIC;
+    }
+    uintptr_t start = (uintptr_t)buffer;
+    uintptr_t end   = start + size;
+    LIST_FOR_EACH_SAFE(ptr, n, &contextHidl->reg_cache_lru)
+    {
+        TEEC_SharedMemoryHidl *tmp = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, head);
+        uintptr_t tmpStart = (uintptr_t)tmp->buffer;
+        bool overlap = (buffer == NULL) || ((tmpStart < end) && (start < tmpStart + tmp->size));
+        if (overlap) {
+            DropCachedRegLocked(contextHidl, tmp);
+        }
+    }
+    (void)pthread_mutex_unlock(&contextHidl->shrMemLock);
+    (void)PutBnContext(contextHidl);
+    return TEEC_SUCCESS;
+}
+
 static TEEC_Result TEEC_CheckTmpRef(TEEC_TempMemoryReference tmpref)
 {
     if ((tmpref.buffer == NULL) && (tmpref.size != 0)) {
@@ -1571,28 +2477,15 @@ static bool CheckSharedBufferExist(TEEC_ContextHidl *context, const TEEC_Registe
     if (context == NULL) {
         return false;
     }
- 
-    struct ListNode *ptr = NULL;
-    TEEC_SharedMemoryHidl *tempSharedMem = NULL;
-    TEEC_SharedMemory *shm = sharedMem->parent;
- 
+
     int lockRet = pthread_mutex_lock(&context->shrMemLock);
     if (lockRet != 0) {
         tloge("get share mem lock failed\n");
         return false;
     }
- 
-    LIST_FOR_EACH(ptr, &context->shrd_mem_list)
-    {
-        tempSharedMem = CONTAINER_OF(ptr, TEEC_SharedMemoryHidl, head);
-        if (tempSharedMem->buffer == shm->buffer) {
-            (void)pthread_mutex_unlock(&context->shrMemLock);
-            return true;
-        }
-    }
- 
+    bool exist = (FindShmByBuffer(context, sharedMem->parent->buffer) != NULL);
     (void)pthread_mutex_unlock(&context->shrMemLock);
-    return false;
+    return exist;
 }
 
 static TEEC_Result TEEC_CheckMemRef(TEEC_ContextHidl *context, TEEC_RegisteredMemoryReference memref, uint32_t paramType)
@@ -18,6 +18,8 @@
 #include <sys/types.h> /* for open close */
 #include <fcntl.h>
 #include <sys/mman.h>  /* for mmap */
+#include <sys/stat.h>
+#include <pthread.h>
 #include <linux/limits.h>
 #include "tee_log.h"
 #include "tee_client_api.h"
@@ -34,6 +36,30 @@
 
 #define H_OFFSET 32
 #define MAX_PATH_LEN 256
+#define TA_IMAGE_CACHE_MAX 16 /* images kept mapped when no open session uses them */
+
+/*
+ * Images read from a path are mapped read-only and shared by every open of the
+ * same file. An entry is found by realpath and only reused while the device,
+ * inode, size and mtime of the file are unchanged, otherwise it is dropped and
+ * unmapped once the last open using it is done.
+ */
+struct TaImageCacheEntry {
+    struct ListNode node;        /* in g_taImageCache, most recently used first */
+    char path[PATH_MAX + 1];
+    dev_t dev;
+    ino_t ino;
+    off_t fileSize;
+    struct timespec mtime;
+    void *image;
+    uint32_t imageLen;
+    uint32_t refCnt;             /* opens currently using the image */
+};
+
+static pthread_mutex_t g_taImageCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static LIST_DECLARE(g_taImageCache);
+static LIST_DECLARE(g_taImageStale); /* dropped from the cache but still used by an open */
+static uint32_t g_taImageCacheNum;
 
 static int32_t TEEC_ReadApp(const TaFileInfo *taFile, const char *loadFile, bool defaultPath,
                             TC_NS_ClientContext *cliContext);
@@ -182,6 +208,180 @@ CHECK_LENTH:
     return 0;
 }
 
+static void SetAppBuffer(TC_NS_ClientContext *cliContext, const void *fileBuffer, uint32_t imgLen)
+{
+    cliContext->file_size          = imgLen;
+    cliContext->memref.file_addr   = (uint32_t)(uintptr_t)fileBuffer;
+    cliContext->memref.file_h_addr = (uint32_t)(((uint64_t)(uintptr_t)fileBuffer) >> H_OFFSET);
+}
+
+static void FreeTaImage(struct TaImageCacheEntry *entry)
+{
+    (void)munmap(entry->image, entry->imageLen);
+    free(entry);
+}
+
+static bool TaImageMatch(const struct TaImageCacheEntry *entry, const struct stat *st)
+{
+    return (entry->dev == st->st_dev) && (entry->ino == st->st_ino) && (entry->fileSize == st->st_size) &&
+        (entry->mtime.tv_sec == st->st_mtim.tv_sec) && (entry->mtime.tv_nsec == st->st_mtim.tv_nsec);
+}
+
+/* caller must hold g_taImageCacheLock */
+static void DropTaImageLocked(struct TaImageCacheEntry *entry)
+{
+    ListRemoveEntry(&entry->node);
+    g_taImageCacheNum--;
+    if (entry->refCnt == 0) {
+        FreeTaImage(entry);
+    } else {
+        ListInsertTail(&g_taImageStale, &entry->node);
+    }
+}
+
+static struct TaImageCacheEntry *TakeCachedTaImage(const char *realPath, const struct stat *st)
+{
+    struct ListNode *ptr = NULL;
+    struct TaImageCacheEntry *found = NULL;
+
+    (void)pthread_mutex_lock(&g_taImageCacheLock);
+    LIST_FOR_EACH(ptr, &g_taImageCache) {
+        struct TaImageCacheEntry *entry = CONTAINER_OF(ptr, struct TaImageCacheEntry, node);
+        if (strcmp(entry->path, realPath) != 0) {
+            continue;
+        }
+        if (TaImageMatch(entry, st)) {
+            found = entry;
+            found->refCnt++;
+            ListRemoveEntry(&found->node);
+            ListInsertHead(&g_taImageCache, &found->node);
+        } else {
+            tlogd("ta image %s changed, drop the cached one\n", realPath);
+            DropTaImageLocked(entry);
+        }
+        break;
+    }
+    (void)pthread_mutex_unlock(&g_taImageCacheLock);
+    return found;
+}
+
+static void InsertTaImage(struct TaImageCacheEntry *entry)
+{
+    struct ListNode *ptr = NULL;
+    struct ListNode *n   = NULL;
+
+    (void)pthread_mutex_lock(&g_taImageCacheLock);
+    ListInsertHead(&g_taImageCache, &entry->node);
+    g_taImageCacheNum++;
+    /* evict the least recently used images nobody is loading right now */
+    for (ptr = LIST_TAIL(&g_taImageCache), n = ptr->prev;
+         ptr != &g_taImageCache && g_taImageCacheNum > TA_IMAGE_CACHE_MAX; ptr = n, n = ptr->prev) {
+        struct TaImageCacheEntry *tmp = CONTAINER_OF(ptr, struct TaImageCacheEntry, node);
+        if (tmp->refCnt == 0) {
+            DropTaImageLocked(tmp);
+        }
+    }
+    (void)pthread_mutex_unlock(&g_taImageCacheLock);
+}
+
+static struct TaImageCacheEntry *MapTaImage(FILE *fp, const char *realPath, const struct stat *st)
+{
+    uint32_t imgLen = 0;
+
+    if (TEEC_GetImageLenth(fp, &imgLen) != 0 || imgLen == 0 || (off_t)imgLen > st->st_size) {
+        tloge("get image length fail\n");
+        return NULL;
+    }
+
+    struct TaImageCacheEntry *entry = (struct TaImageCacheEntry *)malloc(sizeof(*entry));
+    if (entry == NULL) {
+        tloge("alloc ta image cache entry failed\n");
+        return NULL;
+    }
+    (void)memset_s(entry, sizeof(*entry), 0, sizeof(*entry));
+    if (strcpy_s(entry->path, sizeof(entry->path), realPath) != EOK) {
+        free(entry);
+        return NULL;
+    }
+    entry->image = mmap(NULL, imgLen, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fileno(fp), 0);
+    if (entry->image == MAP_FAILED) {
+        tloge("map TA file(size=%u) failed, errno=%d\n", imgLen, errno);
+        free(entry);
+        return NULL;
+    }
+    entry->dev      = st->st_dev;
+    entry->ino      = st->st_ino;
+    entry->fileSize = st->st_size;
+    entry->mtime    = st->st_mtim;
+    entry->imageLen = imgLen;
+    entry->refCnt   = 1;
+    return entry;
+}
+
+static int32_t TEEC_GetCachedApp(FILE *fp, const char *realPath, TC_NS_ClientContext *cliContext)
+{
+    struct stat st;
+
+    if (fstat(fileno(fp), &st) != 0) {
+        tloge("stat TA file failed, errno=%d\n", errno);
+        return -1;
+    }
+
+    struct TaImageCacheEntry *entry = TakeCachedTaImage(realPath, &st);
+    if (entry == NULL) {
+        entry = MapTaImage(fp, realPath, &st);
+        if (entry == NULL) {
+            return -1;
+        }
+        InsertTaImage(entry);
+    }
+    SetAppBuffer(cliContext, entry->image, entry->imageLen);
+    return 0;
+}
+
+void TEEC_ReleaseApp(TC_NS_ClientContext *cliContext)
+{
+    struct ListNode *ptr = NULL;
+    struct TaImageCacheEntry *found = NULL;
+
+    void *fileBuffer = (void *)(uintptr_t)(cliContext->memref.file_addr |
+        (((uint64_t)cliContext->memref.file_h_addr) << H_OFFSET));
+    if (fileBuffer == NULL) {
+        return;
+    }
+    cliContext->memref.file_addr   = 0;
+    cliContext->memref.file_h_addr = 0;
+
+    (void)pthread_mutex_lock(&g_taImageCacheLock);
+    LIST_FOR_EACH(ptr, &g_taImageCache) {
+        struct TaImageCacheEntry *entry = CONTAINER_OF(ptr, struct TaImageCacheEntry, node);
+        if (entry->image == fileBuffer) {
+            found = entry;
+            found->refCnt--;
+            break;
+        }
+    }
+    if (found == NULL) {
+        LIST_FOR_EACH(ptr, &g_taImageStale) {
+            struct TaImageCacheEntry *entry = CONTAINER_OF(ptr, struct TaImageCacheEntry, node);
+            if (entry->image == fileBuffer) {
+                found = entry;
+                if (--found->refCnt == 0) {
+                    ListRemoveEntry(&found->node);
+                    FreeTaImage(found);
+                }
+                break;
+            }
+        }
+    }
+    (void)pthread_mutex_unlock(&g_taImageCacheLock);
+
+    /* images read through a caller supplied fp are not cached */
+    if (found == NULL) {
+        free(fileBuffer);
+    }
+}
+
 static int32_t TEEC_DoReadApp(FILE *fp, TC_NS_ClientContext *cliContext)
 {
     uint32_t totalImgLen = 0;
@@ -207,9 +407,7 @@ static int32_t TEEC_DoReadApp(FILE *fp, TC_NS_ClientContext *cliContext)
         free(fileBuffer);
         return -1;
     }
-    cliContext->file_size   = totalImgLen;
-    cliContext->memref.file_addr = (uint32_t)(uintptr_t)fileBuffer;
-    cliContext->memref.file_h_addr = (uint32_t)(((uint64_t)(uintptr_t)fileBuffer) >> H_OFFSET);
+    SetAppBuffer(cliContext, fileBuffer, totalImgLen);
     return 0;
 }
 
@@ -229,13 +427,16 @@ static int32_t TEEC_ReadApp(const TaFileInfo *taFile, const char *loadFile, bool
 {
     int32_t ret                     = 0;
     FILE *fp                        = NULL;
-    FILE *fpTmp                     = NULL;
     char realLoadFile[PATH_MAX + 1] = { 0 };
 
+    /* a caller supplied fp may not be a regular file, read it as before */
     if (taFile->taFp != NULL) {
-        fp = taFile->taFp;
         tlogd("libteec_vendor-read_app: get fp from ta fp\n");
-        goto READ_APP;
+        ret = TEEC_DoReadApp(taFile->taFp, cliContext);
+        if (ret != 0) {
+            tloge("do read app fail\n");
+        }
+        return ret;
     }
 
     if (realpath(loadFile, realLoadFile) == NULL) {
@@ -254,23 +455,17 @@ static int32_t TEEC_ReadApp(const TaFileInfo *taFile, const char *loadFile, bool
     }
 
     /* open image file */
-    fpTmp = fopen(realLoadFile, "r");
-    if (fpTmp == NULL) {
+    fp = fopen(realLoadFile, "r");
+    if (fp == NULL) {
         tloge("open file error%d\n", errno);
         return -1;
     }
-    fp = fpTmp;
 
-READ_APP:
-    ret = TEEC_DoReadApp(fp, cliContext);
+    ret = TEEC_GetCachedApp(fp, realLoadFile, cliContext);
     if (ret != 0) {
-        tloge("do read app fail\n");
-    }
-
-    if (fpTmp != NULL) {
-        fclose(fpTmp);
+        tloge("get cached app fail\n");
     }
-
+    fclose(fp);
     return ret;
 }
 
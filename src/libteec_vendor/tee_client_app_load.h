@@ -73,6 +73,8 @@ typedef struct {
 } TeecTaHead;
 
 int32_t TEEC_GetApp(const TaFileInfo *taFile, const TEEC_UUID *srvUuid, TC_NS_ClientContext *cliContext);
+/* release the image TEEC_GetApp put into cliContext */
+void TEEC_ReleaseApp(TC_NS_ClientContext *cliContext);
 int32_t TEEC_LoadSecfile(const char *filePath, int tzFd, FILE *fp);
 
 #endif
@@ -11,6 +11,8 @@
  */
 
 #include "tee_client_api.h"
+#include "tee_client_ext_api.h"
+#include "tee_client_socket.h"
 #include "tee_log.h"
 
 #ifdef LOG_TAG
@@ -35,3 +37,13 @@ TEEC_Result TEEC_EXT_ProcEncRoT(const TEEC_Session *session, uint32_t authType,
     tlogi("TEEC_EXT_ProcEncRoT is not support on this platform\n");
     return TEEC_ERROR_NOT_SUPPORTED;
 }
+
+/*
+ * Function:     TEEC_GetTEEVersion
+ * Description:  get the TEE version from teecd, it is asked for once per process
+ * Return:       version of TEE, 0 if teecd cannot be reached
+ */
+uint32_t TEEC_GetTEEVersion(void)
+{
+    return CaDaemonGetTeeVersion();
+}
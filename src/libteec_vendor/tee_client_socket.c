@@ -17,7 +17,14 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <securec.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <poll.h>
 #include <time.h>
+#include <unistd.h>
+#ifdef CONFIG_PATH_NAMED_SOCKET
+#include <sys/inotify.h>
+#endif
 #include "tee_log.h"
 #include "tc_ns_client.h"
 #include "tee_client_version.h"
@@ -232,43 +239,84 @@ static void InitSockMsg(struct msghdr *message, CaRevMsg *revMsg, struct iovec *
     (message->msg_iov[0]).iov_len  = sizeof(*revMsg);
 }
 
-static void SleepNs(long num)
+#ifdef CONFIG_PATH_NAMED_SOCKET
+/* wake up early when teecd creates or chmods its socket file, the caller still retries connect */
+static void WaitSocketPathEvent(int waitMs)
+{
+    char dir[sizeof(TC_NS_SOCKET_NAME)] = TC_NS_SOCKET_NAME;
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL || slash == dir) {
+        (void)poll(NULL, 0, waitMs);
+        return;
+    }
+    *slash = '\0';
+
+    int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd < 0 || inotify_add_watch(fd, dir, IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0 ||
+        access(TC_NS_SOCKET_NAME, F_OK) == 0) {
+        /* the socket exists but nobody listens yet, or the directory is missing */
+        (void)poll(NULL, 0, waitMs);
+    } else {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        (void)poll(&pfd, 1, waitMs);
+    }
+    if (fd >= 0) {
+        (void)close(fd);
+    }
+}
+#else
+/* an abstract socket has no path to watch */
+static void WaitSocketPathEvent(int waitMs)
+{
+    (void)poll(NULL, 0, waitMs);
+}
+#endif
+
+static int64_t GetMonotonicMs(void)
+{
+    struct timespec ts = { 0 };
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000; /* 1000: ms per s, 1000000: ns per ms */
+}
+
+/*
+ * Wait for teecd to listen when the app starts before the daemon. The wait
+ * starts at 1 ms and doubles up to 200 ms, the total stays within the
+ * 10 s the fixed 200 ms x 50 retries used to allow. A wait may end early on
+ * an unrelated event in the socket directory, so the budget is kept against
+ * the clock rather than by adding up the waits.
+ */
+#define CONNECT_WAIT_MIN_MS   1
+#define CONNECT_WAIT_MAX_MS   200
+#define CONNECT_WAIT_TOTAL_MS (200 * 50)
+static int ConnectTeecdWithRetry(int *socketFd)
 {
-    struct timespec ts;
-    ts.tv_sec  = 0;
-    ts.tv_nsec = num;
+    int waitMs = CONNECT_WAIT_MIN_MS;
+    int64_t start = GetMonotonicMs();
+    int64_t leftMs = CONNECT_WAIT_TOTAL_MS;
+    int cRet;
 
-    if (nanosleep(&ts, NULL) != 0) {
-        tlogd("nanosleep ms error\n");
+    while ((cRet = ConnectTeecdSocket(socketFd)) == -1 && leftMs > 0) {
+        tlogd("open device failed, retry!\n");
+        WaitSocketPathEvent((waitMs < leftMs) ? waitMs : (int)leftMs);
+        leftMs = CONNECT_WAIT_TOTAL_MS - (GetMonotonicMs() - start);
+        waitMs = (waitMs * 2 > CONNECT_WAIT_MAX_MS) ? CONNECT_WAIT_MAX_MS : waitMs * 2;
+    }
+    if (cRet < 0) {
+        tloge("try connect ca daemon failed, waited %lld ms\n", (long long)(GetMonotonicMs() - start));
     }
+    return cRet;
 }
 
-/* sleep 200 ms, and 50 times */
-#define SLEEP_TIME (200 * 1000 * 1000)
-#define SLEEP_COUNT 50
-static int CaDaemonConnect(const CaAuthInfo *caInfo, int cmd, const TEEC_XmlParameter *halXmlPtr)
+/* connect to teecd and send the request, returns the socket to read the answer from */
+static int CaDaemonRequest(const CaAuthInfo *caInfo, int cmd, uint32_t fdCount, const TEEC_XmlParameter *halXmlPtr)
 {
     int s = -1;
-    int32_t failCount = 0; /* allow fail 50 times */
-    int32_t cRet;
     struct msghdr message;
     struct iovec iov[1];
     CaRevMsg *revMsg = NULL;
-    int32_t msgRet = -1;
 
-    /* add retry to avoid app start before daemon */
-    while (failCount++ < SLEEP_COUNT) {
-        cRet = ConnectTeecdSocket(&s);
-        if (cRet != -1) {
-            break;
-        }
-
-        tlogd("open device failed, retry!\n");
-        SleepNs(SLEEP_TIME);
-    }
-
-    if (cRet < 0) {
-        tloge("try connect ca daemon failed, fail_counts = %d\n", failCount);
+    if (ConnectTeecdWithRetry(&s) < 0) {
         return -1;
     }
 
@@ -283,6 +331,9 @@ static int CaDaemonConnect(const CaAuthInfo *caInfo, int cmd, const TEEC_XmlPara
         close(s);
         return -1;
     }
+    if (cmd == GET_FDS) {
+        revMsg->xmlBufSize = fdCount;
+    }
 
     /* For the dummy data */
     InitSockMsg(&message, revMsg, iov);
@@ -292,21 +343,170 @@ static int CaDaemonConnect(const CaAuthInfo *caInfo, int cmd, const TEEC_XmlPara
         free(revMsg);
         return SEND_MESS_ERR;
     }
+    free(revMsg);
+    return s;
+}
 
-    msgRet = RecvSockMsg(cmd, s);
+static int CaDaemonConnect(const CaAuthInfo *caInfo, int cmd, const TEEC_XmlParameter *halXmlPtr)
+{
+    int s = CaDaemonRequest(caInfo, cmd, 0, halXmlPtr);
+    if (s < 0) {
+        return s;
+    }
 
+    int msgRet = RecvSockMsg(cmd, s);
     close(s);
-    free(revMsg);
     return msgRet;
 }
 
-int CaDaemonConnectWithCaInfo(const CaAuthInfo *caInfo, int cmd, const TEEC_XmlParameter *halXmlPtr)
+/* receive the fds of a GET_FDS request, a teecd that does not know GET_FDS sends a single one */
+static int RecvSockFds(int socketFd, int *fds, uint32_t maxCount)
 {
-    if (caInfo == NULL) {
-        tloge("ca daemon: ca auth info is NULL\n");
+    struct msghdr hmsg;
+    struct iovec iov[IOV_LEN];
+    char ctrlBuf[CMSG_SPACE(sizeof(int) * CA_DAEMON_FD_BATCH_MAX)];
+    RecvTeecdMsg data = { 0 };
+    int count = 0;
+
+    if (memset_s(&hmsg, sizeof(hmsg), 0, sizeof(hmsg)) != EOK ||
+        memset_s(ctrlBuf, sizeof(ctrlBuf), 0, sizeof(ctrlBuf)) != EOK) {
+        return -1;
+    }
+    iov[0].iov_base = &data;
+    iov[0].iov_len  = sizeof(data);
+    if (InitRecvMsg(&hmsg, iov, IOV_LEN, ctrlBuf, sizeof(ctrlBuf)) != EOK) {
+        return -1;
+    }
+
+    if (recvmsg(socketFd, &hmsg, MSG_CMSG_CLOEXEC) <= 0) {
+        return -1;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hmsg); cmsg != NULL; cmsg = CMSG_NXTHDR(&hmsg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        uint32_t n = (uint32_t)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        const int *passedFds = (const int *)(uintptr_t)CMSG_DATA(cmsg);
+        for (uint32_t i = 0; i < n; i++) {
+            if ((uint32_t)count < maxCount) {
+                fds[count++] = passedFds[i];
+            } else {
+                (void)close(passedFds[i]);
+            }
+        }
+    }
+    return count;
+}
+
+/*
+ * Logged in fds fetched in one round trip and kept for the next contexts of
+ * this process. teecd logs them in with the credentials of the process when
+ * it asked for them, so they are only handed out while the pid and the ids
+ * are still the same: a forked child or a process that changed its uid or
+ * gid drops the ones it holds.
+ */
+#define PRE_AUTH_FD_BATCH 4
+struct PreAuthOwner {
+    pid_t pid;
+    uid_t uid;
+    uid_t euid;
+    gid_t gid;
+    gid_t egid;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct PreAuthOwner owner;
+    uint32_t count;
+    int fds[CA_DAEMON_FD_BATCH_MAX];
+} g_preAuthFds = { .lock = PTHREAD_MUTEX_INITIALIZER, .owner = { 0 }, .count = 0 };
+
+static void GetPreAuthOwner(struct PreAuthOwner *owner)
+{
+    owner->pid = getpid();
+    owner->uid = getuid();
+    owner->euid = geteuid();
+    owner->gid = getgid();
+    owner->egid = getegid();
+}
+
+static bool IsSamePreAuthOwner(const struct PreAuthOwner *a, const struct PreAuthOwner *b)
+{
+    return a->pid == b->pid && a->uid == b->uid && a->euid == b->euid && a->gid == b->gid && a->egid == b->egid;
+}
+
+/* called with g_preAuthFds.lock held, drops the fds logged in for another pid or ids */
+static void DropStaleFdsLocked(const struct PreAuthOwner *owner)
+{
+    if (IsSamePreAuthOwner(&g_preAuthFds.owner, owner)) {
+        return;
+    }
+    for (uint32_t i = 0; i < g_preAuthFds.count; i++) {
+        (void)close(g_preAuthFds.fds[i]);
+    }
+    g_preAuthFds.count = 0;
+    g_preAuthFds.owner = *owner;
+}
+
+static void CloseFds(const int *fds, int count)
+{
+    for (int i = 0; i < count; i++) {
+        (void)close(fds[i]);
+    }
+}
+
+static int CaDaemonGetPreAuthFd(const CaAuthInfo *caInfo)
+{
+    int fds[CA_DAEMON_FD_BATCH_MAX];
+    struct PreAuthOwner owner;
+    struct PreAuthOwner now;
+    int fd = -1;
+
+    GetPreAuthOwner(&owner);
+    (void)pthread_mutex_lock(&g_preAuthFds.lock);
+    DropStaleFdsLocked(&owner);
+    if (g_preAuthFds.count > 0) {
+        fd = g_preAuthFds.fds[--g_preAuthFds.count];
+    }
+    (void)pthread_mutex_unlock(&g_preAuthFds.lock);
+    if (fd >= 0) {
+        return fd;
+    }
+
+    int s = CaDaemonRequest(caInfo, GET_FDS, PRE_AUTH_FD_BATCH, NULL);
+    if (s < 0) {
+        return s;
+    }
+    int count = RecvSockFds(s, fds, PRE_AUTH_FD_BATCH);
+    close(s);
+    if (count <= 0) {
+        return -1;
+    }
+
+    /* the ids changed while teecd logged the batch in, none of it is ours */
+    GetPreAuthOwner(&now);
+    if (!IsSamePreAuthOwner(&owner, &now)) {
+        tloge("process credentials changed during the pre-auth request\n");
+        CloseFds(fds, count);
         return -1;
     }
 
+    (void)pthread_mutex_lock(&g_preAuthFds.lock);
+    DropStaleFdsLocked(&owner);
+    for (int i = 1; i < count; i++) {
+        if (g_preAuthFds.count < CA_DAEMON_FD_BATCH_MAX) {
+            g_preAuthFds.fds[g_preAuthFds.count++] = fds[i];
+        } else {
+            (void)close(fds[i]);
+        }
+    }
+    (void)pthread_mutex_unlock(&g_preAuthFds.lock);
+    tlogd("got %d pre-auth fds from teecd\n", count);
+    return fds[0];
+}
+
+static int CheckTeecdVersionOnce(const CaAuthInfo *caInfo, const TEEC_XmlParameter *halXmlPtr)
+{
     if (g_firstConnectTeecd) {
         if (CaDaemonConnect(caInfo, GET_TEECD_VERSION, halXmlPtr) != 0) {
             tloge("get teecd version failed\n");
@@ -319,6 +519,19 @@ int CaDaemonConnectWithCaInfo(const CaAuthInfo *caInfo, int cmd, const TEEC_XmlP
         tloge("check teecd version failed\n");
         return -1;
     }
+    return 0;
+}
+
+int CaDaemonConnectWithCaInfo(const CaAuthInfo *caInfo, int cmd, const TEEC_XmlParameter *halXmlPtr)
+{
+    if (caInfo == NULL) {
+        tloge("ca daemon: ca auth info is NULL\n");
+        return -1;
+    }
+
+    if (CheckTeecdVersionOnce(caInfo, halXmlPtr) != 0) {
+        return -1;
+    }
 
     int fd = CaDaemonConnect(caInfo, cmd, halXmlPtr);
     if (cmd == GET_FD && fd >= 0) {
@@ -326,3 +539,44 @@ int CaDaemonConnectWithCaInfo(const CaAuthInfo *caInfo, int cmd, const TEEC_XmlP
     }
     return fd;
 }
+
+int CaDaemonConnectPreAuth(const CaAuthInfo *caInfo)
+{
+    if (caInfo == NULL) {
+        tloge("ca daemon: ca auth info is NULL\n");
+        return -1;
+    }
+
+    if (CheckTeecdVersionOnce(caInfo, NULL) != 0) {
+        return -1;
+    }
+
+    int fd = CaDaemonGetPreAuthFd(caInfo);
+    if (fd >= 0) {
+        tlogd("Fd received!\n");
+    }
+    return fd;
+}
+
+/* the TEE version does not change while teecd runs, ask for it once */
+uint32_t CaDaemonGetTeeVersion(void)
+{
+    static volatile atomic_uint teeVersion;
+    CaAuthInfo caInfo;
+
+    uint32_t version = atomic_load_explicit(&teeVersion, memory_order_relaxed);
+    if (version != 0) {
+        return version;
+    }
+    if (memset_s(&caInfo, sizeof(caInfo), 0, sizeof(caInfo)) != EOK) {
+        return 0;
+    }
+    caInfo.fromHidlSide = NON_HIDL_SIDE;
+    int ret = CaDaemonConnectWithCaInfo(&caInfo, GET_TEEVERSION, NULL);
+    if (ret <= 0) {
+        tloge("get tee version from teecd failed\n");
+        return 0;
+    }
+    atomic_store_explicit(&teeVersion, (uint32_t)ret, memory_order_relaxed);
+    return (uint32_t)ret;
+}
@@ -22,5 +22,11 @@
 #endif
 
 int CaDaemonConnectWithCaInfo(const CaAuthInfo *caInfo, int cmd, const TEEC_XmlParameter *halXmlPtr);
+/*
+ * like GET_FD, but served from a per-process pool of fds fetched in batches, only for callers without ca info;
+ * the fds are logged in as the pid, uid/euid and gid/egid of the request and dropped once any of them changes
+ */
+int CaDaemonConnectPreAuth(const CaAuthInfo *caInfo);
+uint32_t CaDaemonGetTeeVersion(void);
 
 #endif
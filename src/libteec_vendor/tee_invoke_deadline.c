@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <securec.h>
+
+#include "tee_client_api.h"
+#include "tee_client_ext_api.h"
+#include "tee_client_list.h"
+#include "tee_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "libteec_vendor"
+
+#define MS_PER_SEC  1000
+#define NS_PER_MS   1000000
+#define NS_PER_SEC  1000000000
+
+struct InvokeDeadline {
+    struct ListNode node;       /* in g_deadlineList, sorted by expire */
+    struct timespec expire;     /* CLOCK_MONOTONIC */
+    TEEC_Operation *operation;
+    bool fired;
+    bool cancelling;            /* the timer thread is requesting the cancellation */
+    pthread_cond_t cancelDone;  /* signaled when cancelling is cleared */
+};
+
+/*
+ * One timer thread serves every outstanding deadline. An expired deadline is
+ * unlinked and marked cancelling under g_deadlineLock, the cancellation itself
+ * is requested without the lock so that it does not hold up other callers.
+ * A caller removing its deadline waits for its own cancellation to finish, so
+ * it never returns while the operation on its stack is still being used.
+ */
+static pthread_once_t g_deadlineOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_deadlineLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_deadlineCond;
+static LIST_DECLARE(g_deadlineList);
+static bool g_deadlineReady;
+static TEEC_InvokeDeadlineStats g_deadlineStats; /* protected by g_deadlineLock */
+
+static bool TimespecBefore(const struct timespec *a, const struct timespec *b)
+{
+    return (a->tv_sec < b->tv_sec) || ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+}
+
+static void *DeadlineTimerThread(void *arg)
+{
+    (void)arg;
+    struct timespec now;
+
+    (void)pthread_mutex_lock(&g_deadlineLock);
+    for (;;) {
+        if (LIST_EMPTY(&g_deadlineList)) {
+            (void)pthread_cond_wait(&g_deadlineCond, &g_deadlineLock);
+            continue;
+        }
+        struct InvokeDeadline *first = CONTAINER_OF(LIST_HEAD(&g_deadlineList), struct InvokeDeadline, node);
+        (void)clock_gettime(CLOCK_MONOTONIC, &now);
+        if (TimespecBefore(&now, &first->expire)) {
+            (void)pthread_cond_timedwait(&g_deadlineCond, &g_deadlineLock, &first->expire);
+            continue;
+        }
+
+        ListRemoveEntry(&first->node);
+        ListInit(&first->node);
+        first->fired = true;
+        first->cancelling = true;
+        g_deadlineStats.fired++;
+        g_deadlineStats.pending--;
+        (void)pthread_mutex_unlock(&g_deadlineLock);
+
+        tlogd("invoke deadline expired, request cancellation\n");
+        TEEC_RequestCancellation(first->operation);
+
+        (void)pthread_mutex_lock(&g_deadlineLock);
+        first->cancelling = false;
+        /* the owner may return as soon as the lock is dropped, first is not touched after this */
+        (void)pthread_cond_signal(&first->cancelDone);
+    }
+    return NULL;
+}
+
+static void InitDeadlineTimer(void)
+{
+    pthread_condattr_t condAttr;
+    pthread_attr_t attr;
+    pthread_t tid;
+
+    (void)pthread_condattr_init(&condAttr);
+    (void)pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    (void)pthread_cond_init(&g_deadlineCond, &condAttr);
+    (void)pthread_condattr_destroy(&condAttr);
+
+    (void)pthread_attr_init(&attr);
+    (void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(&tid, &attr, DeadlineTimerThread, NULL);
+    (void)pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        tloge("create invoke deadline timer failed, ret=%d\n", ret);
+        return;
+    }
+    g_deadlineReady = true;
+}
+
+static bool ArmDeadline(struct InvokeDeadline *deadline, uint32_t timeoutMs)
+{
+    struct ListNode *ptr = NULL;
+
+    (void)pthread_once(&g_deadlineOnce, InitDeadlineTimer);
+    if (!g_deadlineReady) {
+        return false;
+    }
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &deadline->expire);
+    deadline->expire.tv_sec += timeoutMs / MS_PER_SEC;
+    deadline->expire.tv_nsec += (long)(timeoutMs % MS_PER_SEC) * NS_PER_MS;
+    if (deadline->expire.tv_nsec >= NS_PER_SEC) {
+        deadline->expire.tv_sec++;
+        deadline->expire.tv_nsec -= NS_PER_SEC;
+    }
+
+    (void)pthread_mutex_lock(&g_deadlineLock);
+    LIST_FOR_EACH(ptr, &g_deadlineList) {
+        struct InvokeDeadline *tmp = CONTAINER_OF(ptr, struct InvokeDeadline, node);
+        if (TimespecBefore(&deadline->expire, &tmp->expire)) {
+            break;
+        }
+    }
+    /* insert before ptr, which is the list head when deadline expires last */
+    ListInsertTail(ptr, &deadline->node);
+    g_deadlineStats.armed++;
+    g_deadlineStats.pending++;
+    if (LIST_HEAD(&g_deadlineList) == &deadline->node) {
+        (void)pthread_cond_signal(&g_deadlineCond);
+    }
+    (void)pthread_mutex_unlock(&g_deadlineLock);
+    return true;
+}
+
+static bool DisarmDeadline(struct InvokeDeadline *deadline, TEEC_Result ret)
+{
+    (void)pthread_mutex_lock(&g_deadlineLock);
+    if (!deadline->fired) {
+        ListRemoveEntry(&deadline->node);
+        g_deadlineStats.pending--;
+    }
+    while (deadline->cancelling) {
+        (void)pthread_cond_wait(&deadline->cancelDone, &g_deadlineLock);
+    }
+    bool timedOut = deadline->fired && (ret != TEEC_SUCCESS);
+    if (timedOut) {
+        g_deadlineStats.timedOut++;
+    }
+    (void)pthread_mutex_unlock(&g_deadlineLock);
+    return timedOut;
+}
+
+TEEC_Result TEEC_InvokeCommandWithDeadline(TEEC_Session *session, uint32_t commandID, TEEC_Operation *operation,
+    uint32_t timeoutMs, uint32_t *returnOrigin)
+{
+    TEEC_Operation emptyOperation;
+    struct InvokeDeadline deadline;
+
+    if (timeoutMs == 0 || session == NULL) {
+        return TEEC_InvokeCommand(session, commandID, operation, returnOrigin);
+    }
+
+    if (operation == NULL) {
+        /* cancellation needs an operation to find the session */
+        (void)memset_s(&emptyOperation, sizeof(emptyOperation), 0, sizeof(emptyOperation));
+        emptyOperation.started = 1;
+        operation = &emptyOperation;
+    }
+    operation->session = session;
+
+    (void)memset_s(&deadline, sizeof(deadline), 0, sizeof(deadline));
+    deadline.operation = operation;
+    (void)pthread_cond_init(&deadline.cancelDone, NULL);
+    if (!ArmDeadline(&deadline, timeoutMs)) {
+        tloge("invoke deadline timer is not available, invoke without deadline\n");
+        (void)pthread_cond_destroy(&deadline.cancelDone);
+        return TEEC_InvokeCommand(session, commandID, operation, returnOrigin);
+    }
+
+    TEEC_Result ret = TEEC_InvokeCommand(session, commandID, operation, returnOrigin);
+    bool timedOut = DisarmDeadline(&deadline, ret);
+    (void)pthread_cond_destroy(&deadline.cancelDone);
+    if (timedOut) {
+        tloge("invoke cmd 0x%x timed out after %u ms, result 0x%x\n", commandID, timeoutMs, ret);
+        ret = (TEEC_Result)TEEC_ERROR_TIMEOUT;
+        if (returnOrigin != NULL) {
+            *returnOrigin = TEEC_ORIGIN_API;
+        }
+    }
+    return ret;
+}
+
+TEEC_Result TEEC_EXT_GetInvokeDeadlineStats(TEEC_InvokeDeadlineStats *stats)
+{
+    if (stats == NULL) {
+        return (TEEC_Result)TEEC_ERROR_BAD_PARAMETERS;
+    }
+    (void)pthread_mutex_lock(&g_deadlineLock);
+    *stats = g_deadlineStats;
+    (void)pthread_mutex_unlock(&g_deadlineLock);
+    return TEEC_SUCCESS;
+}
@@ -16,6 +16,8 @@
 #include <pthread.h>
 #include <errno.h>
 #include <semaphore.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <securec.h>
 
 #include "tee_client_api.h"
@@ -29,13 +31,220 @@
 
 #define SESSION_POOL_CAP_MIN 5
 #define SESSION_POOL_CAP_MAX 100
+#define SESSION_POOL_MAINTAIN_INTERVAL_MS 1000
+#define SESSION_POOL_HEAL_BACKOFF_MIN_MS 100
+#define SESSION_POOL_HEAL_BACKOFF_MAX_MS 10000
+#define SESSION_POOL_WARMUP_THREADS_MAX 16
 
-static void FreeSessionPool(struct SessionPool *sp);
+#define MS_PER_SEC 1000
+#define US_PER_SEC 1000000
+#define US_PER_MS  1000
+#define NS_PER_US  1000
+#define NS_PER_SEC 1000000000
+#define BITS_PER_WORD 64
+/* an affinity entry is the hash tag, the generation of the slot and slot + 1 */
+#define AFFINITY_SLOT_MASK 0xffULL    /* pools hold at most SESSION_POOL_CAP_MAX sessions */
+#define AFFINITY_GEN_SHIFT 8
+#define AFFINITY_GEN_MASK  0xffffULL
+#define AFFINITY_TAG_MASK  (~0xffffffULL)
 
-static struct SessionPool *AllocSessionPool(TEEC_Context *context,
+struct SessionPoolWaiter {
+    struct SessionPoolWaiter *next;
+    pthread_cond_t cond;
+    bool granted;                 /* a key was taken from sp->pool.keys for this waiter */
+};
+
+struct SessionSlot {
+    bool isOpen;                  /* slot holds an opened session */
+    bool isOpening;               /* slot is reserved by a thread opening a session */
+    uint64_t lastUsedMs;          /* monotonic time the session was last put back */
+    uint32_t generation;          /* bumped with usageLock when the session is opened or closed, read atomic */
+};
+
+/*
+ * struct SessionPool is what callers see and keeps the layout of the public
+ * header, everything else the pool needs lives behind it.
+ */
+struct SessionPoolImpl {
+    struct SessionPool pool;
+    struct SessionSlot *slots;    /* per session state beside pool.sessionsInfo */
+    uint64_t *usage;              /* pool.usage seen as 64 bit words, claimed and returned with atomics */
+    uint32_t usageSize;           /* bitmap size in 64 bit words */
+    uint32_t minSize;
+    uint32_t limit;               /* minSize <= limit <= poolSize, read without a lock */
+    uint32_t targetWaitUs;
+    uint32_t idleTimeoutMs;
+    uint32_t warmupThreads;
+    uint32_t opening;             /* sessions being opened, protected by usageLock */
+    pthread_cond_t readyCond;     /* signalled with usageLock when a session is opened */
+    struct SessionPoolStats stats; /* acquire and wait counters are atomic, the rest protected by usageLock */
+    uint32_t deadCount;           /* dead sessions not reopened yet, protected by usageLock */
+    uint32_t healPending;         /* dead sessions closed and waiting to be reopened, protected by usageLock */
+    uint64_t degradedSinceMs;     /* when deadCount last became non zero */
+    uint32_t healBackoffMs;       /* delay before the next reopen attempt after a failure */
+    uint64_t nextHealMs;          /* monotonic time of the next reopen attempt */
+    pthread_t maintainer;         /* opens and closes sessions, see SessionPoolMaintainFn */
+    bool maintainerStarted;
+    bool stopping;
+    uint32_t growPending;         /* sessions requested by waiting callers */
+    pthread_mutex_t maintainLock; /* protects stopping and growPending */
+    pthread_cond_t maintainCond;
+    uint32_t waiting;             /* callers queued for a key, read without waitLock */
+    pthread_mutex_t waitLock;     /* protects the waiter queues */
+    struct SessionPoolWaiter *waitHead[SESSION_POOL_PRIO_NUM];
+    struct SessionPoolWaiter *waitTail[SESSION_POOL_PRIO_NUM];
+    uint64_t affinity[SESSION_POOL_AFFINITY_SLOTS]; /* key tag, slot generation and slot + 1, atomic */
+};
+
+static void FreeSessionPool(struct SessionPoolImpl *sp);
+
+/* pool is the first member, so a NULL handle stays NULL */
+static inline struct SessionPoolImpl *PoolImpl(struct SessionPool *sessionPool)
+{
+    return (struct SessionPoolImpl *)sessionPool;
+}
+
+/*
+ * The checkout path takes no lock: a key from sp->pool.keys guarantees an idle
+ * bit in sp->usage, which is then claimed with a compare and swap. The pool
+ * keeps plain integer fields, they are only accessed through the helpers below
+ * once the pool is shared. Bit i of the words is bit i % 8 of byte i / 8 in
+ * pool.usage on the little endian targets this library is built for.
+ */
+static inline volatile atomic_ullong *UsageWord(const struct SessionPoolImpl *sp, uint32_t i)
+{
+    return (volatile atomic_ullong *)&sp->usage[i / BITS_PER_WORD];
+}
+
+static inline uint64_t SlotMask(uint32_t i)
+{
+    return 1ULL << (i % BITS_PER_WORD);
+}
+
+static inline void PutSlot(struct SessionPoolImpl *sp, uint32_t i)
+{
+    (void)atomic_fetch_or_explicit(UsageWord(sp, i), SlotMask(i), memory_order_release);
+}
+
+static inline bool ClaimSlot(struct SessionPoolImpl *sp, uint32_t i)
+{
+    uint64_t old = atomic_fetch_and_explicit(UsageWord(sp, i), ~SlotMask(i), memory_order_acquire);
+    return (old & SlotMask(i)) != 0;
+}
+
+static inline bool SlotIdle(const struct SessionPoolImpl *sp, uint32_t i)
+{
+    return (atomic_load_explicit(UsageWord(sp, i), memory_order_relaxed) & SlotMask(i)) != 0;
+}
+
+static int32_t ClaimAnySlot(struct SessionPoolImpl *sp)
+{
+    for (uint32_t w = 0; w < sp->usageSize; w++) {
+        volatile atomic_ullong *word = (volatile atomic_ullong *)&sp->usage[w];
+        unsigned long long value = atomic_load_explicit(word, memory_order_relaxed);
+        while (value != 0) {
+            uint32_t bit = (uint32_t)__builtin_ctzll(value);
+            if (atomic_compare_exchange_weak_explicit(word, &value, value & ~(1ULL << bit),
+                memory_order_acquire, memory_order_relaxed)) {
+                return (int32_t)(w * BITS_PER_WORD + bit);
+            }
+        }
+    }
+    return -1;
+}
+
+static inline void StatAdd(uint64_t *cnt, uint64_t value)
+{
+    (void)atomic_fetch_add_explicit((volatile atomic_ullong *)cnt, value, memory_order_relaxed);
+}
+
+static inline uint64_t StatLoad(const uint64_t *cnt)
+{
+    return atomic_load_explicit((volatile atomic_ullong *)cnt, memory_order_relaxed);
+}
+
+static inline void StatMax(uint64_t *cnt, uint64_t value)
+{
+    unsigned long long old = atomic_load_explicit((volatile atomic_ullong *)cnt, memory_order_relaxed);
+    while (old < value && !atomic_compare_exchange_weak_explicit((volatile atomic_ullong *)cnt, &old, value,
+        memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static inline void CountAdd(uint32_t *cnt, int32_t value)
+{
+    (void)atomic_fetch_add_explicit((volatile atomic_uint *)cnt, (unsigned int)value, memory_order_relaxed);
+}
+
+static inline uint32_t CountLoad(const uint32_t *cnt)
+{
+    return atomic_load_explicit((volatile atomic_uint *)cnt, memory_order_relaxed);
+}
+
+static inline void SetLastUsed(struct SessionSlot *slot, uint64_t nowMs)
+{
+    atomic_store_explicit((volatile atomic_ullong *)&slot->lastUsedMs, nowMs, memory_order_relaxed);
+}
+
+static inline uint64_t GetLastUsed(const struct SessionSlot *slot)
+{
+    return atomic_load_explicit((volatile atomic_ullong *)&slot->lastUsedMs, memory_order_relaxed);
+}
+
+/* the session of the slot changed, affinity entries recorded for the old one no longer match */
+static inline void BumpGeneration(struct SessionSlot *slot)
+{
+    (void)atomic_fetch_add_explicit((volatile atomic_uint *)&slot->generation, 1, memory_order_relaxed);
+}
+
+static inline uint64_t GetGeneration(const struct SessionSlot *slot)
+{
+    return atomic_load_explicit((volatile atomic_uint *)&slot->generation, memory_order_relaxed) & AFFINITY_GEN_MASK;
+}
+
+static uint64_t MonotonicUs(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * US_PER_SEC + (uint64_t)now.tv_nsec / NS_PER_US;
+}
+
+static uint64_t MonotonicMs(void)
+{
+    return MonotonicUs() / US_PER_MS;
+}
+
+static void InitMonotonicCond(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    (void)pthread_condattr_init(&attr);
+    (void)pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    (void)pthread_cond_init(cond, &attr);
+    (void)pthread_condattr_destroy(&attr);
+}
+
+static void MonotonicUsToTimespec(uint64_t us, struct timespec *ts)
+{
+    ts->tv_sec = (time_t)(us / US_PER_SEC);
+    ts->tv_nsec = (long)(us % US_PER_SEC) * NS_PER_US;
+}
+
+static void MonotonicDeadline(uint32_t timeoutMs, struct timespec *deadline)
+{
+    (void)clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeoutMs / MS_PER_SEC;
+    deadline->tv_nsec += (long)(timeoutMs % MS_PER_SEC) * US_PER_MS * NS_PER_US;
+    if (deadline->tv_nsec >= NS_PER_SEC) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= NS_PER_SEC;
+    }
+}
+
+static struct SessionPoolImpl *AllocSessionPool(TEEC_Context *context,
     const TEEC_UUID *destination, uint32_t poolSize)
 {
-    struct SessionPool *sp = malloc(sizeof(struct SessionPool));
+    struct SessionPoolImpl *sp = malloc(sizeof(struct SessionPoolImpl));
     if (sp == NULL) {
         tloge("alloc session pool fail failed\n");
         return NULL;
@@ -47,203 +256,681 @@ static struct SessionPool *AllocSessionPool(TEEC_Context *context,
      * only save a ref ptr to it. So caller need to guarantee it will
      * not be freed before destroy session pool.
      */
-    sp->context = context;
-    if (memcpy_s(&sp->uuid, sizeof(TEEC_UUID), destination, sizeof(*destination)) != EOK) {
+    sp->pool.context = context;
+    if (memcpy_s(&sp->pool.uuid, sizeof(TEEC_UUID), destination, sizeof(*destination)) != EOK) {
         free(sp);
         return NULL;
     }
 
-    sp->sessionsInfo = malloc(sizeof(*sp->sessionsInfo) * poolSize);
-    sp->usageSize = poolSize / sizeof(uint8_t) + ((poolSize % sizeof(uint8_t)) ? 1 : 0);
-    sp->usage = malloc(sp->usageSize);
-    if (sp->sessionsInfo == NULL || sp->usage == NULL) {
+    sp->pool.sessionsInfo = malloc(sizeof(*sp->pool.sessionsInfo) * poolSize);
+    sp->usageSize = (poolSize + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    sp->usage = malloc(sp->usageSize * sizeof(*sp->usage));
+    sp->slots = malloc(sizeof(*sp->slots) * poolSize);
+    if (sp->pool.sessionsInfo == NULL || sp->usage == NULL || sp->slots == NULL) {
         tloge("alloc session pool context fail\n");
         FreeSessionPool(sp);
         return NULL;
     }
+    (void)memset_s(sp->pool.sessionsInfo, sizeof(*sp->pool.sessionsInfo) * poolSize, 0,
+        sizeof(*sp->pool.sessionsInfo) * poolSize);
+    (void)memset_s(sp->usage, sp->usageSize * sizeof(*sp->usage), 0, sp->usageSize * sizeof(*sp->usage));
+    (void)memset_s(sp->slots, sizeof(*sp->slots) * poolSize, 0, sizeof(*sp->slots) * poolSize);
+    sp->pool.usage = (uint8_t *)sp->usage;
+    sp->pool.usageSize = sp->usageSize * sizeof(*sp->usage);
 
-    sp->poolSize = poolSize;
+    sp->pool.poolSize = poolSize;
+    sp->limit = poolSize;
 
-    (void)pthread_mutex_init(&sp->usageLock, NULL);
-    (void)sem_init(&sp->keys, 0, 0);
+    (void)pthread_mutex_init(&sp->pool.usageLock, NULL);
+    (void)sem_init(&sp->pool.keys, 0, 0);
+    (void)pthread_mutex_init(&sp->maintainLock, NULL);
+    (void)pthread_mutex_init(&sp->waitLock, NULL);
+    InitMonotonicCond(&sp->maintainCond);
+    InitMonotonicCond(&sp->readyCond);
 
     return sp;
 }
 
-static void FreeSessionPool(struct SessionPool *sp)
+static void FreeSessionPool(struct SessionPoolImpl *sp)
 {
     if (sp != NULL) {
-        if (sp->sessionsInfo != NULL) {
-            free(sp->sessionsInfo);
+        if (sp->pool.sessionsInfo != NULL) {
+            free(sp->pool.sessionsInfo);
         }
         if (sp->usage != NULL) {
             free(sp->usage);
         }
+        if (sp->slots != NULL) {
+            free(sp->slots);
+        }
         free(sp);
     }
 }
 
-struct CreateSessionReq {
-    struct SessionPool *sp;
-    uint32_t reqCount;
-    TEEC_Result ret;
-};
+/* called with waitLock held, hands the keys in sp->pool.keys to queued callers, highest class first */
+static void DispatchKeysLocked(struct SessionPoolImpl *sp)
+{
+    for (uint32_t prio = 0; prio < SESSION_POOL_PRIO_NUM; prio++) {
+        while (sp->waitHead[prio] != NULL) {
+            if (sem_trywait(&sp->pool.keys) != 0) {
+                return;
+            }
+            struct SessionPoolWaiter *waiter = sp->waitHead[prio];
+            sp->waitHead[prio] = waiter->next;
+            if (sp->waitHead[prio] == NULL) {
+                sp->waitTail[prio] = NULL;
+            }
+            CountAdd(&sp->waiting, -1);
+            waiter->granted = true;
+            (void)pthread_cond_signal(&waiter->cond);
+        }
+    }
+}
 
-static void *CreateSessionsFn(void *data)
+/*
+ * A caller queues up before it tries the semaphore again, so a key posted
+ * meanwhile is either seen by that try or handed over here.
+ */
+static void PostSessionKey(struct SessionPoolImpl *sp)
+{
+    if (sem_post(&sp->pool.keys) < 0) {
+        tloge("keys may corrupted, err=%d\n", errno);
+        return;
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (CountLoad(&sp->waiting) == 0) {
+        return;
+    }
+    (void)pthread_mutex_lock(&sp->waitLock);
+    DispatchKeysLocked(sp);
+    (void)pthread_mutex_unlock(&sp->waitLock);
+}
+
+static void EnqueueWaiterLocked(struct SessionPoolImpl *sp, uint32_t prio, struct SessionPoolWaiter *waiter)
+{
+    if (sp->waitTail[prio] == NULL) {
+        sp->waitHead[prio] = waiter;
+    } else {
+        sp->waitTail[prio]->next = waiter;
+    }
+    sp->waitTail[prio] = waiter;
+    (void)atomic_fetch_add_explicit((volatile atomic_uint *)&sp->waiting, 1, memory_order_seq_cst);
+}
+
+static void RemoveWaiterLocked(struct SessionPoolImpl *sp, uint32_t prio, const struct SessionPoolWaiter *waiter)
+{
+    struct SessionPoolWaiter *prev = NULL;
+    struct SessionPoolWaiter *cur = sp->waitHead[prio];
+
+    while (cur != NULL && cur != waiter) {
+        prev = cur;
+        cur = cur->next;
+    }
+    if (cur == NULL) {
+        return;
+    }
+    if (prev == NULL) {
+        sp->waitHead[prio] = cur->next;
+    } else {
+        prev->next = cur->next;
+    }
+    if (sp->waitTail[prio] == cur) {
+        sp->waitTail[prio] = prev;
+    }
+    CountAdd(&sp->waiting, -1);
+}
+
+/* sessions being opened and dead sessions waiting to be reopened count towards the pool size */
+static uint32_t GetOpenedCountLocked(const struct SessionPoolImpl *sp)
+{
+    return sp->pool.opened + sp->opening + sp->healPending;
+}
+
+static uint32_t GetOpenedCount(struct SessionPoolImpl *sp)
+{
+    (void)pthread_mutex_lock(&sp->pool.usageLock);
+    uint32_t opened = GetOpenedCountLocked(sp);
+    (void)pthread_mutex_unlock(&sp->pool.usageLock);
+    return opened;
+}
+
+/*
+ * Open a session into a free slot unless the pool already holds limit
+ * sessions. Several warm-up threads may open at once, so the slot is
+ * reserved first.
+ */
+static TEEC_Result OpenPoolSession(struct SessionPoolImpl *sp, uint32_t limit)
 {
-    struct CreateSessionReq *req = (struct CreateSessionReq *)data;
-    struct SessionPool *sp = req->sp;
-    uint32_t i;
     TEEC_Operation operation = { 0 };
-    TEEC_Result ret = TEEC_ERROR_GENERIC;
-    uint32_t opened = sp->opened;
+    uint32_t i;
 
-    for (i = opened; i < opened + req->reqCount; i++) {
-        operation.started = 1;
-        ret = TEEC_OpenSession(sp->context, &sp->sessionsInfo[i].session, &sp->uuid, TEEC_LOGIN_IDENTIFY,
-            NULL, &operation, NULL);
-        if (ret != TEEC_SUCCESS) {
-            tloge("open session(%u/%u) failed, ret = 0x%x\n", i + 1, sp->poolSize, ret);
+    (void)pthread_mutex_lock(&sp->pool.usageLock);
+    for (i = 0; i < sp->pool.poolSize; i++) {
+        if (!sp->slots[i].isOpen && !sp->slots[i].isOpening) {
             break;
-        } else {
-            tlogd("open session(%u/%u) success\n", i + 1, sp->poolSize);
         }
-        sp->sessionsInfo[i].isDead = false;
-        (void)pthread_mutex_lock(&sp->usageLock);
-        SetBit(i, sp->usageSize, sp->usage);
-        sp->opened++;
-        (void)pthread_mutex_unlock(&sp->usageLock);
-        (void)sem_post(&sp->keys);
     }
+    if (i == sp->pool.poolSize || GetOpenedCountLocked(sp) >= limit) {
+        (void)pthread_mutex_unlock(&sp->pool.usageLock);
+        return TEEC_ERROR_BUSY;
+    }
+    sp->slots[i].isOpening = true;
+    sp->opening++;
+    (void)pthread_mutex_unlock(&sp->pool.usageLock);
 
-    /*
-     * reqCount = 1, in parent thread
-     * reqCount > 1, in child thread
-     */
-    if (req->reqCount == 1) {
-        req->ret = ret;
+    operation.started = 1;
+    TEEC_Result ret = TEEC_OpenSession(sp->pool.context, &sp->pool.sessionsInfo[i].session, &sp->pool.uuid,
+        TEEC_LOGIN_IDENTIFY, NULL, &operation, NULL);
+    (void)pthread_mutex_lock(&sp->pool.usageLock);
+    sp->slots[i].isOpening = false;
+    sp->opening--;
+    if (ret != TEEC_SUCCESS) {
+        (void)pthread_mutex_unlock(&sp->pool.usageLock);
+        tloge("open session(%u/%u) failed, ret = 0x%x\n", i + 1, sp->pool.poolSize, ret);
+        return ret;
+    }
+    tlogd("open session(%u/%u) success\n", i + 1, sp->pool.poolSize);
+
+    sp->pool.sessionsInfo[i].isDead = false;
+    sp->slots[i].isOpen = true;
+    BumpGeneration(&sp->slots[i]);
+    SetLastUsed(&sp->slots[i], MonotonicMs());
+    PutSlot(sp, i);
+    sp->pool.opened++;
+    (void)pthread_cond_broadcast(&sp->readyCond);
+    (void)pthread_mutex_unlock(&sp->pool.usageLock);
+    PostSessionKey(sp);
+    return TEEC_SUCCESS;
+}
+
+/*
+ * close the session idle for the longest time if it has been idle past
+ * idleTimeoutMs, or if the pool holds more sessions than its limit
+ */
+static bool ShrinkIdleSession(struct SessionPoolImpl *sp)
+{
+    int32_t victim = -1;
+
+    uint32_t opened = GetOpenedCount(sp);
+    bool overLimit = opened > CountLoad(&sp->limit);
+    if ((sp->idleTimeoutMs == 0 && !overLimit) || opened <= sp->minSize) {
+        return false;
+    }
+    /* take the key of the session first so no caller can be handed it */
+    if (sem_trywait(&sp->pool.keys) != 0) {
+        return false;
+    }
+
+    /* a caller may claim the chosen slot first, the key guarantees another idle one then */
+    uint64_t now = MonotonicMs();
+    (void)pthread_mutex_lock(&sp->pool.usageLock);
+    do {
+        uint64_t victimUsed = UINT64_MAX;
+        victim = -1;
+        for (uint32_t i = 0; i < sp->pool.poolSize; i++) {
+            const struct SessionSlot *slot = &sp->slots[i];
+            uint64_t lastUsed = GetLastUsed(slot);
+            bool idle = slot->isOpen && SlotIdle(sp, i) && (overLimit || now - lastUsed >= sp->idleTimeoutMs);
+            if (idle && lastUsed < victimUsed) {
+                victim = (int32_t)i;
+                victimUsed = lastUsed;
+            }
+        }
+    } while (victim >= 0 && !ClaimSlot(sp, (uint32_t)victim));
+    (void)pthread_mutex_unlock(&sp->pool.usageLock);
+
+    if (victim < 0) {
+        PostSessionKey(sp);
+        return false;
+    }
+
+    TEEC_CloseSession(&sp->pool.sessionsInfo[victim].session);
+    (void)pthread_mutex_lock(&sp->pool.usageLock);
+    sp->slots[victim].isOpen = false;
+    BumpGeneration(&sp->slots[victim]);
+    sp->pool.opened--;
+    sp->stats.shrunk++;
+    (void)pthread_mutex_unlock(&sp->pool.usageLock);
+    tlogd("close idle session %d, opened %u\n", victim, sp->pool.opened);
+    return true;
+}
+
+static void RecordReopen(struct SessionPoolImpl *sp, TEEC_Result ret, uint64_t now)
+{
+    (void)pthread_mutex_lock(&sp->pool.usageLock);
+    if (ret == TEEC_SUCCESS) {
+        sp->healPending--;
+        sp->deadCount--;
+        sp->stats.reopened++;
+        if (sp->deadCount == 0) {
+            sp->stats.degradedMs += now - sp->degradedSinceMs;
+        }
+        sp->healBackoffMs = 0;
     } else {
-        free(req);
+        sp->stats.reopenFailed++;
+        sp->healBackoffMs = (sp->healBackoffMs == 0) ? SESSION_POOL_HEAL_BACKOFF_MIN_MS : sp->healBackoffMs * 2;
+        if (sp->healBackoffMs > SESSION_POOL_HEAL_BACKOFF_MAX_MS) {
+            sp->healBackoffMs = SESSION_POOL_HEAL_BACKOFF_MAX_MS;
+        }
+        sp->nextHealMs = now + sp->healBackoffMs;
+    }
+    (void)pthread_mutex_unlock(&sp->pool.usageLock);
+}
+
+/*
+ * Close the sessions that died with TEEC_ERROR_TARGET_DEAD and open new ones in
+ * their place, backing off while reopening fails. Returns the time in ms until
+ * the next attempt, 0 when nothing is left to heal.
+ */
+static uint32_t HealDeadSessions(struct SessionPoolImpl *sp)
+{
+    for (uint32_t i = 0; i < sp->pool.poolSize; i++) {
+        (void)pthread_mutex_lock(&sp->pool.usageLock);
+        bool dead = sp->slots[i].isOpen && sp->pool.sessionsInfo[i].isDead;
+        (void)pthread_mutex_unlock(&sp->pool.usageLock);
+        if (!dead) {
+            continue;
+        }
+        TEEC_CloseSession(&sp->pool.sessionsInfo[i].session);
+        (void)pthread_mutex_lock(&sp->pool.usageLock);
+        sp->slots[i].isOpen = false;
+        BumpGeneration(&sp->slots[i]);
+        sp->pool.sessionsInfo[i].isDead = false;
+        sp->pool.opened--;
+        sp->healPending++;
+        (void)pthread_mutex_unlock(&sp->pool.usageLock);
+    }
+
+    for (;;) {
+        (void)pthread_mutex_lock(&sp->pool.usageLock);
+        uint32_t pending = sp->healPending;
+        uint64_t nextHealMs = sp->nextHealMs;
+        (void)pthread_mutex_unlock(&sp->pool.usageLock);
+        if (pending == 0) {
+            return 0;
+        }
+
+        uint64_t now = MonotonicMs();
+        if (now < nextHealMs) {
+            return (uint32_t)(nextHealMs - now);
+        }
+        /* the slot is already counted in healPending, only free slots bound it */
+        TEEC_Result ret = OpenPoolSession(sp, UINT32_MAX);
+        RecordReopen(sp, ret, MonotonicMs());
+        if (ret != TEEC_SUCCESS) {
+            tloge("reopen dead session failed, ret = 0x%x, retry in %u ms\n", ret, sp->healBackoffMs);
+        }
+    }
+}
+
+static void WaitMaintainEvent(struct SessionPoolImpl *sp, uint32_t healWaitMs)
+{
+    struct timespec deadline;
+    uint32_t intervalMs = SESSION_POOL_MAINTAIN_INTERVAL_MS;
+
+    if (sp->idleTimeoutMs != 0 && sp->idleTimeoutMs / 2 < intervalMs) {
+        intervalMs = sp->idleTimeoutMs / 2 + 1;
+    }
+    if (healWaitMs != 0 && healWaitMs < intervalMs) {
+        intervalMs = healWaitMs;
     }
+    MonotonicDeadline(intervalMs, &deadline);
+    (void)pthread_cond_timedwait(&sp->maintainCond, &sp->maintainLock, &deadline);
+}
 
+static void *WarmupOpenerFn(void *data)
+{
+    struct SessionPoolImpl *sp = (struct SessionPoolImpl *)data;
+
+    for (;;) {
+        (void)pthread_mutex_lock(&sp->maintainLock);
+        bool stopping = sp->stopping;
+        (void)pthread_mutex_unlock(&sp->maintainLock);
+        if (stopping || OpenPoolSession(sp, sp->minSize) != TEEC_SUCCESS) {
+            break;
+        }
+    }
     return NULL;
 }
 
-TEEC_Result TEEC_SessionPoolCreate(TEEC_Context *context, const TEEC_UUID *destination,
-    struct SessionPool **sessionPool, uint32_t poolSize)
+/* open the first minSize sessions with warmupThreads openers, the maintainer being one of them */
+static void WarmupSessionPool(struct SessionPoolImpl *sp)
+{
+    pthread_t openers[SESSION_POOL_WARMUP_THREADS_MAX];
+    uint32_t started = 0;
+
+    uint32_t need = sp->minSize - GetOpenedCount(sp);
+    while (started + 1 < sp->warmupThreads && started + 1 < need) {
+        if (pthread_create(&openers[started], NULL, &WarmupOpenerFn, sp) != 0) {
+            tloge("create warm-up opener failed, error = %d\n", errno);
+            break;
+        }
+        started++;
+    }
+    (void)WarmupOpenerFn(sp);
+    for (uint32_t i = 0; i < started; i++) {
+        (void)pthread_join(openers[i], NULL);
+    }
+    tlogd("session pool warmed up with %u openers, opened %u\n", started + 1, GetOpenedCount(sp));
+}
+
+/*
+ * The maintainer reopens dead sessions, fills the pool up to minSize, opens
+ * one more session per request from a caller that waited past targetWaitUs
+ * and closes sessions that have been idle past idleTimeoutMs.
+ */
+static void *SessionPoolMaintainFn(void *data)
+{
+    struct SessionPoolImpl *sp = (struct SessionPoolImpl *)data;
+
+    WarmupSessionPool(sp);
+
+    (void)pthread_mutex_lock(&sp->maintainLock);
+    while (!sp->stopping) {
+        (void)pthread_mutex_unlock(&sp->maintainLock);
+        uint32_t healWaitMs = HealDeadSessions(sp);
+        (void)pthread_mutex_lock(&sp->maintainLock);
+
+        uint32_t opened = GetOpenedCount(sp);
+        uint32_t limit = CountLoad(&sp->limit);
+        bool fill = opened < sp->minSize;
+        bool grow = (sp->growPending > 0) && (opened < limit);
+        if (fill || grow) {
+            if (!fill) {
+                sp->growPending--;
+            }
+            (void)pthread_mutex_unlock(&sp->maintainLock);
+            TEEC_Result ret = OpenPoolSession(sp, fill ? sp->minSize : limit);
+            (void)pthread_mutex_lock(&sp->maintainLock);
+            if (ret == TEEC_SUCCESS && !fill) {
+                (void)pthread_mutex_lock(&sp->pool.usageLock);
+                sp->stats.grown++;
+                (void)pthread_mutex_unlock(&sp->pool.usageLock);
+            }
+            if (ret == TEEC_SUCCESS) {
+                continue;
+            }
+            /* the TEE is out of sessions or the TA fails to open, retry later */
+            sp->growPending = 0;
+        } else {
+            sp->growPending = 0;
+            (void)pthread_mutex_unlock(&sp->maintainLock);
+            while (ShrinkIdleSession(sp)) {
+            }
+            (void)pthread_mutex_lock(&sp->maintainLock);
+        }
+        if (!sp->stopping && sp->growPending == 0) {
+            WaitMaintainEvent(sp, healWaitMs);
+        }
+    }
+    (void)pthread_mutex_unlock(&sp->maintainLock);
+    return NULL;
+}
+
+static void RequestPoolGrow(struct SessionPoolImpl *sp)
+{
+    (void)pthread_mutex_lock(&sp->maintainLock);
+    if (GetOpenedCount(sp) + sp->growPending < CountLoad(&sp->limit)) {
+        sp->growPending++;
+        (void)pthread_cond_signal(&sp->maintainCond);
+    }
+    (void)pthread_mutex_unlock(&sp->maintainLock);
+}
+
+static TEEC_Result CheckPoolConfig(const struct SessionPoolConfig *config)
+{
+    bool invalid = (config->minSize == 0) || (config->minSize > config->maxSize) ||
+        (config->maxSize > SESSION_POOL_CAP_MAX) || (config->warmupThreads > SESSION_POOL_WARMUP_THREADS_MAX);
+    return invalid ? TEEC_ERROR_BAD_PARAMETERS : TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_SessionPoolCreateWithConfig(TEEC_Context *context, const TEEC_UUID *destination,
+    const struct SessionPoolConfig *config, struct SessionPool **sessionPool)
 {
-    struct CreateSessionReq *req = NULL;
-    struct SessionPool *sp = NULL;
+    struct SessionPoolImpl *sp = NULL;
     TEEC_Result ret;
-    pthread_t worker;
 
-    if (context == NULL || destination == NULL || sessionPool == NULL) {
+    if (context == NULL || destination == NULL || config == NULL || sessionPool == NULL) {
         return TEEC_ERROR_BAD_PARAMETERS;
     }
-    if (poolSize > SESSION_POOL_CAP_MAX || poolSize < SESSION_POOL_CAP_MIN) {
+    if (CheckPoolConfig(config) != TEEC_SUCCESS) {
+        tloge("invalid session pool config, min %u max %u\n", config->minSize, config->maxSize);
         return TEEC_ERROR_BAD_PARAMETERS;
     }
 
-    sp = AllocSessionPool(context, destination, poolSize);
+    sp = AllocSessionPool(context, destination, config->maxSize);
     if (sp == NULL) {
         tloge("alloc session pool failed\n");
-        ret = TEEC_ERROR_OUT_OF_MEMORY;
-        goto error;
-    }
-    req = malloc(sizeof(struct CreateSessionReq));
-    if (req == NULL) {
-        tloge("alloc req failed\n");
-        ret = TEEC_ERROR_OUT_OF_MEMORY;
-        goto error;
+        return TEEC_ERROR_OUT_OF_MEMORY;
     }
+    sp->minSize       = config->minSize;
+    sp->targetWaitUs  = config->targetWaitUs;
+    sp->idleTimeoutMs = config->idleTimeoutMs;
+    sp->warmupThreads = (config->warmupThreads == 0) ? 1 : config->warmupThreads;
 
     /*
      * We try to open 1 session at first to check if it can success,
-     * then the rest sessions will be opened in a child thread so that the main
-     * thread will not block too much time.
+     * then the rest sessions will be opened by the maintainer thread so that
+     * the main thread will not block too much time.
      * If want to know how many session is opened actually, you need to use
      * TEEC_SessionPoolQuery.
      */
-    req->sp = sp;
-    req->reqCount = 1;
-    (void)CreateSessionsFn((void*)req);
-    if (req->ret != TEEC_SUCCESS) {
-        tloge("open first session failed, ret = 0x%x\n", req->ret);
-        ret = req->ret;
+    ret = OpenPoolSession(sp, sp->minSize);
+    if (ret != TEEC_SUCCESS) {
+        tloge("open first session failed, ret = 0x%x\n", ret);
         goto error;
     }
 
-    /* req will be freed in child thread */
-    req->reqCount = sp->poolSize - 1;
-    if (pthread_create(&worker, NULL, &CreateSessionsFn, req) != 0) {
-        tloge("create worker failed, error = %d\n", errno);
+    if (pthread_create(&sp->maintainer, NULL, &SessionPoolMaintainFn, sp) != 0) {
+        tloge("create maintainer failed, error = %d\n", errno);
         ret = TEEC_ERROR_GENERIC;
         goto error;
     }
-    pthread_detach(worker);
+    sp->maintainerStarted = true;
 
-    *sessionPool = sp;
+    *sessionPool = &sp->pool;
 
     return TEEC_SUCCESS;
 
 error:
-    TEEC_SessionPoolDestroy(sp);
-    if (req != NULL) {
-        free(req);
-    }
+    TEEC_SessionPoolDestroy(&sp->pool);
     return ret;
 }
 
-static TEEC_Session *GetSessionFromPool(struct SessionPool *sp, int32_t *index)
+TEEC_Result TEEC_SessionPoolCreate(TEEC_Context *context, const TEEC_UUID *destination,
+    struct SessionPool **sessionPool, uint32_t poolSize)
+{
+    if (poolSize > SESSION_POOL_CAP_MAX || poolSize < SESSION_POOL_CAP_MIN) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    struct SessionPoolConfig config = {
+        .minSize = poolSize,
+        .maxSize = poolSize,
+        .targetWaitUs = 0,
+        .idleTimeoutMs = 0,
+        .warmupThreads = 1,
+    };
+    return TEEC_SessionPoolCreateWithConfig(context, destination, &config, sessionPool);
+}
+
+/*
+ * Callers take a key straight from the semaphore only while nobody is queued,
+ * otherwise they queue in their class and keys are handed over by priority.
+ * A queued caller asks the pool to grow once it has waited targetWaitUs.
+ * *waitUs is 0 when a key was free at once.
+ */
+static TEEC_Result WaitSessionKey(struct SessionPoolImpl *sp, uint32_t prio, uint32_t timeoutMs, uint64_t *waitUs)
 {
-    int32_t used;
+    struct SessionPoolWaiter waiter = { .next = NULL, .granted = false };
+    struct timespec deadline;
 
-    while ((sem_wait(&sp->keys)) == -1 && errno == EINTR) {
-        continue;       /* restart if interrupted by signal */
+    *waitUs = 0;
+    if (CountLoad(&sp->waiting) == 0 && sem_trywait(&sp->pool.keys) == 0) {
+        return TEEC_SUCCESS;
     }
-    (void)pthread_mutex_lock(&sp->usageLock);
-    used = GetAndCleartBit(sp->usage, sp->usageSize);
-    if (used != -1) {
-        sp->inuse++;
+
+    uint64_t start = MonotonicUs();
+    uint64_t growAtUs = (GetOpenedCount(sp) < CountLoad(&sp->limit)) ? start + sp->targetWaitUs : UINT64_MAX;
+    uint64_t expireAtUs = (timeoutMs == 0) ? UINT64_MAX : start + (uint64_t)timeoutMs * US_PER_MS;
+    InitMonotonicCond(&waiter.cond);
+
+    (void)pthread_mutex_lock(&sp->waitLock);
+    EnqueueWaiterLocked(sp, prio, &waiter);
+    DispatchKeysLocked(sp);
+    while (!waiter.granted) {
+        uint64_t now = MonotonicUs();
+        if (now >= expireAtUs) {
+            RemoveWaiterLocked(sp, prio, &waiter);
+            break;
+        }
+        if (now >= growAtUs) {
+            growAtUs = UINT64_MAX;
+            (void)pthread_mutex_unlock(&sp->waitLock);
+            RequestPoolGrow(sp);
+            (void)pthread_mutex_lock(&sp->waitLock);
+            continue;
+        }
+        uint64_t wakeAtUs = (growAtUs < expireAtUs) ? growAtUs : expireAtUs;
+        if (wakeAtUs == UINT64_MAX) {
+            (void)pthread_cond_wait(&waiter.cond, &sp->waitLock);
+        } else {
+            MonotonicUsToTimespec(wakeAtUs, &deadline);
+            (void)pthread_cond_timedwait(&waiter.cond, &sp->waitLock, &deadline);
+        }
     }
-    (void)pthread_mutex_unlock(&sp->usageLock);
+    (void)pthread_mutex_unlock(&sp->waitLock);
+    (void)pthread_cond_destroy(&waiter.cond);
 
-    /* shouldn't happen */
-    if (used == -1) {
-        tloge("can't get session, session bitmap may corrupted\n");
-        (void)sem_post(&sp->keys);
-        return NULL;
+    *waitUs = MonotonicUs() - start + 1;
+    return waiter.granted ? TEEC_SUCCESS : TEEC_ERROR_TIMEOUT;
+}
+
+static uint32_t WaitBucket(uint64_t waitUs)
+{
+    if (waitUs == 0) {
+        return 0;
     }
+    uint32_t bucket = BITS_PER_WORD - (uint32_t)__builtin_clzll(waitUs);
+    return (bucket < SESSION_POOL_WAIT_BUCKETS) ? bucket : SESSION_POOL_WAIT_BUCKETS - 1;
+}
 
-    if (index != NULL) {
-        *index = used;
+/* waitUs is 0 when a session was idle at once */
+static void RecordAcquire(struct SessionPoolImpl *sp, uint32_t prio, uint64_t waitUs)
+{
+    StatAdd(&sp->stats.acquired, 1);
+    StatAdd(&sp->stats.classes[prio].acquired, 1);
+    StatAdd(&sp->stats.classes[prio].waitHist[WaitBucket(waitUs)], 1);
+    if (waitUs == 0) {
+        return;
     }
+    StatAdd(&sp->stats.waited, 1);
+    StatAdd(&sp->stats.waitTotalUs, waitUs);
+    StatMax(&sp->stats.waitMaxUs, waitUs);
+    if (waitUs > sp->targetWaitUs) {
+        StatAdd(&sp->stats.overTarget, 1);
+    }
+}
 
-    return &sp->sessionsInfo[used].session;
+/* a 64 bit mix so that sequential keys spread over the table, the low byte keeps the slot */
+static uint64_t AffinityHash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
 }
 
-static void PutSessionToPool(struct SessionPool *sp, int32_t index)
+static inline volatile atomic_ullong *AffinityEntry(struct SessionPoolImpl *sp, uint64_t hash)
 {
-    (void)pthread_mutex_lock(&sp->usageLock);
-    SetBit((uint32_t)index, sp->usageSize, sp->usage);
-    sp->inuse--;
-    (void)pthread_mutex_unlock(&sp->usageLock);
+    return (volatile atomic_ullong *)&sp->affinity[hash % SESSION_POOL_AFFINITY_SLOTS];
+}
 
-    if (sem_post(&sp->keys) < 0) {
-        tloge("keys may corrupted, err=%d\n", errno);
+/*
+ * claim the session last used for the key, -1 if it is not idle or the slot
+ * has had its session closed or reopened since: the TA state the key wants
+ * went with the old session, so that counts as a miss
+ */
+static int32_t ClaimAffinitySlot(struct SessionPoolImpl *sp, uint64_t affinityKey)
+{
+    uint64_t hash = AffinityHash(affinityKey);
+    uint64_t entry = atomic_load_explicit(AffinityEntry(sp, hash), memory_order_relaxed);
+    uint64_t slot = entry & AFFINITY_SLOT_MASK;
+
+    if (slot == 0 || (entry & AFFINITY_TAG_MASK) != (hash & AFFINITY_TAG_MASK)) {
+        StatAdd(&sp->stats.affinityCold, 1);
+        return -1;
+    }
+    if (slot - 1 < sp->pool.poolSize && ClaimSlot(sp, (uint32_t)(slot - 1))) {
+        /* checked once claimed, the session can't be closed or reopened while it is ours */
+        if (GetGeneration(&sp->slots[slot - 1]) == ((entry >> AFFINITY_GEN_SHIFT) & AFFINITY_GEN_MASK)) {
+            StatAdd(&sp->stats.affinityHits, 1);
+            return (int32_t)(slot - 1);
+        }
+        PutSlot(sp, (uint32_t)(slot - 1));
     }
+    StatAdd(&sp->stats.affinityMisses, 1);
+    return -1;
+}
+
+/* called while the session at index is still claimed */
+static void RecordAffinity(struct SessionPoolImpl *sp, uint64_t affinityKey, int32_t index)
+{
+    uint64_t hash = AffinityHash(affinityKey);
+    uint64_t entry = (hash & AFFINITY_TAG_MASK) | (GetGeneration(&sp->slots[index]) << AFFINITY_GEN_SHIFT) |
+        (uint64_t)(index + 1);
+    atomic_store_explicit(AffinityEntry(sp, hash), entry, memory_order_relaxed);
+}
+
+/* the key taken guarantees an idle session, so the fallback claim always finds one */
+static TEEC_Result GetSessionFromPool(struct SessionPoolImpl *sp, uint32_t prio, uint32_t timeoutMs,
+    const uint64_t *affinityKey, int32_t *index)
+{
+    uint64_t waitUs;
+
+    TEEC_Result ret = WaitSessionKey(sp, prio, timeoutMs, &waitUs);
+    if (ret != TEEC_SUCCESS) {
+        StatAdd(&sp->stats.classes[prio].expired, 1);
+        StatAdd(&sp->stats.classes[prio].waitHist[WaitBucket(waitUs)], 1);
+        return ret;
+    }
+
+    int32_t used = (affinityKey == NULL) ? -1 : ClaimAffinitySlot(sp, *affinityKey);
+    if (used == -1) {
+        used = ClaimAnySlot(sp);
+    }
+    /* shouldn't happen */
+    if (used == -1) {
+        tloge("can't get session, session bitmap may corrupted\n");
+        PostSessionKey(sp);
+        return TEEC_ERROR_BAD_STATE;
+    }
+    CountAdd(&sp->pool.inuse, 1);
+    RecordAcquire(sp, prio, waitUs);
+
+    *index = used;
+    return TEEC_SUCCESS;
+}
+
+static void PutSessionToPool(struct SessionPoolImpl *sp, int32_t index)
+{
+    SetLastUsed(&sp->slots[index], MonotonicMs());
+    CountAdd(&sp->pool.inuse, -1);
+    PutSlot(sp, (uint32_t)index);
+    PostSessionKey(sp);
 }
 
-#define BITS_PER_UINT8 8
 #define BITS_PER_UINT32 32
 
-static void DumpSessionState(const struct SessionPool *sp)
+static void DumpSessionState(const struct SessionPoolImpl *sp)
 {
     uint32_t i;
     char *array = NULL;
     uint32_t len;
 
-    len = sp->poolSize + 1;
+    len = sp->pool.poolSize + 1;
     array = malloc(len);
     if (array == NULL) {
         return;
@@ -251,8 +938,8 @@ static void DumpSessionState(const struct SessionPool *sp)
     (void)memset_s(array, len, 0, len);
 
     tloge("Session dead state:\n");
-    for (i = 0; i < sp->poolSize; i++) {
-        bool isDead = sp->sessionsInfo[i].isDead;
+    for (i = 0; i < sp->pool.poolSize; i++) {
+        bool isDead = sp->pool.sessionsInfo[i].isDead;
 
         if (isDead) {
             array[i] = '1';
@@ -260,12 +947,12 @@ static void DumpSessionState(const struct SessionPool *sp)
             array[i] = '0';
         }
     }
-    tloge("%d-%u: %s\n", 0, sp->poolSize - 1, array);
+    tloge("%d-%u: %s\n", 0, sp->pool.poolSize - 1, array);
 
     free(array);
 }
 
-static void DumpSessionPool(const struct SessionPool *sp)
+static void DumpSessionPool(const struct SessionPoolImpl *sp)
 {
     uint32_t i;
     char *bitmap = NULL;
@@ -276,13 +963,10 @@ static void DumpSessionPool(const struct SessionPool *sp)
     }
     (void)memset_s(bitmap, BITS_PER_UINT32 + 1, 0, BITS_PER_UINT32 + 1);
 
-    tloge("Session Pool: size=%u, opened=%u\n", sp->poolSize, sp->opened);
+    tloge("Session Pool: size=%u, opened=%u\n", sp->pool.poolSize, sp->pool.opened);
     tloge("Pool usage:\n");
-    for (i = 0; i < sp->poolSize; i++) {
-        uint8_t usage = sp->usage[i / BITS_PER_UINT8];
-        uint32_t offset = i % BITS_PER_UINT8;
-
-        if ((usage & (1<<offset)) != 0) {
+    for (i = 0; i < sp->pool.poolSize; i++) {
+        if (SlotIdle(sp, i)) {
             bitmap[i % BITS_PER_UINT32] = '1';
         } else {
             bitmap[i % BITS_PER_UINT32] = '0';
@@ -293,88 +977,238 @@ static void DumpSessionPool(const struct SessionPool *sp)
             (void)memset_s(bitmap, BITS_PER_UINT32 + 1, 0, BITS_PER_UINT32 + 1);
         }
     }
-    if ((sp->poolSize % BITS_PER_UINT32) != 0) {
-        tloge("%u-%u: %s\n", i - i % BITS_PER_UINT32, sp->poolSize, bitmap);
+    if ((sp->pool.poolSize % BITS_PER_UINT32) != 0) {
+        tloge("%u-%u: %s\n", i - i % BITS_PER_UINT32, sp->pool.poolSize, bitmap);
     }
 
     free(bitmap);
 }
 
-static void DumpSessionInfo(struct SessionPool *sessionPool)
+static void DumpSessionInfo(struct SessionPoolImpl *sp)
 {
-    if (sessionPool->poolSize > SESSION_POOL_CAP_MAX || sessionPool->poolSize < SESSION_POOL_CAP_MIN) {
+    if (sp->pool.poolSize > SESSION_POOL_CAP_MAX || sp->pool.poolSize == 0) {
         return;
     }
 
-    DumpSessionPool(sessionPool);
-    DumpSessionState(sessionPool);
+    DumpSessionPool(sp);
+    DumpSessionState(sp);
 }
 
-TEEC_Result TEEC_SessionPoolInvoke(struct SessionPool *sessionPool, uint32_t commandID,
-    TEEC_Operation *operation, uint32_t *returnOrigin)
+static TEEC_Result SessionPoolInvoke(struct SessionPoolImpl *sp, uint32_t priority, uint32_t timeoutMs,
+    const uint64_t *affinityKey, uint32_t commandID, TEEC_Operation *operation, uint32_t *returnOrigin)
 {
     TEEC_Session *session = NULL;
     TEEC_Result ret;
     int32_t index;
 
-    if (sessionPool == NULL || sessionPool->sessionsInfo == NULL) {
+    if (sp == NULL || sp->pool.sessionsInfo == NULL || priority >= SESSION_POOL_PRIO_NUM) {
         return TEEC_ERROR_BAD_PARAMETERS;
     }
 
-    session = GetSessionFromPool(sessionPool, &index);
-    if (session == NULL) {
+    ret = GetSessionFromPool(sp, priority, timeoutMs, affinityKey, &index);
+    if (ret == TEEC_ERROR_TIMEOUT) {
+        tlogd("no session within %u ms for class %u\n", timeoutMs, priority);
+        if (returnOrigin != NULL) {
+            *returnOrigin = TEEC_ORIGIN_API;
+        }
+        return ret;
+    }
+    if (ret != TEEC_SUCCESS) {
         tloge("can't get session from pool\n");
         /* shouldn't happen, dump session pool status */
-        DumpSessionInfo(sessionPool);
+        DumpSessionInfo(sp);
         return TEEC_ERROR_BAD_PARAMETERS;
     }
+    session = &sp->pool.sessionsInfo[index].session;
 
     ret = TEEC_InvokeCommand(session, commandID, operation, returnOrigin);
     if (ret == TEEC_ERROR_TARGET_DEAD) {
-        /* Session is crash, and not put bitmap and sem keys. */
+        /* Session is crash, keep its key until the maintainer has reopened it. */
         tloge("this session is dead: index=%d\n", index);
-        sessionPool->sessionsInfo[index].isDead = true;
-        DumpSessionInfo(sessionPool);
+        (void)pthread_mutex_lock(&sp->pool.usageLock);
+        sp->pool.sessionsInfo[index].isDead = true;
+        CountAdd(&sp->pool.inuse, -1);
+        sp->stats.deaths++;
+        if (sp->deadCount++ == 0) {
+            sp->degradedSinceMs = MonotonicMs();
+        }
+        (void)pthread_mutex_unlock(&sp->pool.usageLock);
+        DumpSessionInfo(sp);
+
+        (void)pthread_mutex_lock(&sp->maintainLock);
+        (void)pthread_cond_signal(&sp->maintainCond);
+        (void)pthread_mutex_unlock(&sp->maintainLock);
     } else {
-        PutSessionToPool(sessionPool, index);
+        if (affinityKey != NULL) {
+            RecordAffinity(sp, *affinityKey, index);
+        }
+        PutSessionToPool(sp, index);
     }
 
     return ret;
 }
 
+TEEC_Result TEEC_SessionPoolInvokeWithPriority(struct SessionPool *sessionPool, uint32_t priority,
+    uint32_t timeoutMs, uint32_t commandID, TEEC_Operation *operation, uint32_t *returnOrigin)
+{
+    return SessionPoolInvoke(PoolImpl(sessionPool), priority, timeoutMs, NULL, commandID, operation, returnOrigin);
+}
+
+TEEC_Result TEEC_SessionPoolInvokeWithAffinity(struct SessionPool *sessionPool, uint64_t affinityKey,
+    uint32_t commandID, TEEC_Operation *operation, uint32_t *returnOrigin)
+{
+    return SessionPoolInvoke(PoolImpl(sessionPool), SESSION_POOL_PRIO_NORMAL, 0, &affinityKey, commandID,
+        operation, returnOrigin);
+}
+
+TEEC_Result TEEC_SessionPoolInvoke(struct SessionPool *sessionPool, uint32_t commandID,
+    TEEC_Operation *operation, uint32_t *returnOrigin)
+{
+    return TEEC_SessionPoolInvokeWithPriority(sessionPool, SESSION_POOL_PRIO_NORMAL, 0, commandID,
+        operation, returnOrigin);
+}
+
 void TEEC_SessionPoolDestroy(struct SessionPool *sessionPool)
 {
+    struct SessionPoolImpl *sp = PoolImpl(sessionPool);
     uint32_t i;
 
-    if (sessionPool == NULL || sessionPool->sessionsInfo == NULL) {
+    if (sp == NULL || sp->pool.sessionsInfo == NULL) {
         return;
     }
 
-    for (i = 0; i < sessionPool->opened; i++) {
-        TEEC_CloseSession(&sessionPool->sessionsInfo[i].session);
+    if (sp->maintainerStarted) {
+        (void)pthread_mutex_lock(&sp->maintainLock);
+        sp->stopping = true;
+        (void)pthread_cond_signal(&sp->maintainCond);
+        (void)pthread_mutex_unlock(&sp->maintainLock);
+        (void)pthread_join(sp->maintainer, NULL);
+    }
+
+    for (i = 0; i < sp->pool.poolSize; i++) {
+        if (sp->slots[i].isOpen) {
+            TEEC_CloseSession(&sp->pool.sessionsInfo[i].session);
+        }
     }
 
-    (void)sem_destroy(&sessionPool->keys);
-    FreeSessionPool(sessionPool);
+    (void)sem_destroy(&sp->pool.keys);
+    (void)pthread_mutex_destroy(&sp->pool.usageLock);
+    (void)pthread_mutex_destroy(&sp->maintainLock);
+    (void)pthread_mutex_destroy(&sp->waitLock);
+    (void)pthread_cond_destroy(&sp->maintainCond);
+    (void)pthread_cond_destroy(&sp->readyCond);
+    FreeSessionPool(sp);
 }
 
 void TEEC_SessionPoolQuery(struct SessionPool *sessionPool, uint32_t *size,
     uint32_t *opened, uint32_t *inuse, bool showBitmap)
 {
-    if (sessionPool == NULL) {
+    struct SessionPoolImpl *sp = PoolImpl(sessionPool);
+
+    if (sp == NULL) {
         return;
     }
 
     if (size != NULL) {
-        *size = sessionPool->poolSize;
+        *size = sp->pool.poolSize;
     }
     if (opened != NULL) {
-        *opened = sessionPool->opened;
+        *opened = sp->pool.opened;
     }
     if (inuse != NULL) {
-        *inuse = sessionPool->inuse;
+        *inuse = CountLoad(&sp->pool.inuse);
+    }
+    if (showBitmap && sp->pool.sessionsInfo != NULL) {
+        DumpSessionInfo(sp);
+    }
+}
+
+TEEC_Result TEEC_SessionPoolSetLimit(struct SessionPool *sessionPool, uint32_t limit)
+{
+    struct SessionPoolImpl *sp = PoolImpl(sessionPool);
+
+    if (sp == NULL || limit < sp->minSize || limit > sp->pool.poolSize) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    (void)pthread_mutex_lock(&sp->maintainLock);
+    uint32_t old = CountLoad(&sp->limit);
+    atomic_store_explicit((volatile atomic_uint *)&sp->limit, limit, memory_order_relaxed);
+    if (limit < old) {
+        (void)pthread_cond_signal(&sp->maintainCond);
+    }
+    (void)pthread_mutex_unlock(&sp->maintainLock);
+    return TEEC_SUCCESS;
+}
+
+void TEEC_SessionPoolGetStats(struct SessionPool *sessionPool, struct SessionPoolStats *stats)
+{
+    struct SessionPoolImpl *sp = PoolImpl(sessionPool);
+
+    if (sp == NULL || stats == NULL) {
+        return;
+    }
+
+    (void)memset_s(stats, sizeof(*stats), 0, sizeof(*stats));
+    (void)pthread_mutex_lock(&sp->pool.usageLock);
+    stats->grown        = sp->stats.grown;
+    stats->shrunk       = sp->stats.shrunk;
+    stats->deaths       = sp->stats.deaths;
+    stats->reopened     = sp->stats.reopened;
+    stats->reopenFailed = sp->stats.reopenFailed;
+    stats->degradedMs   = sp->stats.degradedMs;
+    stats->minSize = sp->minSize;
+    stats->maxSize = sp->pool.poolSize;
+    stats->limit   = CountLoad(&sp->limit);
+    stats->opened  = sp->pool.opened;
+    stats->inuse   = CountLoad(&sp->pool.inuse);
+    stats->acquired    = StatLoad(&sp->stats.acquired);
+    stats->waited      = StatLoad(&sp->stats.waited);
+    stats->waitTotalUs = StatLoad(&sp->stats.waitTotalUs);
+    stats->waitMaxUs   = StatLoad(&sp->stats.waitMaxUs);
+    stats->overTarget  = StatLoad(&sp->stats.overTarget);
+    stats->affinityHits   = StatLoad(&sp->stats.affinityHits);
+    stats->affinityMisses = StatLoad(&sp->stats.affinityMisses);
+    stats->affinityCold   = StatLoad(&sp->stats.affinityCold);
+    for (uint32_t prio = 0; prio < SESSION_POOL_PRIO_NUM; prio++) {
+        const struct SessionPoolClassStats *cls = &sp->stats.classes[prio];
+        stats->classes[prio].acquired = StatLoad(&cls->acquired);
+        stats->classes[prio].expired  = StatLoad(&cls->expired);
+        for (uint32_t i = 0; i < SESSION_POOL_WAIT_BUCKETS; i++) {
+            stats->classes[prio].waitHist[i] = StatLoad(&cls->waitHist[i]);
+        }
+    }
+    stats->dead    = sp->deadCount;
+    if (sp->deadCount > 0) {
+        stats->degradedMs += MonotonicMs() - sp->degradedSinceMs;
+    }
+    (void)pthread_mutex_unlock(&sp->pool.usageLock);
+}
+
+/* dead sessions not closed by the maintainer yet are still counted in opened */
+static uint32_t GetReadyCountLocked(const struct SessionPoolImpl *sp)
+{
+    return sp->pool.opened - (sp->deadCount - sp->healPending);
+}
+
+TEEC_Result TEEC_SessionPoolWaitReady(struct SessionPool *sessionPool, uint32_t count, uint32_t timeoutMs)
+{
+    struct SessionPoolImpl *sp = PoolImpl(sessionPool);
+    struct timespec deadline;
+    TEEC_Result ret = TEEC_SUCCESS;
+
+    if (sp == NULL || count > sp->pool.poolSize) {
+        return TEEC_ERROR_BAD_PARAMETERS;
     }
-    if (showBitmap && sessionPool->sessionsInfo != NULL) {
-        DumpSessionInfo(sessionPool);
+
+    MonotonicDeadline(timeoutMs, &deadline);
+    (void)pthread_mutex_lock(&sp->pool.usageLock);
+    while (GetReadyCountLocked(sp) < count) {
+        if (pthread_cond_timedwait(&sp->readyCond, &sp->pool.usageLock, &deadline) == ETIMEDOUT) {
+            ret = (GetReadyCountLocked(sp) < count) ? (TEEC_Result)TEEC_ERROR_TIMEOUT : TEEC_SUCCESS;
+            break;
+        }
     }
+    (void)pthread_mutex_unlock(&sp->pool.usageLock);
+    return ret;
 }
@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "tee_session_pool_mgr.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <securec.h>
+
+#include "tee_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "libteec_vendor"
+
+#define SESSION_POOL_MGR_INTERVAL_MS 1000
+#define MS_PER_SEC 1000
+#define NS_PER_MS  1000000
+#define NS_PER_SEC 1000000000
+
+struct PoolEntry {
+    TEEC_UUID uuid;
+    struct SessionPool *pool;
+    uint32_t minSize;
+    uint32_t maxSize;
+    uint64_t lastWaited;          /* stats.waited seen by the previous rebalance */
+};
+
+struct SessionPoolManager {
+    TEEC_Context *context;
+    uint32_t budget;
+    uint32_t intervalMs;
+    struct PoolEntry entries[SESSION_POOL_MGR_TA_MAX];
+    uint32_t entryNum;            /* entries are only appended, published with a release store */
+    uint32_t reservedMin;         /* sum of minSize of all pools */
+    uint64_t rebalances;
+    pthread_mutex_t lock;         /* serializes adding pools, rebalancing and stopping */
+    pthread_cond_t cond;
+    pthread_t rebalancer;
+    bool started;
+    bool stopping;
+};
+
+static uint32_t EntryNum(const struct SessionPoolManager *mgr)
+{
+    return atomic_load_explicit((volatile atomic_uint *)&mgr->entryNum, memory_order_acquire);
+}
+
+static struct PoolEntry *FindEntry(struct SessionPoolManager *mgr, const TEEC_UUID *destination)
+{
+    uint32_t num = EntryNum(mgr);
+
+    for (uint32_t i = 0; i < num; i++) {
+        if (memcmp(&mgr->entries[i].uuid, destination, sizeof(*destination)) == 0) {
+            return &mgr->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t MaxU32(uint32_t a, uint32_t b)
+{
+    return (a > b) ? a : b;
+}
+
+/* give the spare budget away one session at a time to the pool with most demand per extra session */
+static void SplitSpareBudget(const struct SessionPoolManager *mgr, const uint64_t *demand, uint32_t *target)
+{
+    uint32_t spare = mgr->budget - mgr->reservedMin;
+
+    for (; spare > 0; spare--) {
+        int32_t best = -1;
+        for (uint32_t i = 0; i < mgr->entryNum; i++) {
+            const struct PoolEntry *e = &mgr->entries[i];
+            if (demand[i] == 0 || target[i] >= e->maxSize) {
+                continue;
+            }
+            uint64_t extra = target[i] - e->minSize + 1;
+            if (best < 0 ||
+                demand[i] * (target[best] - mgr->entries[best].minSize + 1) > demand[best] * extra) {
+                best = (int32_t)i;
+            }
+        }
+        if (best < 0) {
+            return;
+        }
+        target[best]++;
+    }
+}
+
+/*
+ * Called with mgr->lock held. Demand of a pool is its sessions in use plus
+ * the callers that had to wait since the last round. Limits are lowered
+ * first, a raised limit only takes budget that the other pools do not hold,
+ * so sessions above a lowered limit are given back before they are reused.
+ */
+static void RebalancePoolsLocked(struct SessionPoolManager *mgr)
+{
+    uint64_t demand[SESSION_POOL_MGR_TA_MAX];
+    uint32_t target[SESSION_POOL_MGR_TA_MAX];
+    uint32_t opened[SESSION_POOL_MGR_TA_MAX];
+    uint32_t limit[SESSION_POOL_MGR_TA_MAX];
+    struct SessionPoolStats stats;
+    uint64_t demandSum = 0;
+    bool changed = false;
+
+    for (uint32_t i = 0; i < mgr->entryNum; i++) {
+        struct PoolEntry *e = &mgr->entries[i];
+        TEEC_SessionPoolGetStats(e->pool, &stats);
+        demand[i] = stats.inuse + (stats.waited - e->lastWaited);
+        e->lastWaited = stats.waited;
+        target[i] = e->minSize;
+        limit[i] = stats.limit;
+        opened[i] = stats.opened;
+        demandSum += demand[i];
+    }
+    /* nobody is busy, leave the limits where the last demand put them */
+    if (demandSum == 0) {
+        return;
+    }
+    SplitSpareBudget(mgr, demand, target);
+
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < mgr->entryNum; i++) {
+        if (target[i] < limit[i] && TEEC_SessionPoolSetLimit(mgr->entries[i].pool, target[i]) == TEEC_SUCCESS) {
+            limit[i] = target[i];
+            changed = true;
+        }
+        used += MaxU32(opened[i], limit[i]);
+    }
+    for (uint32_t i = 0; i < mgr->entryNum && used < mgr->budget; i++) {
+        if (target[i] <= limit[i]) {
+            continue;
+        }
+        uint32_t raise = target[i] - limit[i];
+        if (raise > mgr->budget - used) {
+            raise = mgr->budget - used;
+        }
+        if (TEEC_SessionPoolSetLimit(mgr->entries[i].pool, limit[i] + raise) == TEEC_SUCCESS) {
+            used += raise;
+            changed = true;
+        }
+    }
+    if (changed) {
+        mgr->rebalances++;
+    }
+}
+
+static void *RebalancerFn(void *data)
+{
+    struct SessionPoolManager *mgr = (struct SessionPoolManager *)data;
+    struct timespec deadline;
+
+    (void)pthread_mutex_lock(&mgr->lock);
+    while (!mgr->stopping) {
+        RebalancePoolsLocked(mgr);
+
+        (void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += mgr->intervalMs / MS_PER_SEC;
+        deadline.tv_nsec += (long)(mgr->intervalMs % MS_PER_SEC) * NS_PER_MS;
+        if (deadline.tv_nsec >= NS_PER_SEC) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= NS_PER_SEC;
+        }
+        if (!mgr->stopping) {
+            (void)pthread_cond_timedwait(&mgr->cond, &mgr->lock, &deadline);
+        }
+    }
+    (void)pthread_mutex_unlock(&mgr->lock);
+    return NULL;
+}
+
+TEEC_Result TEEC_SessionPoolManagerCreate(TEEC_Context *context, const struct SessionPoolManagerConfig *config,
+    struct SessionPoolManager **manager)
+{
+    pthread_condattr_t attr;
+
+    if (context == NULL || config == NULL || manager == NULL || config->budget == 0) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    struct SessionPoolManager *mgr = (struct SessionPoolManager *)malloc(sizeof(*mgr));
+    if (mgr == NULL) {
+        tloge("alloc session pool manager failed\n");
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+    (void)memset_s(mgr, sizeof(*mgr), 0, sizeof(*mgr));
+    mgr->context = context;
+    mgr->budget = config->budget;
+    mgr->intervalMs = (config->rebalanceIntervalMs == 0) ? SESSION_POOL_MGR_INTERVAL_MS : config->rebalanceIntervalMs;
+
+    (void)pthread_mutex_init(&mgr->lock, NULL);
+    (void)pthread_condattr_init(&attr);
+    (void)pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    (void)pthread_cond_init(&mgr->cond, &attr);
+    (void)pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&mgr->rebalancer, NULL, &RebalancerFn, mgr) != 0) {
+        tloge("create rebalancer failed, error = %d\n", errno);
+        TEEC_SessionPoolManagerDestroy(mgr);
+        return TEEC_ERROR_GENERIC;
+    }
+    mgr->started = true;
+
+    *manager = mgr;
+    return TEEC_SUCCESS;
+}
+
+/* lower the limits of the other pools so that need more sessions fit into the budget */
+static void ReleaseBudgetLocked(struct SessionPoolManager *mgr, uint32_t need)
+{
+    struct SessionPoolStats stats;
+    uint32_t limit[SESSION_POOL_MGR_TA_MAX];
+    uint32_t used = 0;
+
+    for (uint32_t i = 0; i < mgr->entryNum; i++) {
+        TEEC_SessionPoolGetStats(mgr->entries[i].pool, &stats);
+        limit[i] = stats.limit;
+        used += stats.limit;
+    }
+    for (uint32_t i = 0; i < mgr->entryNum && used + need > mgr->budget; i++) {
+        uint32_t cut = limit[i] - mgr->entries[i].minSize;
+        if (cut > used + need - mgr->budget) {
+            cut = used + need - mgr->budget;
+        }
+        if (cut > 0 && TEEC_SessionPoolSetLimit(mgr->entries[i].pool, limit[i] - cut) == TEEC_SUCCESS) {
+            used -= cut;
+        }
+    }
+}
+
+TEEC_Result TEEC_SessionPoolManagerAddTa(struct SessionPoolManager *manager, const TEEC_UUID *destination,
+    const struct SessionPoolConfig *config)
+{
+    struct SessionPool *pool = NULL;
+    TEEC_Result ret;
+
+    if (manager == NULL || destination == NULL || config == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    (void)pthread_mutex_lock(&manager->lock);
+    if (FindEntry(manager, destination) != NULL) {
+        ret = TEEC_ERROR_ACCESS_CONFLICT;
+        goto END;
+    }
+    if (manager->entryNum == SESSION_POOL_MGR_TA_MAX) {
+        tloge("session pool manager already serves %d TAs\n", SESSION_POOL_MGR_TA_MAX);
+        ret = TEEC_ERROR_OUT_OF_MEMORY;
+        goto END;
+    }
+    if (config->minSize > manager->budget - manager->reservedMin) {
+        tloge("minSize %u exceeds the session budget left %u\n", config->minSize,
+            manager->budget - manager->reservedMin);
+        ret = TEEC_ERROR_OUT_OF_MEMORY;
+        goto END;
+    }
+
+    ReleaseBudgetLocked(manager, config->minSize);
+    ret = TEEC_SessionPoolCreateWithConfig(manager->context, destination, config, &pool);
+    if (ret != TEEC_SUCCESS) {
+        tloge("create session pool failed, ret = 0x%x\n", ret);
+        goto END;
+    }
+    (void)TEEC_SessionPoolSetLimit(pool, config->minSize);
+
+    struct PoolEntry *e = &manager->entries[manager->entryNum];
+    e->uuid = *destination;
+    e->pool = pool;
+    e->minSize = config->minSize;
+    e->maxSize = config->maxSize;
+    e->lastWaited = 0;
+    manager->reservedMin += config->minSize;
+    atomic_store_explicit((volatile atomic_uint *)&manager->entryNum, manager->entryNum + 1, memory_order_release);
+
+END:
+    (void)pthread_mutex_unlock(&manager->lock);
+    return ret;
+}
+
+TEEC_Result TEEC_SessionPoolManagerInvokeWithPriority(struct SessionPoolManager *manager,
+    const TEEC_UUID *destination, uint32_t priority, uint32_t timeoutMs, uint32_t commandID,
+    TEEC_Operation *operation, uint32_t *returnOrigin)
+{
+    if (manager == NULL || destination == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    struct PoolEntry *e = FindEntry(manager, destination);
+    if (e == NULL) {
+        tloge("no session pool for the TA\n");
+        return TEEC_ERROR_ITEM_NOT_FOUND;
+    }
+    return TEEC_SessionPoolInvokeWithPriority(e->pool, priority, timeoutMs, commandID, operation, returnOrigin);
+}
+
+TEEC_Result TEEC_SessionPoolManagerInvoke(struct SessionPoolManager *manager, const TEEC_UUID *destination,
+    uint32_t commandID, TEEC_Operation *operation, uint32_t *returnOrigin)
+{
+    return TEEC_SessionPoolManagerInvokeWithPriority(manager, destination, SESSION_POOL_PRIO_NORMAL, 0,
+        commandID, operation, returnOrigin);
+}
+
+struct SessionPool *TEEC_SessionPoolManagerGetPool(struct SessionPoolManager *manager, const TEEC_UUID *destination)
+{
+    if (manager == NULL || destination == NULL) {
+        return NULL;
+    }
+    struct PoolEntry *e = FindEntry(manager, destination);
+    return (e == NULL) ? NULL : e->pool;
+}
+
+void TEEC_SessionPoolManagerGetStats(struct SessionPoolManager *manager, struct SessionPoolManagerStats *stats)
+{
+    struct SessionPoolStats poolStats;
+
+    if (manager == NULL || stats == NULL) {
+        return;
+    }
+
+    (void)memset_s(stats, sizeof(*stats), 0, sizeof(*stats));
+    (void)pthread_mutex_lock(&manager->lock);
+    stats->budget = manager->budget;
+    stats->poolNum = manager->entryNum;
+    stats->rebalances = manager->rebalances;
+    for (uint32_t i = 0; i < manager->entryNum; i++) {
+        TEEC_SessionPoolGetStats(manager->entries[i].pool, &poolStats);
+        stats->reserved += poolStats.limit;
+        stats->opened += poolStats.opened;
+    }
+    (void)pthread_mutex_unlock(&manager->lock);
+}
+
+/* caller guarantees no invoke is running */
+void TEEC_SessionPoolManagerDestroy(struct SessionPoolManager *manager)
+{
+    if (manager == NULL) {
+        return;
+    }
+
+    if (manager->started) {
+        (void)pthread_mutex_lock(&manager->lock);
+        manager->stopping = true;
+        (void)pthread_cond_signal(&manager->cond);
+        (void)pthread_mutex_unlock(&manager->lock);
+        (void)pthread_join(manager->rebalancer, NULL);
+    }
+
+    for (uint32_t i = 0; i < manager->entryNum; i++) {
+        TEEC_SessionPoolDestroy(manager->entries[i].pool);
+    }
+    (void)pthread_mutex_destroy(&manager->lock);
+    (void)pthread_cond_destroy(&manager->cond);
+    free(manager);
+}
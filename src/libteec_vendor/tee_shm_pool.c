@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "tee_shm_pool.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <securec.h>
+
+#include "tee_client_constants.h"
+#include "tee_client_inner.h"
+#include "tee_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "libteec_vendor"
+
+#define SHM_POOL_CLASS_MAX        16
+#define SHM_POOL_DEFAULT_MIN_SIZE 0x1000
+#define SHM_POOL_DEFAULT_MAX_SIZE 0x100000
+#define SHM_POOL_DEFAULT_CACHED   16
+#define SHM_POOL_CACHED_MAX       1024
+#define HUGE_PAGE_SIZE            0x200000
+
+struct ShmPoolClass {
+    pthread_mutex_t lock;
+    uint32_t size;   /* buffer size of this class */
+    uint32_t count;  /* idle buffers in buffers[] */
+    void **buffers;
+};
+
+struct ShmPool {
+    atomic_uint refs;   /* one for the owning context, one per buffer handed out */
+    uint32_t classNum;
+    uint32_t maxCached; /* idle buffers kept per class */
+    uint32_t flags;     /* TEEC_SharedMemPoolFlag */
+    struct ShmPoolClass classes[SHM_POOL_CLASS_MAX];
+    atomic_ullong hits;
+    atomic_ullong misses;
+    atomic_ullong bypassed;
+    atomic_ullong recycled;
+    atomic_ullong trimmed;
+};
+
+static uint32_t RoundUpPowerOfTwo(uint32_t size)
+{
+    uint32_t value = 1;
+    while (value < size && value <= (UINT32_MAX >> 1)) {
+        value <<= 1;
+    }
+    return value;
+}
+
+/* fresh anonymous mappings are zero filled, MAP_POPULATE faults them in up front */
+static void *MapPoolBuffer(const struct ShmPool *pool, uint32_t size)
+{
+    void *buffer = MAP_FAILED;
+
+    if ((pool->flags & TEEC_SHM_POOL_HUGEPAGE) != 0 && (size % HUGE_PAGE_SIZE) == 0) {
+        buffer = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE | MAP_HUGETLB, -1, 0);
+        if (buffer == MAP_FAILED) {
+            tlogd("no hugepage for shm pool class 0x%x, fall back to normal pages\n", size);
+        }
+    }
+    if (buffer == MAP_FAILED) {
+        buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    }
+    return (buffer == MAP_FAILED) ? NULL : buffer;
+}
+
+static TEEC_Result CheckPoolConfig(const TEEC_SharedMemPoolConfig *config, uint32_t *minSize, uint32_t *maxSize,
+    uint32_t *maxCached)
+{
+    *minSize   = (config->minSize == 0) ? SHM_POOL_DEFAULT_MIN_SIZE : RoundUpPowerOfTwo(config->minSize);
+    *maxSize   = (config->maxSize == 0) ? SHM_POOL_DEFAULT_MAX_SIZE : RoundUpPowerOfTwo(config->maxSize);
+    *maxCached = (config->maxCachedPerClass == 0) ? SHM_POOL_DEFAULT_CACHED : config->maxCachedPerClass;
+
+    if (*minSize < (uint32_t)PAGE_SIZE) {
+        *minSize = (uint32_t)PAGE_SIZE;
+    }
+    bool invalid = (*maxSize < *minSize) || (*maxSize > MAX_SHAREDMEM_LEN) ||
+        (*maxCached > SHM_POOL_CACHED_MAX) || (config->warmCountPerClass > *maxCached);
+    if (invalid) {
+        tloge("invalid shm pool config, min 0x%x max 0x%x cached %u\n", *minSize, *maxSize, *maxCached);
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t classNum = 1;
+    for (uint32_t size = *minSize; size < *maxSize; size <<= 1) {
+        classNum++;
+    }
+    if (classNum > SHM_POOL_CLASS_MAX) {
+        tloge("shm pool spans %u size classes, at most %d supported\n", classNum, SHM_POOL_CLASS_MAX);
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+    return TEEC_SUCCESS;
+}
+
+static void WarmPoolClass(const struct ShmPool *pool, struct ShmPoolClass *poolClass, uint32_t warmCount)
+{
+    while (poolClass->count < warmCount) {
+        void *buffer = MapPoolBuffer(pool, poolClass->size);
+        if (buffer == NULL) {
+            tloge("warm shm pool class 0x%x failed\n", poolClass->size);
+            return;
+        }
+        poolClass->buffers[poolClass->count++] = buffer;
+    }
+}
+
+struct ShmPool *ShmPoolCreate(const TEEC_SharedMemPoolConfig *config)
+{
+    uint32_t minSize, maxSize, maxCached;
+
+    if (config == NULL || CheckPoolConfig(config, &minSize, &maxSize, &maxCached) != TEEC_SUCCESS) {
+        return NULL;
+    }
+
+    struct ShmPool *pool = (struct ShmPool *)malloc(sizeof(*pool));
+    if (pool == NULL) {
+        tloge("alloc shm pool failed\n");
+        return NULL;
+    }
+    (void)memset_s(pool, sizeof(*pool), 0, sizeof(*pool));
+    pool->maxCached = maxCached;
+    pool->flags     = config->flags;
+    atomic_init(&pool->refs, 1);
+    atomic_init(&pool->hits, 0);
+    atomic_init(&pool->misses, 0);
+    atomic_init(&pool->bypassed, 0);
+    atomic_init(&pool->recycled, 0);
+    atomic_init(&pool->trimmed, 0);
+
+    for (uint32_t size = minSize; size <= maxSize; size <<= 1) {
+        struct ShmPoolClass *poolClass = &pool->classes[pool->classNum];
+        poolClass->buffers = (void **)malloc(sizeof(void *) * maxCached);
+        if (poolClass->buffers == NULL) {
+            tloge("alloc shm pool class failed\n");
+            ShmPoolDestroy(pool);
+            return NULL;
+        }
+        (void)pthread_mutex_init(&poolClass->lock, NULL);
+        poolClass->size = size;
+        pool->classNum++;
+        WarmPoolClass(pool, poolClass, config->warmCountPerClass);
+    }
+    return pool;
+}
+
+static void ReleasePool(struct ShmPool *pool)
+{
+    for (uint32_t i = 0; i < pool->classNum; i++) {
+        struct ShmPoolClass *poolClass = &pool->classes[i];
+        for (uint32_t j = 0; j < poolClass->count; j++) {
+            (void)munmap(poolClass->buffers[j], poolClass->size);
+        }
+        free(poolClass->buffers);
+        (void)pthread_mutex_destroy(&poolClass->lock);
+    }
+    free(pool);
+}
+
+static void PutPool(struct ShmPool *pool)
+{
+    if (atomic_fetch_sub_explicit(&pool->refs, 1, memory_order_acq_rel) == 1) {
+        ReleasePool(pool);
+    }
+}
+
+void ShmPoolDestroy(struct ShmPool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    PutPool(pool);
+}
+
+void *ShmPoolAlloc(struct ShmPool *pool, uint32_t size, uint32_t *poolClass)
+{
+    *poolClass = SHM_POOL_NO_CLASS;
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    uint32_t idx = 0;
+    while (idx < pool->classNum && pool->classes[idx].size < size) {
+        idx++;
+    }
+    if (idx == pool->classNum) {
+        (void)atomic_fetch_add_explicit(&pool->bypassed, 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    /* the buffer keeps the pool alive, its owner may drop the pool before the buffer comes back */
+    (void)atomic_fetch_add_explicit(&pool->refs, 1, memory_order_relaxed);
+    struct ShmPoolClass *cls = &pool->classes[idx];
+    void *buffer = NULL;
+    if (pthread_mutex_lock(&cls->lock) == 0) {
+        if (cls->count > 0) {
+            buffer = cls->buffers[--cls->count];
+        }
+        (void)pthread_mutex_unlock(&cls->lock);
+    }
+
+    if (buffer != NULL) {
+        (void)atomic_fetch_add_explicit(&pool->hits, 1, memory_order_relaxed);
+        /* a recycled buffer still holds the previous request, only the part handed out is cleared */
+        if ((pool->flags & TEEC_SHM_POOL_SKIP_ZERO) == 0 && memset_s(buffer, cls->size, 0, size) != EOK) {
+            ShmPoolFree(pool, buffer, idx + 1);
+            return NULL;
+        }
+    } else {
+        (void)atomic_fetch_add_explicit(&pool->misses, 1, memory_order_relaxed);
+        buffer = MapPoolBuffer(pool, cls->size);
+        if (buffer == NULL) {
+            tloge("map shm pool buffer of 0x%x failed\n", cls->size);
+            PutPool(pool);
+            return NULL;
+        }
+    }
+
+    *poolClass = idx + 1;
+    return buffer;
+}
+
+void ShmPoolFree(struct ShmPool *pool, void *buffer, uint32_t poolClass)
+{
+    if (pool == NULL || buffer == NULL || poolClass == SHM_POOL_NO_CLASS || poolClass > pool->classNum) {
+        return;
+    }
+
+    struct ShmPoolClass *cls = &pool->classes[poolClass - 1];
+    if (pthread_mutex_lock(&cls->lock) == 0) {
+        if (cls->count < pool->maxCached) {
+            cls->buffers[cls->count++] = buffer;
+            buffer = NULL;
+        }
+        (void)pthread_mutex_unlock(&cls->lock);
+    }
+
+    if (buffer == NULL) {
+        (void)atomic_fetch_add_explicit(&pool->recycled, 1, memory_order_relaxed);
+    } else {
+        (void)munmap(buffer, cls->size);
+        (void)atomic_fetch_add_explicit(&pool->trimmed, 1, memory_order_relaxed);
+    }
+    PutPool(pool);
+}
+
+void ShmPoolGetStats(struct ShmPool *pool, TEEC_SharedMemPoolStats *stats)
+{
+    (void)memset_s(stats, sizeof(*stats), 0, sizeof(*stats));
+    if (pool == NULL) {
+        return;
+    }
+
+    stats->enabled  = true;
+    stats->hits     = atomic_load_explicit(&pool->hits, memory_order_relaxed);
+    stats->misses   = atomic_load_explicit(&pool->misses, memory_order_relaxed);
+    stats->bypassed = atomic_load_explicit(&pool->bypassed, memory_order_relaxed);
+    stats->recycled = atomic_load_explicit(&pool->recycled, memory_order_relaxed);
+    stats->trimmed  = atomic_load_explicit(&pool->trimmed, memory_order_relaxed);
+    for (uint32_t i = 0; i < pool->classNum; i++) {
+        struct ShmPoolClass *cls = &pool->classes[i];
+        if (pthread_mutex_lock(&cls->lock) != 0) {
+            continue;
+        }
+        stats->cachedBuffers += cls->count;
+        stats->cachedBytes += (uint64_t)cls->count * cls->size;
+        (void)pthread_mutex_unlock(&cls->lock);
+    }
+}
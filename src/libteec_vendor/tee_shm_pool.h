@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2024-2024. All rights reserved.
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#ifndef LIBTEEC_TEE_SHM_POOL_H
+#define LIBTEEC_TEE_SHM_POOL_H
+
+#include <stdint.h>
+#include "tee_client_type.h"
+
+#define SHM_POOL_NO_CLASS 0 /* buffer was not taken from a pool */
+
+struct ShmPool;
+
+struct ShmPool *ShmPoolCreate(const TEEC_SharedMemPoolConfig *config);
+/*
+ * drop the creator's reference, every buffer taken by ShmPoolAlloc holds one more,
+ * so the pool is only unmapped and freed once the last of them is returned
+ */
+void ShmPoolDestroy(struct ShmPool *pool);
+
+/*
+ * take a buffer of at least size bytes from the pool, *poolClass is set to the
+ * class it must be returned to, or SHM_POOL_NO_CLASS when the pool cannot serve
+ * the request and the caller has to allocate by itself
+ */
+void *ShmPoolAlloc(struct ShmPool *pool, uint32_t size, uint32_t *poolClass);
+/* return a buffer to the pool it was taken from, which may already be destroyed by its owner */
+void ShmPoolFree(struct ShmPool *pool, void *buffer, uint32_t poolClass);
+void ShmPoolGetStats(struct ShmPool *pool, TEEC_SharedMemPoolStats *stats);
+
+#endif
@@ -37,23 +37,62 @@
 
 static int32_t CopyFile(const char *fromPath, const char *toPath);
 
-/* record the current g_userId and g_storageId */
-static uint32_t g_userId;
-static uint32_t g_storageId;
+#ifdef CONFIG_FS_AGENT_WORKERS
+#define FS_AGENT_WORKERS CONFIG_FS_AGENT_WORKERS
+#else
+#define FS_AGENT_WORKERS 1
+#endif
+#if FS_AGENT_WORKERS < 1 || FS_AGENT_WORKERS > 16
+#error "CONFIG_FS_AGENT_WORKERS must be in 1..16"
+#endif
+#define FS_PATH_LOCK_NUM 16
+
+/*
+ * record the current g_userId and g_storageId, every worker serves one
+ * request at a time so they are kept per thread
+ */
+static __thread uint32_t g_userId;
+static __thread uint32_t g_storageId;
+
+/*
+ * Each worker waits for fs requests on its own agent fd with its own control
+ * buffer. Worker 0 is the agent registered by FsAgentInit, the others only
+ * exist when the driver accepts more than one instance of the fs agent.
+ */
+struct FsWorker {
+    int fd;
+    struct SecStorageType *control;
+    pthread_t thread;
+    bool started;
+};
+
+static struct FsWorker g_fsWorkers[FS_AGENT_WORKERS];
+static uint32_t g_fsWorkerNum = 0;
 
-/* agentfd & agent control */
-static int g_fsAgentFd = -1;
-static struct SecStorageType *g_fsAgentControl = NULL;
-static pthread_t g_fsThread = ULONG_MAX;
+/* requests naming the same path are serialized by the lock its name hashes to */
+static pthread_mutex_t g_pathLocks[FS_PATH_LOCK_NUM];
 
 int GetFsAgentFd(void)
 {
-    return g_fsAgentFd;
+    return (g_fsWorkerNum == 0) ? -1 : g_fsWorkers[0].fd;
 }
 
 void *GetFsAgentControl(void)
 {
-    return g_fsAgentControl;
+    return (g_fsWorkerNum == 0) ? NULL : g_fsWorkers[0].control;
+}
+
+static void RegisterFsWorkers(uint32_t bufferSize)
+{
+    while (g_fsWorkerNum < FS_AGENT_WORKERS) {
+        struct FsWorker *worker = &g_fsWorkers[g_fsWorkerNum];
+        worker->fd = AgentInit(AGENT_FS_ID, bufferSize, (void **)(&worker->control));
+        if (worker->fd < 0) {
+            tlogi("fs agent instance %u refused by driver, run with %u workers\n", g_fsWorkerNum, g_fsWorkerNum);
+            return;
+        }
+        g_fsWorkerNum++;
+    }
 }
 
 int FsAgentInit(void)
@@ -78,31 +117,49 @@ int FsAgentInit(void)
     }
     (void)close(fd);
 
-    g_fsAgentFd = AgentInit(AGENT_FS_ID, bufferSize, (void **)(&g_fsAgentControl));
-    if (g_fsAgentFd < 0) {
+    g_fsWorkers[0].fd = AgentInit(AGENT_FS_ID, bufferSize, (void **)(&g_fsWorkers[0].control));
+    if (g_fsWorkers[0].fd < 0) {
         tloge("fs agent init failed\n");
         return -1;
     }
+    g_fsWorkerNum = 1;
+    RegisterFsWorkers(bufferSize);
+
+    for (uint32_t i = 0; i < FS_PATH_LOCK_NUM; i++) {
+        (void)pthread_mutex_init(&g_pathLocks[i], NULL);
+    }
     return 0;
 }
 
 void FsAgentThreadCreate(void)
 {
     SetFileNumLimit();
-    (void)pthread_create(&g_fsThread, NULL, FsWorkThread, g_fsAgentControl);
+    for (uint32_t i = 0; i < g_fsWorkerNum; i++) {
+        struct FsWorker *worker = &g_fsWorkers[i];
+        worker->started = (pthread_create(&worker->thread, NULL, FsWorkThread, worker) == 0);
+        if (!worker->started) {
+            tloge("create fs worker %u failed\n", i);
+        }
+    }
 }
 
 void FsAgentThreadJoin(void)
 {
-    (void)pthread_join(g_fsThread, NULL);
+    for (uint32_t i = 0; i < g_fsWorkerNum; i++) {
+        if (g_fsWorkers[i].started) {
+            (void)pthread_join(g_fsWorkers[i].thread, NULL);
+            g_fsWorkers[i].started = false;
+        }
+    }
 }
 
 void FsAgentExit(void)
 {
-    if (g_fsAgentFd >= 0) {
-        AgentExit(AGENT_FS_ID, g_fsAgentFd);
-        g_fsAgentFd = -1;
-        g_fsAgentControl = NULL;
+    while (g_fsWorkerNum > 0) {
+        struct FsWorker *worker = &g_fsWorkers[--g_fsWorkerNum];
+        AgentExit(AGENT_FS_ID, worker->fd);
+        worker->fd = -1;
+        worker->control = NULL;
     }
 }
 
@@ -129,87 +186,380 @@ int32_t IsUserDataReady(void)
     return 1;
 }
 
-/* open file list head */
-static struct OpenedFile *g_firstFile = NULL;
+static uint32_t PathLockIndex(const char *path)
+{
+    uint32_t hash = 2166136261U; /* FNV-1a */
+    for (; *path != '\0'; path++) {
+        hash = (hash ^ (uint8_t)*path) * 16777619U;
+    }
+    return hash % FS_PATH_LOCK_NUM;
+}
 
-/* add to tail */
-static int32_t AddOpenFile(FILE *pFile)
+/* path2 may be NULL, two locks are always taken in index order */
+static void LockPaths(const char *path, const char *path2)
 {
-    struct OpenedFile *newFile = malloc(sizeof(struct OpenedFile));
-    if (newFile == NULL) {
-        tloge("malloc OpenedFile failed\n");
+    uint32_t first = PathLockIndex(path);
+    uint32_t second = (path2 == NULL) ? first : PathLockIndex(path2);
+
+    if (first > second) {
+        uint32_t tmp = first;
+        first = second;
+        second = tmp;
+    }
+    (void)pthread_mutex_lock(&g_pathLocks[first]);
+    if (second != first) {
+        (void)pthread_mutex_lock(&g_pathLocks[second]);
+    }
+}
+
+static void UnlockPaths(const char *path, const char *path2)
+{
+    uint32_t first = PathLockIndex(path);
+    uint32_t second = (path2 == NULL) ? first : PathLockIndex(path2);
+
+    if (second != first) {
+        (void)pthread_mutex_unlock(&g_pathLocks[second]);
+    }
+    (void)pthread_mutex_unlock(&g_pathLocks[first]);
+}
+
+static void LockAllPaths(void)
+{
+    for (uint32_t i = 0; i < FS_PATH_LOCK_NUM; i++) {
+        (void)pthread_mutex_lock(&g_pathLocks[i]);
+    }
+}
+
+static void UnlockAllPaths(void)
+{
+    for (uint32_t i = FS_PATH_LOCK_NUM; i > 0; i--) {
+        (void)pthread_mutex_unlock(&g_pathLocks[i - 1]);
+    }
+}
+
+#ifdef CONFIG_FS_AGENT_STDIO
+/* stdio backend, data goes through the FILE buffer of libc */
+static int32_t FsFileOpen(struct OpenedFile *file, const char *path, const char *mode)
+{
+    file->file = fopen(path, mode);
+    if (file->file == NULL) {
         return -1;
     }
-    newFile->file = pFile;
+    file->fd = fileno(file->file);
+    return 0;
+}
 
-    if (g_firstFile == NULL) {
-        g_firstFile   = newFile;
-        newFile->next = newFile;
-        newFile->prev = newFile;
-    } else {
-        if (g_firstFile->prev == NULL) {
-            tloge("the tail is null\n");
-            free(newFile);
+static size_t FsFileRead(struct OpenedFile *file, void *buf, size_t count, bool *eof)
+{
+    size_t done = fread(buf, 1, count, file->file);
+    *eof = (feof(file->file) != 0);
+    return done;
+}
+
+static size_t FsFileWrite(struct OpenedFile *file, const void *buf, size_t count)
+{
+    return fwrite(buf, 1, count, file->file);
+}
+
+static int32_t FsFileFlush(struct OpenedFile *file)
+{
+    return fflush(file->file);
+}
+
+static int32_t FsFileSeek(struct OpenedFile *file, int32_t offset, int32_t whence)
+{
+    return fseek(file->file, offset, whence);
+}
+
+static long FsFileTell(struct OpenedFile *file)
+{
+    return ftell(file->file);
+}
+
+static int32_t FsFileClose(struct OpenedFile *file)
+{
+    return fclose(file->file);
+}
+#else
+/*
+ * fd backend, the agent keeps the file position itself and reads and writes
+ * go straight between the control buffer and the kernel with pread/pwrite
+ */
+#define FS_FILE_CREATE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) /* as fopen */
+
+/* translate an fopen mode, 'b' means nothing on linux */
+static int32_t FsModeToFlags(const char *mode, bool *append)
+{
+    int32_t flags;
+    bool update = false;
+
+    switch (mode[0]) {
+        case 'r':
+            flags = 0;
+            break;
+        case 'w':
+            flags = O_CREAT | O_TRUNC;
+            break;
+        case 'a':
+            flags = O_CREAT | O_APPEND;
+            *append = true;
+            break;
+        default:
             return -1;
+    }
+    for (uint32_t i = 1; i < KINDS_OF_SSA_MODE && mode[i] != '\0'; i++) {
+        if (mode[i] == '+') {
+            update = true;
+        } else if (mode[i] == 'x') {
+            flags |= O_EXCL;
+        } else if (mode[i] == 'e') {
+            flags |= O_CLOEXEC;
         }
-        g_firstFile->prev->next = newFile;
-        newFile->prev           = g_firstFile->prev;
-        newFile->next           = g_firstFile;
-        g_firstFile->prev       = newFile;
     }
+    if (update) {
+        flags |= O_RDWR;
+    } else {
+        flags |= (mode[0] == 'r') ? O_RDONLY : O_WRONLY;
+    }
+    return flags;
+}
+
+static int32_t FsFileOpen(struct OpenedFile *file, const char *path, const char *mode)
+{
+    int32_t flags = FsModeToFlags(mode, &file->append);
+    if (flags < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    file->fd = open(path, flags, FS_FILE_CREATE_MODE);
+    if (file->fd < 0) {
+        return -1;
+    }
+    file->pos = 0;
     return 0;
 }
 
-static void DelOpenFile(struct OpenedFile *file)
+static size_t FsFileRead(struct OpenedFile *file, void *buf, size_t count, bool *eof)
 {
-    struct OpenedFile *next = NULL;
+    size_t done = 0;
 
-    if (file == NULL) {
-        return;
+    *eof = false;
+    while (done < count) {
+        ssize_t n = pread(file->fd, (char *)buf + done, count - done, (off_t)(file->pos + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            *eof = (n == 0);
+            break;
+        }
+        done += (size_t)n;
     }
-    next = file->next;
+    file->pos += done;
+    return done;
+}
 
-    if (file == next) { /* only 1 node */
-        g_firstFile = NULL;
-    } else {
-        if (file->next == NULL || file->prev == NULL) {
-            tloge("the next or the prev is null\n");
-            return;
+static size_t FsFileWrite(struct OpenedFile *file, const void *buf, size_t count)
+{
+    size_t done = 0;
+    struct stat st;
+
+    /* O_APPEND writes land at the end whatever the offset, the position follows them */
+    if (file->append) {
+        if (fstat(file->fd, &st) != 0) {
+            return 0;
+        }
+        file->pos = (uint64_t)st.st_size;
+    }
+    while (done < count) {
+        ssize_t n = pwrite(file->fd, (const char *)buf + done, count - done, (off_t)(file->pos + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
         }
-        if (file == g_firstFile) {
-            g_firstFile = file->next;
+        if (n <= 0) {
+            break;
         }
-        next->prev       = file->prev;
-        file->prev->next = next;
+        done += (size_t)n;
     }
+    file->pos += done;
+    return done;
 }
 
-static int32_t FindOpenFile(int32_t fd, struct OpenedFile **file)
+/* nothing is buffered in user space */
+static int32_t FsFileFlush(struct OpenedFile *file)
 {
-    struct OpenedFile *p = g_firstFile;
-    int32_t findFlag     = 0;
+    (void)file;
+    return 0;
+}
 
-    if (p == NULL) {
-        return findFlag;
-    }
+/* same rules as fseek: the position may pass the end but not go below 0 */
+static int32_t FsFileSeek(struct OpenedFile *file, int32_t offset, int32_t whence)
+{
+    int64_t base;
+    struct stat st;
 
-    do {
-        if (p->file != NULL) {
-            if (fileno(p->file) == fd) {
-                findFlag = 1;
-                break;
+    switch (whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = (int64_t)file->pos;
+            break;
+        case SEEK_END:
+            if (fstat(file->fd, &st) != 0) {
+                return -1;
             }
-        }
-        p = p->next;
-    } while (p != g_firstFile && p != NULL);
+            base = (int64_t)st.st_size;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+    if (base + offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    file->pos = (uint64_t)(base + offset);
+    return 0;
+}
+
+static long FsFileTell(struct OpenedFile *file)
+{
+    return (long)file->pos;
+}
 
-    if (findFlag == 0) {
-        p = NULL;
+static int32_t FsFileClose(struct OpenedFile *file)
+{
+    return close(file->fd);
+}
+#endif
+
+/*
+ * opened files indexed by fd, SetFileNumLimit keeps the fds of teecd below
+ * FILE_NUM_LIMIT_MAX. g_fileLock protects the slots and the refs of the entries.
+ */
+static struct OpenedFile *g_openFiles[FILE_NUM_LIMIT_MAX];
+static uint32_t g_openFileNum = 0;
+static pthread_mutex_t g_fileLock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t GetMonotonicSec(void)
+{
+    struct timespec ts = { 0 };
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec;
+}
+
+/* newFile was opened by FsFileOpen, returns 0 or the errno to report for the open */
+static int32_t AddOpenFile(struct OpenedFile *newFile, enum FsCmdType cmd)
+{
+    int32_t fd = newFile->fd;
+    if (fd < 0 || fd >= FILE_NUM_LIMIT_MAX) {
+        tloge("fd %d exceeds the open file table\n", fd);
+        FsAgentDumpOpenFiles();
+        return EMFILE;
+    }
+
+    newFile->refs     = 1;
+    newFile->openTime = GetMonotonicSec();
+    newFile->lastOp   = cmd;
+    (void)pthread_mutex_init(&newFile->lock, NULL);
+
+    /* a closing file leaves its slot before its fd is released, so the slot is free */
+    (void)pthread_mutex_lock(&g_fileLock);
+    g_openFiles[fd] = newFile;
+    g_openFileNum++;
+    (void)pthread_mutex_unlock(&g_fileLock);
+    return 0;
+}
+
+/* called with g_fileLock held */
+static void DelOpenFile(struct OpenedFile *file)
+{
+    if (file == NULL || g_openFiles[file->fd] != file) {
+        return;
+    }
+    g_openFiles[file->fd] = NULL;
+    g_openFileNum--;
+}
+
+/* called with g_fileLock held */
+static struct OpenedFile *FindOpenFile(int32_t fd)
+{
+    if (fd < 0 || fd >= FILE_NUM_LIMIT_MAX) {
+        return NULL;
     }
+    return g_openFiles[fd];
+}
+
+static void ReleaseOpenFile(struct OpenedFile *file)
+{
+    bool last = false;
+
+    (void)pthread_mutex_unlock(&file->lock);
+    (void)pthread_mutex_lock(&g_fileLock);
+    last = (--file->refs == 0);
+    (void)pthread_mutex_unlock(&g_fileLock);
+
+    if (last) {
+        (void)pthread_mutex_destroy(&file->lock);
+        free(file);
+    }
+}
+
+/*
+ * look up an opened file and lock it, requests on the same file run one
+ * after another while other files are served by other workers. The caller
+ * must pair this with ReleaseOpenFile.
+ */
+static struct OpenedFile *AcquireOpenFile(int32_t fd, enum FsCmdType cmd)
+{
+    (void)pthread_mutex_lock(&g_fileLock);
+    struct OpenedFile *file = FindOpenFile(fd);
     if (file != NULL) {
-        *file = p;
+        file->refs++;
+    }
+    (void)pthread_mutex_unlock(&g_fileLock);
+
+    if (file == NULL) {
+        return NULL;
+    }
+    (void)pthread_mutex_lock(&file->lock);
+    if (file->closed) {
+        /* closed by another worker while we waited */
+        ReleaseOpenFile(file);
+        return NULL;
+    }
+    file->lastOp = cmd;
+    return file;
+}
+
+void FsAgentDumpOpenFiles(void)
+{
+    struct OpenedFile *files[FILE_NUM_LIMIT_MAX];
+    uint32_t num = 0;
+
+    /* pin the entries first, their own locks may not be taken under g_fileLock */
+    (void)pthread_mutex_lock(&g_fileLock);
+    for (int32_t fd = 0; fd < FILE_NUM_LIMIT_MAX; fd++) {
+        if (g_openFiles[fd] != NULL) {
+            g_openFiles[fd]->refs++;
+            files[num++] = g_openFiles[fd];
+        }
+    }
+    (void)pthread_mutex_unlock(&g_fileLock);
+
+    tlogi("fs agent holds %u open files\n", num);
+    uint64_t now = GetMonotonicSec();
+    for (uint32_t i = 0; i < num; i++) {
+        struct OpenedFile *file = files[i];
+        (void)pthread_mutex_lock(&file->lock);
+        if (!file->closed) {
+            tlogi("fd %d open %llus last op %d read %llu written %llu\n", file->fd,
+                (unsigned long long)(now - file->openTime), (int32_t)file->lastOp,
+                (unsigned long long)file->bytesRead, (unsigned long long)file->bytesWritten);
+        }
+        ReleaseOpenFile(file);
     }
-    return findFlag;
 }
 
 /*
@@ -719,19 +1069,29 @@ static uint32_t DoOpenFile(const char *path, struct SecStorageType *transControl
         return rRet;
     }
 
-    FILE *pFile = fopen(trustPath, transControl->args.open.mode);
-    if (pFile == NULL) {
-        tloge("open file with flag %s failed: %d\n", transControl->args.open.mode, errno);
-        return (uint32_t)errno;
+    struct OpenedFile *newFile = malloc(sizeof(struct OpenedFile));
+    if (newFile == NULL) {
+        tloge("malloc OpenedFile failed\n");
+        return ENOMEM;
+    }
+    (void)memset_s(newFile, sizeof(*newFile), 0, sizeof(*newFile));
+
+    if (FsFileOpen(newFile, trustPath, transControl->args.open.mode) != 0) {
+        rRet = (uint32_t)errno;
+        tloge("open file with flag %s failed: %u\n", transControl->args.open.mode, rRet);
+        free(newFile);
+        return rRet;
     }
     ChownSecStorageDataToSystem(trustPath, true);
-    int32_t ret = AddOpenFile(pFile);
+    int32_t fd = newFile->fd;
+    int32_t ret = AddOpenFile(newFile, transControl->cmd);
     if (ret != 0) {
         tloge("add OpenedFile failed\n");
-        (void)fclose(pFile);
-        return ENOMEM;
+        (void)FsFileClose(newFile);
+        free(newFile);
+        return (uint32_t)ret;
     }
-    transControl->ret = fileno(pFile); /* return fileno */
+    transControl->ret = fd; /* return fileno */
     return 0;
 }
 
@@ -787,6 +1147,7 @@ static void OpenWork(struct SecStorageType *transControl)
         return;
     }
 
+    LockPaths(nameBuff, NULL);
     if (CheckOpenWorkValid(transControl, isBackup, nameBuff, sizeof(nameBuff)) != 0) {
         error = ENOENT;
         goto ERROR;
@@ -802,9 +1163,11 @@ static void OpenWork(struct SecStorageType *transControl)
         goto ERROR;
     }
 
+    UnlockPaths(nameBuff, NULL);
     return;
 
 ERROR:
+    UnlockPaths(nameBuff, NULL);
     transControl->ret   = -1;
     transControl->error = error;
     return;
@@ -817,19 +1180,24 @@ static void CloseWork(struct SecStorageType *transControl)
 
     tlogv("sec storage : close\n");
 
-    if (FindOpenFile(transControl->args.close.fd, &selFile) != 0) {
-        ret = fclose(selFile->file);
+    selFile = AcquireOpenFile(transControl->args.close.fd, SEC_CLOSE);
+    if (selFile != NULL) {
+        /* close releases the file even when it fails, so the entry goes either way */
+        (void)pthread_mutex_lock(&g_fileLock);
+        DelOpenFile(selFile);
+        selFile->refs--;
+        (void)pthread_mutex_unlock(&g_fileLock);
+
+        ret = FsFileClose(selFile);
+        selFile->closed = true;
         if (ret == 0) {
             tlogv("close file %d success\n", transControl->args.close.fd);
-            DelOpenFile(selFile);
-            free(selFile);
-            selFile = NULL;
-            (void)selFile;
         } else {
             tloge("close file %d failed: %d\n", transControl->args.close.fd, errno);
             transControl->error = (uint32_t)errno;
         }
         transControl->ret = ret;
+        ReleaseOpenFile(selFile);
     } else {
         tloge("can't find opened file(fileno = %d)\n", transControl->args.close.fd);
         transControl->ret   = -1;
@@ -841,15 +1209,18 @@ static void ReadWork(struct SecStorageType *transControl)
 {
     struct OpenedFile *selFile = NULL;
     size_t count;
+    bool eof = false;
 
     tlogv("sec storage : read count = %u\n", transControl->args.read.count);
 
-    if (FindOpenFile(transControl->args.read.fd, &selFile) != 0) {
-        count = fread((void *)(transControl->args.read.buffer), 1, transControl->args.read.count, selFile->file);
+    selFile = AcquireOpenFile(transControl->args.read.fd, SEC_READ);
+    if (selFile != NULL) {
+        count = FsFileRead(selFile, (void *)(transControl->args.read.buffer), transControl->args.read.count, &eof);
         transControl->ret = (int32_t)count;
+        selFile->bytesRead += count;
 
         if (count < transControl->args.read.count) {
-            if (feof(selFile->file) != 0) {
+            if (eof) {
                 transControl->ret2 = 0;
                 tlogv("read end of file\n");
             } else {
@@ -861,6 +1232,7 @@ static void ReadWork(struct SecStorageType *transControl)
             transControl->ret2 = 0;
             tlogv("read file success, content len=%zu\n", count);
         }
+        ReleaseOpenFile(selFile);
     } else {
         transControl->ret   = 0;
         transControl->ret2  = -1;
@@ -876,17 +1248,16 @@ static void WriteWork(struct SecStorageType *transControl)
 
     tlogv("sec storage : write count = %u\n", transControl->args.write.count);
 
-    if (FindOpenFile(transControl->args.write.fd, &selFile) != 0) {
-        count = fwrite((void *)(transControl->args.write.buffer), 1, transControl->args.write.count, selFile->file);
+    selFile = AcquireOpenFile(transControl->args.write.fd, SEC_WRITE);
+    if (selFile != NULL) {
+        count = FsFileWrite(selFile, (void *)(transControl->args.write.buffer), transControl->args.write.count);
+        selFile->bytesWritten += count;
         if (count < transControl->args.write.count) {
             tloge("write file failed: %d\n", errno);
             transControl->ret   = (int32_t)count;
             transControl->error = (uint32_t)errno;
-            return;
-        }
-
-        if (transControl->ret2 == SEC_WRITE_SSA) {
-            if (fflush(selFile->file) != 0) {
+        } else if (transControl->ret2 == SEC_WRITE_SSA) {
+            if (FsFileFlush(selFile) != 0) {
                 tloge("fflush file failed: %d\n", errno);
                 transControl->ret   = 0;
                 transControl->error = (uint32_t)errno;
@@ -897,6 +1268,7 @@ static void WriteWork(struct SecStorageType *transControl)
             transControl->ret   = (int32_t)count;
             transControl->error = 0;
         }
+        ReleaseOpenFile(selFile);
     } else {
         tloge("can't find opened file(fileno = %d)\n", transControl->args.write.fd);
         transControl->ret   = 0;
@@ -911,8 +1283,9 @@ static void SeekWork(struct SecStorageType *transControl)
 
     tlogv("sec storage : seek offset=%d, whence=%u\n", transControl->args.seek.offset, transControl->args.seek.whence);
 
-    if (FindOpenFile(transControl->args.seek.fd, &selFile) != 0) {
-        ret = fseek(selFile->file, transControl->args.seek.offset, (int32_t)transControl->args.seek.whence);
+    selFile = AcquireOpenFile(transControl->args.seek.fd, SEC_SEEK);
+    if (selFile != NULL) {
+        ret = FsFileSeek(selFile, transControl->args.seek.offset, (int32_t)transControl->args.seek.whence);
         if (ret != 0) {
             tloge("seek file failed: %d\n", errno);
             transControl->error = (uint32_t)errno;
@@ -920,6 +1293,7 @@ static void SeekWork(struct SecStorageType *transControl)
             tlogv("seek file success\n");
         }
         transControl->ret = ret;
+        ReleaseOpenFile(selFile);
     } else {
         tloge("can't find opened file(fileno = %d)\n", transControl->args.seek.fd);
         transControl->ret   = -1;
@@ -939,7 +1313,9 @@ static void RemoveWork(struct SecStorageType *transControl)
     SetCurrentStorageId(transControl->storageId);
 
     if (JoinFileName((char *)(transControl->args.remove.name), isBackup, nameBuff, sizeof(nameBuff)) == 0) {
+        LockPaths(nameBuff, NULL);
         ret = UnlinkRecursive(nameBuff);
+        UnlockPaths(nameBuff, NULL);
         if (ret != 0) {
             tloge("remove file failed: %d\n", errno);
             transControl->error = (uint32_t)errno;
@@ -964,7 +1340,9 @@ static void TruncateWork(struct SecStorageType *transControl)
     SetCurrentStorageId(transControl->storageId);
 
     if (JoinFileName((char *)(transControl->args.truncate.name), isBackup, nameBuff, sizeof(nameBuff)) == 0) {
+        LockPaths(nameBuff, NULL);
         ret = truncate(nameBuff, (long)transControl->args.truncate.len);
+        UnlockPaths(nameBuff, NULL);
         if (ret != 0) {
             tloge("truncate file failed: %d\n", errno);
             transControl->error = (uint32_t)errno;
@@ -993,7 +1371,9 @@ static void RenameWork(struct SecStorageType *transControl)
     int32_t joinNewRet = JoinFileName((char *)(transControl->args.rename.buffer) + transControl->args.rename.oldNameLen,
                                       newIsBackup, nameBuff2, sizeof(nameBuff2));
     if (joinOldRet == 0 && joinNewRet == 0) {
+        LockPaths(nameBuff, nameBuff2);
         ret = rename(nameBuff, nameBuff2);
+        UnlockPaths(nameBuff, nameBuff2);
         if (ret != 0) {
             tloge("rename file failed: %d\n", errno);
             transControl->error = (uint32_t)errno;
@@ -1116,7 +1496,9 @@ static void CopyWork(struct SecStorageType *transControl)
     int32_t joinFromRet = JoinFileName(fromName, fromIsBackup, fromPath, sizeof(fromPath));
     int32_t joinToRet = JoinFileName(toName, toIsBackup, toPath, sizeof(toPath));
     if (joinFromRet == 0 && joinToRet == 0) {
+        LockPaths(fromPath, toPath);
         ret = CopyFile(fromPath, toPath);
+        UnlockPaths(fromPath, toPath);
         if (ret != 0) {
             tloge("copy file failed: %d\n", errno);
             transControl->error = (uint32_t)errno;
@@ -1139,16 +1521,18 @@ static void FileInfoWork(struct SecStorageType *transControl)
 
     transControl->args.info.fileLen = transControl->args.info.curPos = 0;
 
-    if (FindOpenFile(transControl->args.info.fd, &selFile) != 0) {
+    selFile = AcquireOpenFile(transControl->args.info.fd, SEC_INFO);
+    if (selFile != NULL) {
         ret = fstat(transControl->args.info.fd, &statBuff);
         if (ret == 0) {
             transControl->args.info.fileLen = (uint32_t)statBuff.st_size;
-            transControl->args.info.curPos  = (uint32_t)ftell(selFile->file);
+            transControl->args.info.curPos  = (uint32_t)FsFileTell(selFile);
         } else {
             tloge("fstat file failed: %d\n", errno);
             transControl->error = (uint32_t)errno;
         }
         transControl->ret = ret;
+        ReleaseOpenFile(selFile);
     } else {
         transControl->ret   = -1;
         transControl->error = EBADF;
@@ -1168,7 +1552,9 @@ static void FileAccessWork(struct SecStorageType *transControl)
         SetCurrentStorageId(transControl->storageId);
 
         if (JoinFileName((char *)(transControl->args.access.name), isBackup, nameBuff, sizeof(nameBuff)) == 0) {
+            LockPaths(nameBuff, NULL);
             ret = access(nameBuff, transControl->args.access.mode);
+            UnlockPaths(nameBuff, NULL);
             if (ret < 0) {
                 tlogw("access file mode %d failed: %d\n", transControl->args.access.mode, errno);
             }
@@ -1190,39 +1576,43 @@ static void FileAccessWork(struct SecStorageType *transControl)
 static void FsyncWork(struct SecStorageType *transControl)
 {
     int32_t ret;
-    int32_t fd                 = -1;
     struct OpenedFile *selFile = NULL;
 
     tlogv("sec storage : file fsync\n");
 
     /* opened file */
-    if (transControl->args.fsync.fd != 0 && FindOpenFile(transControl->args.fsync.fd, &selFile) != 0) {
-        /* first,flush memory from user to kernel */
-        ret = fflush(selFile->file);
-        if (ret != 0) {
-            tloge("fsync:fflush file failed: %d\n", errno);
-            transControl->ret   = -1;
-            transControl->error = (uint32_t)errno;
-            return;
-        }
-
-        /* second,fsync memory from kernel to disk */
-        fd  = fileno(selFile->file);
-        ret = fsync(fd);
-        if (ret != 0) {
-            tloge("fsync:fsync file failed: %d\n", errno);
-            transControl->ret   = -1;
-            transControl->error = (uint32_t)errno;
-            return;
-        }
-
-        transControl->ret = 0;
-        tlogv("fsync file(%d) success\n", transControl->args.fsync.fd);
-    } else {
+    if (transControl->args.fsync.fd != 0) {
+        selFile = AcquireOpenFile(transControl->args.fsync.fd, SEC_FSYNC);
+    }
+    if (selFile == NULL) {
         tloge("can't find opened file(fileno = %d)\n", transControl->args.fsync.fd);
         transControl->ret   = -1;
         transControl->error = EBADF;
+        return;
+    }
+
+    /* first,flush memory from user to kernel */
+    ret = FsFileFlush(selFile);
+    if (ret != 0) {
+        tloge("fsync:fflush file failed: %d\n", errno);
+        transControl->ret   = -1;
+        transControl->error = (uint32_t)errno;
+        goto END;
+    }
+
+    /* second,fsync memory from kernel to disk */
+    ret = fsync(selFile->fd);
+    if (ret != 0) {
+        tloge("fsync:fsync file failed: %d\n", errno);
+        transControl->ret   = -1;
+        transControl->error = (uint32_t)errno;
+        goto END;
     }
+
+    transControl->ret = 0;
+    tlogv("fsync file(%d) success\n", transControl->args.fsync.fd);
+END:
+    ReleaseOpenFile(selFile);
 }
 
 #define KBYTE 1024
@@ -1285,7 +1675,10 @@ static void DeleteAllWork(struct SecStorageType *transControl)
 
     tlogv("sec storage : joint delete path\n");
 
+    /* the whole tree goes, so no other path op may run meanwhile */
+    LockAllPaths();
     ret = UnlinkRecursive(path);
+    UnlockAllPaths();
     if (ret != 0) {
         tloge("delete file failed: %d\n", errno);
         transControl->error = (uint32_t)errno;
@@ -1313,18 +1706,29 @@ static const struct FsWorkTbl g_fsWorkTbl[] = {
     { SEC_DISKUSAGE, DiskUsageWork }, { SEC_DELETE_ALL, DeleteAllWork },
 };
 
-void *FsWorkThread(void *control)
+/* the control buffer is read by the TEE, the result has to be visible before the magic and the response */
+static inline void FsControlBarrier(void)
+{
+#if defined(__aarch64__) || defined(__arm__)
+    __asm__ volatile("isb");
+    __asm__ volatile("dsb sy");
+#else
+    __sync_synchronize();
+#endif
+}
+
+void *FsWorkThread(void *worker)
 {
     struct SecStorageType *transControl = NULL;
     int32_t ret;
     int32_t fsFd;
 
-    if (control == NULL) {
+    if (worker == NULL || ((struct FsWorker *)worker)->control == NULL) {
         return NULL;
     }
-    transControl = control;
+    transControl = ((struct FsWorker *)worker)->control;
 
-    fsFd = g_fsAgentFd;
+    fsFd = ((struct FsWorker *)worker)->fd;
     if (fsFd == -1) {
         tloge("fs is not open\n");
         return NULL;
@@ -1352,13 +1756,11 @@ void *FsWorkThread(void *control)
 
     FILE_WORK_DONE:
 
-        __asm__ volatile("isb");
-        __asm__ volatile("dsb sy");
+        FsControlBarrier();
 
         transControl->magic = AGENT_FS_ID;
 
-        __asm__ volatile("isb");
-        __asm__ volatile("dsb sy");
+        FsControlBarrier();
 
         ret = ioctl(fsFd, TC_NS_CLIENT_IOCTL_SEND_EVENT_RESPONSE, AGENT_FS_ID);
         if (ret != 0) {
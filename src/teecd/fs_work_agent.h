@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #define FILE_NAME_MAX_BUF       256
 #define FILE_NUM_LIMIT_MAX      1024
@@ -129,16 +130,29 @@ struct SecStorageType {
 };
 
 struct OpenedFile {
+#ifdef CONFIG_FS_AGENT_STDIO
     FILE *file;
-    struct OpenedFile *next;
-    struct OpenedFile *prev;
+#else
+    uint64_t pos;           /* file position, the agent reads and writes at it with pread/pwrite */
+    bool append;
+#endif
+    int32_t fd;
+    bool closed;
+    uint32_t refs;          /* the table and every worker using the file */
+    pthread_mutex_t lock;   /* keeps the ops on one file in order */
+    uint64_t openTime;      /* CLOCK_MONOTONIC seconds */
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    enum FsCmdType lastOp;
 };
 
 int IsUserDataReady(void);
-void *FsWorkThread(void *control);
+void *FsWorkThread(void *worker);
 void SetFileNumLimit(void);
 int GetFsAgentFd(void);
 void *GetFsAgentControl(void);
+/* log every file the fs agent holds open, with its age, traffic and last op */
+void FsAgentDumpOpenFiles(void);
 
 int FsAgentInit(void);
 void FsAgentThreadCreate(void);
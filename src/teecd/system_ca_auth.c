@@ -12,6 +12,7 @@
 
 #include "system_ca_auth.h"
 #include <errno.h>
+#include <poll.h>
 #include <sys/ioctl.h> /* for ioctl */
 #include <sys/socket.h>
 #include <fcntl.h>
@@ -76,8 +77,8 @@ int RecvCaMsg(int socket, CaRevMsg *caInfo)
 {
     struct iovec iov[1];
     struct msghdr message;
-    fd_set fds;
-    struct timeval timeout = { 3, 0 }; /* 3s timeout */
+    struct pollfd pfd = { .fd = socket, .events = POLLIN };
+    int timeoutMs = 3000; /* 3s timeout */
     int ret;
 
     if (caInfo == NULL) {
@@ -101,9 +102,10 @@ int RecvCaMsg(int socket, CaRevMsg *caInfo)
     message.msg_iov[0].iov_base = caInfo;
     message.msg_iov[0].iov_len  = sizeof(CaRevMsg);
 
-    FD_ZERO(&fds);
-    FD_SET(socket, &fds);
-    ret = select(socket + 1, &fds, NULL, NULL, &timeout);
+    /* poll instead of select, the socket fd may exceed FD_SETSIZE when many CAs connect at once */
+    do {
+        ret = poll(&pfd, 1, timeoutMs);
+    } while (ret < 0 && errno == EINTR);
     if (ret <= 0) {
         tloge("teecd socket timeout or err, err=%d.\n", errno);
         return -1;
@@ -19,7 +19,12 @@
 #include <signal.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <time.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "securec.h"
 #include "tc_ns_client.h"
 #include "tee_log.h"
 #include "fs_work_agent.h"
@@ -159,31 +164,30 @@ void ProcessAgentExit(void)
 
 #define SEC_MIN 0xFFFFF
 #define NSEC_PER_MILLIS 1000000
-static int SyncSysTimeToSecure(void)
+#define MILLIS_PER_SEC  1000
+static int SyncSysTimeToSecure(struct timespec *realTime, struct timespec *sysTime)
 {
     int ret;
     TC_NS_Time tcNsTime;
-    struct timespec realTime;
-    struct timespec sysTime;
 
-    ret = clock_gettime(CLOCK_REALTIME, &realTime);
+    ret = clock_gettime(CLOCK_REALTIME, realTime);
     if (ret != 0) {
         tloge("get real time failed ret=0x%x\n", ret);
         return ret;
     }
 
-    ret = clock_gettime(CLOCK_MONOTONIC, &sysTime);
+    ret = clock_gettime(CLOCK_MONOTONIC, sysTime);
     if (ret != 0) {
         tloge("get system time failed ret=0x%x\n", ret);
         return ret;
     }
 
-    if (realTime.tv_sec <= sysTime.tv_sec || (realTime.tv_sec - sysTime.tv_sec) < SEC_MIN) {
+    if (realTime->tv_sec <= sysTime->tv_sec || (realTime->tv_sec - sysTime->tv_sec) < SEC_MIN) {
         tlogd("real time is not ready\n");
         return -1;
     }
-    tcNsTime.seconds = (uint32_t)realTime.tv_sec;
-    tcNsTime.millis  = (uint32_t)(realTime.tv_nsec / NSEC_PER_MILLIS);
+    tcNsTime.seconds = (uint32_t)realTime->tv_sec;
+    tcNsTime.millis  = (uint32_t)(realTime->tv_nsec / NSEC_PER_MILLIS);
 
     int fd = open(TC_TEECD_PRIVATE_DEV_NAME, O_RDWR);
     if (fd < 0) {
@@ -199,17 +203,136 @@ static int SyncSysTimeToSecure(void)
     return ret;
 }
 
+/*
+ * drift is how far the wall clock moved against the monotonic clock between
+ * two syncs, which is what the secure side would be off by without this sync
+ */
+struct TimeSyncState {
+    pthread_mutex_t lock;
+    bool synced;
+    uint64_t syncs;
+    uint64_t failures;
+    uint64_t clockJumps;
+    int64_t lastDriftMs;
+    int64_t maxDriftMs;
+    struct timespec lastReal;
+    struct timespec lastMono;
+};
+
+static struct TimeSyncState g_timeSync = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int64_t TimespecMs(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * MILLIS_PER_SEC + ts->tv_nsec / NSEC_PER_MILLIS;
+}
+
+static int SyncSecureTime(bool clockJumped)
+{
+    struct timespec realTime;
+    struct timespec sysTime;
+
+    (void)pthread_mutex_lock(&g_timeSync.lock);
+    if (clockJumped) {
+        g_timeSync.clockJumps++;
+    }
+    int ret = SyncSysTimeToSecure(&realTime, &sysTime);
+    if (ret != 0) {
+        g_timeSync.failures++;
+        (void)pthread_mutex_unlock(&g_timeSync.lock);
+        return ret;
+    }
+
+    if (g_timeSync.synced) {
+        int64_t drift = (TimespecMs(&realTime) - TimespecMs(&g_timeSync.lastReal)) -
+            (TimespecMs(&sysTime) - TimespecMs(&g_timeSync.lastMono));
+        g_timeSync.lastDriftMs = drift;
+        if (llabs(drift) > llabs(g_timeSync.maxDriftMs)) {
+            g_timeSync.maxDriftMs = drift;
+        }
+    }
+    g_timeSync.synced = true;
+    g_timeSync.syncs++;
+    g_timeSync.lastReal = realTime;
+    g_timeSync.lastMono = sysTime;
+    tlogi("sys time synced to secure: syncs %llu, failures %llu, clock jumps %llu, drift %lld ms, max drift %lld ms\n",
+        (unsigned long long)g_timeSync.syncs, (unsigned long long)g_timeSync.failures,
+        (unsigned long long)g_timeSync.clockJumps, (long long)g_timeSync.lastDriftMs,
+        (long long)g_timeSync.maxDriftMs);
+    (void)pthread_mutex_unlock(&g_timeSync.lock);
+    return 0;
+}
+
+/* sync once if no sync succeeded yet, the time sync thread keeps it up to date afterwards */
 void TrySyncSysTimeToSecure(void)
 {
-    int ret;
-    static int syncSysTimed = 0;
-
-    if (syncSysTimed == 0) {
-        ret = SyncSysTimeToSecure();
-        if (ret != 0) {
-            tlogw("failed to sync sys time to secure\n");
-        } else {
-            syncSysTimed = 1;
+    (void)pthread_mutex_lock(&g_timeSync.lock);
+    bool synced = g_timeSync.synced;
+    (void)pthread_mutex_unlock(&g_timeSync.lock);
+
+    if (!synced && SyncSecureTime(false) != 0) {
+        tlogw("failed to sync sys time to secure\n");
+    }
+}
+
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+#define TIME_SYNC_PERIOD_SEC 3600
+#define TIME_SYNC_RETRY_SEC  10   /* real time is not set yet or the sync failed */
+
+/*
+ * The timer is armed on CLOCK_REALTIME with TFD_TIMER_CANCEL_ON_SET, so a
+ * read returns ECANCELED as soon as the wall clock is set and the new time
+ * reaches the secure side at once instead of at the next period.
+ */
+static void *TimeSyncThread(void *arg)
+{
+    (void)arg;
+    struct itimerspec its;
+    uint64_t expirations;
+
+    int tfd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+    if (tfd < 0) {
+        tloge("timerfd_create failed, errno=%d\n", errno);
+        return NULL;
+    }
+
+    (void)pthread_mutex_lock(&g_timeSync.lock);
+    bool lastOk = g_timeSync.synced;
+    (void)pthread_mutex_unlock(&g_timeSync.lock);
+    while (1) {
+        (void)memset_s(&its, sizeof(its), 0, sizeof(its));
+        (void)clock_gettime(CLOCK_REALTIME, &its.it_value);
+        its.it_value.tv_sec += lastOk ? TIME_SYNC_PERIOD_SEC : TIME_SYNC_RETRY_SEC;
+        if (timerfd_settime(tfd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL) != 0) {
+            tloge("timerfd_settime failed, errno=%d\n", errno);
+            break;
+        }
+
+        ssize_t n = read(tfd, &expirations, sizeof(expirations));
+        bool clockJumped = (n < 0 && errno == ECANCELED);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && !clockJumped) {
+            tloge("read timerfd failed, errno=%d\n", errno);
+            break;
         }
+        lastOk = (SyncSecureTime(clockJumped) == 0);
+    }
+    (void)close(tfd);
+    return NULL;
+}
+
+void StartTimeSyncThread(void)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    (void)pthread_attr_init(&attr);
+    (void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, TimeSyncThread, NULL) != 0) {
+        tloge("create time sync thread failed, errno=%d\n", errno);
     }
+    (void)pthread_attr_destroy(&attr);
 }
@@ -22,5 +22,6 @@ void ProcessAgentThreadCreate(void);
 void ProcessAgentThreadJoin(void);
 void ProcessAgentExit(void);
 void TrySyncSysTimeToSecure(void);
+void StartTimeSyncThread(void);
 
 #endif
@@ -11,7 +11,14 @@
  */
 
 #include "tee_ca_auth.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/ioctl.h> /* for ioctl */
+#include <sys/stat.h>
 #include "securec.h"
 #include "tc_ns_client.h"
 #include "tee_client_type.h"
@@ -26,11 +33,221 @@
 #endif
 #define LOG_TAG "teecd_auth"
 
+#define AUTH_CACHE_SIZE            64
+#define AUTH_STATS_REPORT_INTERVAL 1024
+#define PROC_STAT_BUF_LEN          1024
+#define PROC_STAT_STARTTIME_FIELD  22  /* counted from the pid, see proc(5) */
+#define PERCENT                    100
+#define US_PER_SEC                 1000000
+#define NS_PER_US                  1000
+
+/*
+ * A pid can be reused by another process, and a process can exec another
+ * program, so a cached cert is only returned to the same process image:
+ * pid, start time, uid and the inode of the executable must all match.
+ */
+struct CaIdentity {
+    pid_t pid;
+    unsigned int uid;
+    unsigned long long startTime;
+    dev_t exeDev;
+    ino_t exeIno;
+};
+
+struct AuthCacheEntry {
+    struct CaIdentity id;
+    uint64_t lastUsed;
+    uint32_t len;
+    uint8_t *cert;
+};
+
+struct AuthStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t uncached;      /* identity of the CA could not be read */
+    uint64_t hitTotalUs;
+    uint64_t missTotalUs;
+    uint64_t maxUs;
+};
+
+static struct AuthCacheEntry g_authCache[AUTH_CACHE_SIZE];
+static uint64_t g_authCacheClock;
+static struct AuthStats g_authStats;
+static pthread_mutex_t g_authCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t AuthNowUs(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * US_PER_SEC + (uint64_t)now.tv_nsec / NS_PER_US;
+}
+
+static int ReadStartTime(pid_t pid, unsigned long long *startTime)
+{
+    char path[MAX_PATH_LENGTH] = { 0 };
+    char buf[PROC_STAT_BUF_LEN] = { 0 };
+
+    if (snprintf_s(path, sizeof(path), sizeof(path) - 1, "/proc/%d/stat", pid) == -1) {
+        return -1;
+    }
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+    (void)fclose(fp);
+    buf[len] = '\0';
+
+    /* the command name may hold spaces and brackets, fields are counted after the last ')' */
+    char *pos = strrchr(buf, ')');
+    if (pos == NULL) {
+        return -1;
+    }
+    for (int field = 2; field < PROC_STAT_STARTTIME_FIELD; field++) {
+        pos = strchr(pos + 1, ' ');
+        if (pos == NULL) {
+            return -1;
+        }
+    }
+    char *end = NULL;
+    *startTime = strtoull(pos + 1, &end, 10); /* 10 is decimal */
+    return (end == pos + 1) ? -1 : 0;
+}
+
+static int GetCaIdentity(const struct ucred *cr, struct CaIdentity *id)
+{
+    char path[MAX_PATH_LENGTH] = { 0 };
+    struct stat st;
+
+    if (snprintf_s(path, sizeof(path), sizeof(path) - 1, "/proc/%d/exe", cr->pid) == -1) {
+        return -1;
+    }
+    if (stat(path, &st) != 0 || ReadStartTime(cr->pid, &id->startTime) != 0) {
+        return -1;
+    }
+    id->pid = cr->pid;
+    id->uid = cr->uid;
+    id->exeDev = st.st_dev;
+    id->exeIno = st.st_ino;
+    return 0;
+}
+
+static bool SameIdentity(const struct CaIdentity *a, const struct CaIdentity *b)
+{
+    return a->pid == b->pid && a->uid == b->uid && a->startTime == b->startTime &&
+        a->exeDev == b->exeDev && a->exeIno == b->exeIno;
+}
+
+/* called with g_authCacheLock held */
+static struct AuthCacheEntry *FindAuthCache(const struct CaIdentity *id)
+{
+    for (uint32_t i = 0; i < AUTH_CACHE_SIZE; i++) {
+        if (g_authCache[i].cert != NULL && SameIdentity(&g_authCache[i].id, id)) {
+            return &g_authCache[i];
+        }
+    }
+    return NULL;
+}
+
+static bool LookupAuthCache(const struct CaIdentity *id, uint8_t *buf, unsigned int bufLen)
+{
+    bool found = false;
+
+    (void)pthread_mutex_lock(&g_authCacheLock);
+    struct AuthCacheEntry *entry = FindAuthCache(id);
+    if (entry != NULL && memcpy_s(buf, bufLen, entry->cert, entry->len) == EOK) {
+        entry->lastUsed = ++g_authCacheClock;
+        found = true;
+    }
+    (void)pthread_mutex_unlock(&g_authCacheLock);
+    return found;
+}
+
+static void InsertAuthCache(const struct CaIdentity *id, const uint8_t *buf, uint32_t len)
+{
+    uint8_t *cert = (uint8_t *)malloc(len);
+    if (cert == NULL || memcpy_s(cert, len, buf, len) != EOK) {
+        free(cert);
+        return;
+    }
+
+    (void)pthread_mutex_lock(&g_authCacheLock);
+    struct AuthCacheEntry *entry = FindAuthCache(id);
+    if (entry == NULL) {
+        /* take a free entry or the least recently used one */
+        entry = &g_authCache[0];
+        for (uint32_t i = 0; i < AUTH_CACHE_SIZE && entry->cert != NULL; i++) {
+            if (g_authCache[i].cert == NULL || g_authCache[i].lastUsed < entry->lastUsed) {
+                entry = &g_authCache[i];
+            }
+        }
+    }
+    free(entry->cert);
+    entry->id = *id;
+    entry->cert = cert;
+    entry->len = len;
+    entry->lastUsed = ++g_authCacheClock;
+    (void)pthread_mutex_unlock(&g_authCacheLock);
+}
+
+static void RecordAuth(bool cacheable, bool hit, uint64_t costUs)
+{
+    (void)pthread_mutex_lock(&g_authCacheLock);
+    struct AuthStats *st = &g_authStats;
+    if (!cacheable) {
+        st->uncached++;
+    } else if (hit) {
+        st->hits++;
+        st->hitTotalUs += costUs;
+    } else {
+        st->misses++;
+        st->missTotalUs += costUs;
+    }
+    if (costUs > st->maxUs) {
+        st->maxUs = costUs;
+    }
+    uint64_t total = st->hits + st->misses + st->uncached;
+    if (total % AUTH_STATS_REPORT_INTERVAL == 0) {
+        tlogi("ca auth cache: %llu auths, hit rate %llu%%, avg hit %lluus, avg miss %lluus, max %lluus\n",
+            (unsigned long long)total, (unsigned long long)(st->hits * PERCENT / total),
+            (unsigned long long)(st->hits == 0 ? 0 : st->hitTotalUs / st->hits),
+            (unsigned long long)(st->misses == 0 ? 0 : st->missTotalUs / st->misses),
+            (unsigned long long)st->maxUs);
+    }
+    (void)pthread_mutex_unlock(&g_authCacheLock);
+}
+
+/* build the cert of the CA, or copy it from the cache when the same process connected before */
+static int GetNativeCertCached(const struct ucred *cr, uint8_t *buf, unsigned int bufLen)
+{
+    struct CaIdentity id;
+    struct CaIdentity idAfter;
+    uint64_t start = AuthNowUs();
+
+    bool cacheable = (GetCaIdentity(cr, &id) == 0);
+    if (cacheable && LookupAuthCache(&id, buf, bufLen)) {
+        RecordAuth(true, true, AuthNowUs() - start);
+        return 0;
+    }
+
+    uint32_t len = bufLen;
+    int ret = TeeGetNativeCert(cr->pid, cr->uid, &len, buf);
+    if (ret != 0) {
+        return ret;
+    }
+    /* the process may have exited or exec'd meanwhile, then the cert is used once but not kept */
+    if (cacheable && GetCaIdentity(cr, &idAfter) == 0 && SameIdentity(&id, &idAfter)) {
+        InsertAuthCache(&id, buf, len);
+    }
+    RecordAuth(cacheable, false, AuthNowUs() - start);
+    return 0;
+}
+
 static int GetLoginInfoNonHidl(const struct ucred *cr, int fd, uint8_t *buf, unsigned int bufLen)
 {
     int ret;
 
-    ret = TeeGetNativeCert(cr->pid, cr->uid, &bufLen, buf);
+    ret = GetNativeCertCached(cr, buf, bufLen);
     if (ret != 0) {
         tloge("CERT check failed<%d>\n", ret);
         /* Inform the driver the cert could not be set */
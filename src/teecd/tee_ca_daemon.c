@@ -12,11 +12,14 @@
 
 #include "tee_ca_daemon.h"
 #include <unistd.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <errno.h> /* for errno */
 #include <fcntl.h>
 #include <sys/ioctl.h> /* for ioctl */
 #include <sys/mman.h>  /* for mmap */
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <sys/un.h>
 #include <sys/types.h>
 #include <string.h>
@@ -49,12 +52,43 @@
 
 #define IOV_LEN 1
 
+#ifdef CONFIG_CA_SERVER_WORKERS
+#define CA_SERVER_WORKERS CONFIG_CA_SERVER_WORKERS
+#else
+#define CA_SERVER_WORKERS 4
+#endif
+#define CA_SERVER_QUEUE_LEN    256
+#define CA_SERVER_BACKLOG      128
+#define CA_SERVER_EPOLL_EVENTS 16
+#define CA_SERVER_RETRY_US     10000
+
+/*
+ * The acceptor thread waits on the listening socket with epoll and queues
+ * accepted clients, CA_SERVER_WORKERS workers authenticate them and hand
+ * out the device fds, so one slow client no longer holds up the others.
+ * Secure time is kept in sync by the time sync thread, see tee_agent.c.
+ */
+struct CaServer {
+    int clients[CA_SERVER_QUEUE_LEN];
+    uint32_t head;
+    uint32_t count;
+    bool stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+};
+
 static struct ModuleInfo g_teecdModuleInfo = {
     .deviceName = TC_TEECD_PRIVATE_DEV_NAME,
     .moduleName = "teecd",
     .ioctlNum = TC_NS_CLIENT_IOCTL_GET_TEE_INFO,
 };
 static unsigned int g_version = 0;
+static struct CaServer g_caServer = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .notEmpty = PTHREAD_COND_INITIALIZER,
+    .notFull = PTHREAD_COND_INITIALIZER,
+};
 
 static int InitMsg(struct msghdr *hmsg, struct iovec *iov, size_t iovLen,
                    char *ctrlBuf, size_t ctrlBufLen)
@@ -128,6 +162,80 @@ static int SendFileDescriptor(int cmd, int socket, int fd)
     return 0;
 }
 
+static int SendFileDescriptors(int socket, const int *fds, uint32_t count)
+{
+    struct msghdr hmsg;
+    struct iovec iov[IOV_LEN];
+    char ctrlBuf[CMSG_SPACE(sizeof(int) * CA_DAEMON_FD_BATCH_MAX)];
+    RecvTeecdMsg base = { 0 };
+
+    if (memset_s(&hmsg, sizeof(hmsg), 0, sizeof(hmsg)) != EOK ||
+        memset_s(ctrlBuf, sizeof(ctrlBuf), 0, sizeof(ctrlBuf)) != EOK) {
+        tloge("memset failed!\n");
+        return -1;
+    }
+    iov[0].iov_base = &base;
+    iov[0].iov_len = sizeof(base);
+    if (InitMsg(&hmsg, iov, IOV_LEN, ctrlBuf, CMSG_SPACE(sizeof(int) * count)) != EOK) {
+        tloge("init msg failed!\n");
+        return -1;
+    }
+
+    struct cmsghdr *controlMsg = CMSG_FIRSTHDR(&hmsg);
+    if (controlMsg == NULL) {
+        return -1;
+    }
+    controlMsg->cmsg_level = SOL_SOCKET;
+    controlMsg->cmsg_type  = SCM_RIGHTS;
+    controlMsg->cmsg_len   = CMSG_LEN(sizeof(int) * count);
+    if (memcpy_s(CMSG_DATA(controlMsg), sizeof(int) * count, fds, sizeof(int) * count) != EOK) {
+        return -1;
+    }
+
+    if (sendmsg(socket, &hmsg, 0) <= 0) {
+        tloge("sendmsg failed:%d.\n", errno);
+        return -1;
+    }
+    return 0;
+}
+
+/* open and log in up to the requested number of fds, a short batch is still sent */
+static int ProcessGetFds(const struct ucred *cr, const CaRevMsg *caInfo, int socket)
+{
+    int fds[CA_DAEMON_FD_BATCH_MAX];
+    uint32_t want = caInfo->xmlBufSize;
+    uint32_t count = 0;
+    int ret = -1;
+
+    if (want == 0 || want > CA_DAEMON_FD_BATCH_MAX) {
+        want = (want == 0) ? 1 : CA_DAEMON_FD_BATCH_MAX;
+    }
+    for (; count < want; count++) {
+        int fd = open(TC_NS_CLIENT_DEV_NAME, O_RDWR);
+        if (fd == -1) {
+            tloge("Failed to open %s: %d\n", TC_NS_CLIENT_DEV_NAME, errno);
+            break;
+        }
+        if (SendLoginInfo(cr, caInfo, fd) != EOK) {
+            tloge("Failed to send login info.\n");
+            (void)close(fd);
+            break;
+        }
+        fds[count] = fd;
+    }
+
+    if (count > 0) {
+        ret = SendFileDescriptors(socket, fds, count);
+        if (ret != 0) {
+            tloge("Failed to send %u fds.\n", count);
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        (void)close(fds[i]);
+    }
+    return ret;
+}
+
 static int ProcessCaMsg(const struct ucred *cr, const CaRevMsg *caInfo, int socket)
 {
     int ret;
@@ -140,6 +248,9 @@ static int ProcessCaMsg(const struct ucred *cr, const CaRevMsg *caInfo, int sock
         }
         return 0;
     }
+    if (caInfo->cmd == GET_FDS) {
+        return ProcessGetFds(cr, caInfo, socket);
+    }
 
     int fd = open(TC_NS_CLIENT_DEV_NAME, O_RDWR);
     if (fd == -1) {
@@ -164,53 +275,186 @@ static int ProcessCaMsg(const struct ucred *cr, const CaRevMsg *caInfo, int sock
     return 0;
 }
 
-static void ProcessAccept(int s, CaRevMsg *caInfo)
+static void ProcessClient(int s2, CaRevMsg *caInfo)
 {
     struct ucred cr;
-    struct sockaddr_un remote;
     int ret;
 
+    socklen_t len = sizeof(struct ucred);
+    if (getsockopt(s2, SOL_SOCKET, SO_PEERCRED, &cr, &len) < 0) {
+        tloge("peercred failed: %d", errno);
+        (void)close(s2);
+        return;
+    }
+
+    tlogd("uid %d pid %d\n", cr.uid, cr.pid);
+
+    ret = RecvCaMsg(s2, caInfo);
+    if (ret != 0) {
+        tloge("tee ca daemon recvmsg failed\n");
+        goto CLOSE_SOCKET;
+    }
+
+    ret = ProcessCaMsg(&cr, caInfo, s2);
+    if (ret != 0) {
+        tloge("Failed to process ca msg. ret=%d\n", ret);
+        goto CLOSE_SOCKET;
+    }
+
+CLOSE_SOCKET:
+    tlogd("close_socket and curret ret=%u\n", ret);
+    (void)close(s2);
+    errno_t rc = memset_s(caInfo, sizeof(CaRevMsg), 0, sizeof(CaRevMsg));
+    if (rc != EOK) {
+        tloge("ca_info memset_s failed\n");
+    }
+}
+
+/* blocks while the queue is full, so a connect storm waits in the listen backlog */
+static bool QueueClient(struct CaServer *server, int client)
+{
+    (void)pthread_mutex_lock(&server->lock);
+    while (server->count == CA_SERVER_QUEUE_LEN && !server->stopping) {
+        (void)pthread_cond_wait(&server->notFull, &server->lock);
+    }
+    if (server->stopping) {
+        (void)pthread_mutex_unlock(&server->lock);
+        return false;
+    }
+    server->clients[(server->head + server->count) % CA_SERVER_QUEUE_LEN] = client;
+    server->count++;
+    (void)pthread_cond_signal(&server->notEmpty);
+    (void)pthread_mutex_unlock(&server->lock);
+    return true;
+}
+
+static int DequeueClient(struct CaServer *server)
+{
+    int client = -1;
+
+    (void)pthread_mutex_lock(&server->lock);
+    while (server->count == 0 && !server->stopping) {
+        (void)pthread_cond_wait(&server->notEmpty, &server->lock);
+    }
+    if (server->count > 0) {
+        client = server->clients[server->head];
+        server->head = (server->head + 1) % CA_SERVER_QUEUE_LEN;
+        server->count--;
+        (void)pthread_cond_signal(&server->notFull);
+    }
+    (void)pthread_mutex_unlock(&server->lock);
+    return client;
+}
+
+static void *CaServerWorker(void *data)
+{
+    struct CaServer *server = (struct CaServer *)data;
+
+    CaRevMsg *caInfo = (CaRevMsg *)malloc(sizeof(CaRevMsg));
+    if (caInfo == NULL) {
+        tloge("ca server: Failed to malloc caInfo\n");
+        return NULL;
+    }
+    if (memset_s(caInfo, sizeof(CaRevMsg), 0, sizeof(CaRevMsg)) != EOK) {
+        tloge("ca_info memset_s failed\n");
+        free(caInfo);
+        return NULL;
+    }
+
+    int client;
+    while ((client = DequeueClient(server)) >= 0) {
+        ProcessClient(client, caInfo);
+    }
+    free(caInfo);
+    return NULL;
+}
+
+/* accept every pending connection, returns -1 if the listening socket is broken */
+static int AcceptClients(struct CaServer *server, int s)
+{
+    struct sockaddr_un remote;
+
     while (1) {
-        /* int done, n; */
-        tlogd("Waiting for a connection...target daemon\n");
-        size_t t = sizeof(remote);
-        int s2   = accept(s, (struct sockaddr *)&remote, (socklen_t *)&t);
+        socklen_t t = sizeof(remote);
+        int s2 = accept4(s, (struct sockaddr *)&remote, &t, SOCK_CLOEXEC);
         if (s2 == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+                return 0;
+            }
             tloge("accept() to server socket failed, errno=%d", errno);
-            continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                /* out of fds or memory, give the workers time to close some */
+                (void)usleep(CA_SERVER_RETRY_US);
+                return 0;
+            }
+            return -1;
         }
-
-        socklen_t len = sizeof(struct ucred);
-        if (getsockopt(s2, SOL_SOCKET, SO_PEERCRED, &cr, &len) < 0) {
-            tloge("peercred failed: %d", errno);
+        if (!QueueClient(server, s2)) {
             (void)close(s2);
-            continue;
+            return -1;
         }
+    }
+}
 
-        tlogd("uid %d pid %d\n", cr.uid, cr.pid);
+static void ProcessAccept(int s)
+{
+    struct epoll_event events[CA_SERVER_EPOLL_EVENTS];
+    pthread_t workers[CA_SERVER_WORKERS];
+    uint32_t started = 0;
+
+    int flags = fcntl(s, F_GETFL, 0);
+    if (flags < 0 || fcntl(s, F_SETFL, (unsigned int)flags | O_NONBLOCK) < 0) {
+        tloge("set server socket nonblock failed, errno=%d\n", errno);
+        return;
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        tloge("epoll_create1 failed, errno=%d\n", errno);
+        return;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = s };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, s, &ev) < 0) {
+        tloge("epoll_ctl add server socket failed, errno=%d\n", errno);
+        goto CLOSE_EPOLL;
+    }
 
-        ret = RecvCaMsg(s2, caInfo);
-        if (ret != 0) {
-            tloge("tee ca daemon recvmsg failed\n");
-            goto CLOSE_SOCKET;
+    for (; started < CA_SERVER_WORKERS; started++) {
+        if (pthread_create(&workers[started], NULL, CaServerWorker, &g_caServer) != 0) {
+            tloge("create ca server worker failed, errno=%d\n", errno);
+            break;
         }
+    }
+    if (started == 0) {
+        goto CLOSE_EPOLL;
+    }
+    tlogd("ca server started %u workers\n", started);
 
-        TrySyncSysTimeToSecure();
-
-        ret = ProcessCaMsg(&cr, caInfo, s2);
-        if (ret != 0) {
-            tloge("Failed to process ca msg. ret=%d\n", ret);
-            goto CLOSE_SOCKET;
+    while (1) {
+        tlogd("Waiting for a connection...target daemon\n");
+        int n = epoll_wait(epfd, events, CA_SERVER_EPOLL_EVENTS, -1);
+        if (n < 0 && errno == EINTR) {
+            continue;
         }
-
-    CLOSE_SOCKET:
-        tlogd("close_socket and curret ret=%u\n", ret);
-        (void)close(s2);
-        errno_t rc = memset_s(caInfo, sizeof(CaRevMsg), 0, sizeof(CaRevMsg));
-        if (rc != EOK) {
-            tloge("ca_info memset_s failed\n");
+        if (n < 0) {
+            tloge("epoll_wait failed, errno=%d\n", errno);
+            break;
         }
+        if (n > 0 && AcceptClients(&g_caServer, s) != 0) {
+            break;
+        }
+    }
+
+    (void)pthread_mutex_lock(&g_caServer.lock);
+    g_caServer.stopping = true;
+    (void)pthread_cond_broadcast(&g_caServer.notEmpty);
+    (void)pthread_cond_broadcast(&g_caServer.notFull);
+    (void)pthread_mutex_unlock(&g_caServer.lock);
+    for (uint32_t i = 0; i < started; i++) {
+        (void)pthread_join(workers[i], NULL);
     }
+
+CLOSE_EPOLL:
+    (void)close(epfd);
 }
 
 static int FormatSockAddr(struct sockaddr_un *local, socklen_t *len)
@@ -351,7 +595,6 @@ static int32_t CreateSocket(void)
 void *CaServerWorkThread(void *dummy)
 {
     (void)dummy;
-    CaRevMsg *caInfo = NULL;
 
     int32_t s = CreateSocket();
     if (s < 0) {
@@ -359,27 +602,14 @@ void *CaServerWorkThread(void *dummy)
     }
 
     /* Start listening on the socket */
-    if (listen(s, BACKLOG_LEN) < 0) {
+    if (listen(s, CA_SERVER_BACKLOG) < 0) {
         tloge("listen() failed, errno=%d\n", errno);
         goto CLOSE_EXIT;
     }
 
     tlogv("\n********* deamon successfully initialized!***\n");
 
-    caInfo = (CaRevMsg *)malloc(sizeof(CaRevMsg));
-    if (caInfo == NULL) {
-        tloge("ca server: Failed to malloc caInfo\n");
-        goto CLOSE_EXIT;
-    }
-
-    if (memset_s(caInfo, sizeof(CaRevMsg), 0, sizeof(CaRevMsg)) != EOK) {
-        tloge("ca_info memset_s failed\n");
-        free(caInfo);
-        goto CLOSE_EXIT;
-    }
-
-    ProcessAccept(s, caInfo);
-    free(caInfo);
+    ProcessAccept(s);
 
     tlogv("\n********* deamon process_accept over!***\n");
 
@@ -71,6 +71,7 @@ int main(void)
 
     /* sync time to tee should be before ta&driver load to tee for v3.1 signature */
     TrySyncSysTimeToSecure();
+    StartTimeSyncThread();
 
 #ifdef DYNAMIC_CRYPTO_DRV_DIR
     LoadDynamicCryptoDir();